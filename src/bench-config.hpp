@@ -0,0 +1,148 @@
+#ifndef LAB2_BENCH_CONFIG_H
+#define LAB2_BENCH_CONFIG_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "cache.hpp"
+
+#define CACHE_FLAGS_USAGE "[--cache-size=BYTES] [--block-size=BYTES] [--policy=clock|2q|arc] [--shards=N] [--readahead=BLOCKS] [--dirty-ratio=PCT] [--dirty-expire=MS] [--writeback=0|1] [--huge-pages=0|1] [--mlock=0|1] [--bypass=BYTES] [--async-depth=N] [--compressed-size=BYTES] [--shared-cache=NAME] [--shared-size=BYTES] [--deferred-close=0|1] [--numa-nodes=N] [--numa-policy=interleave|file] [--record=TRACE]"
+
+// Размер с необязательным суффиксом K/M/G: "64K" -> 65536
+inline size_t parse_size(const std::string& value) {
+    size_t suffix_position = 0;
+    size_t size = std::stoull(value, &suffix_position);
+    if (suffix_position < value.size()) {
+        switch (value[suffix_position]) {
+            case 'K': case 'k': size <<= 10; break;
+            case 'M': case 'm': size <<= 20; break;
+            case 'G': case 'g': size <<= 30; break;
+            default: throw std::invalid_argument("bad size suffix: " + value);
+        }
+    }
+    return size;
+}
+
+inline bool parse_numa_policy(const std::string& name, Lab2NumaPolicy& policy) {
+    if (name == "interleave") {
+        policy = LAB2_NUMA_INTERLEAVE;
+        return true;
+    }
+    if (name == "file") {
+        policy = LAB2_NUMA_FILE_HOME;
+        return true;
+    }
+    return false;
+}
+
+inline bool parse_policy(const std::string& name, Lab2EvictionPolicy& policy) {
+    if (name == "clock") {
+        policy = LAB2_POLICY_CLOCK;
+        return true;
+    }
+    if (name == "2q") {
+        policy = LAB2_POLICY_2Q;
+        return true;
+    }
+    if (name == "arc") {
+        policy = LAB2_POLICY_ARC;
+        return true;
+    }
+    return false;
+}
+
+// Разбор общего для бенчмарков флага конфигурации кэша; false, если флаг не распознан
+inline bool parse_cache_flag(const std::string& arg, Lab2Config& config) {
+    const size_t separator = arg.find('=');
+    if (arg.rfind("--", 0) != 0 || separator == std::string::npos) {
+        return false;
+    }
+
+    const std::string name = arg.substr(2, separator - 2);
+    const std::string value = arg.substr(separator + 1);
+    if (name == "cache-size") {
+        config.cache_capacity = parse_size(value);
+    } else if (name == "block-size") {
+        config.block_size = parse_size(value);
+    } else if (name == "shards") {
+        config.shard_count = std::stoull(value);
+    } else if (name == "readahead") {
+        config.readahead_max_blocks = std::stoull(value);
+        config.readahead_disabled = config.readahead_max_blocks == 0;
+    } else if (name == "dirty-ratio") {
+        config.dirty_ratio = static_cast<unsigned int>(std::stoul(value));
+    } else if (name == "dirty-expire") {
+        config.dirty_expire_ms = static_cast<unsigned int>(std::stoul(value));
+    } else if (name == "writeback") {
+        config.writeback_disabled = std::stoi(value) == 0;
+    } else if (name == "huge-pages") {
+        config.huge_pages = std::stoi(value) != 0;
+    } else if (name == "mlock") {
+        config.lock_memory = std::stoi(value) != 0;
+    } else if (name == "bypass") {
+        config.bypass_threshold = parse_size(value);
+    } else if (name == "async-depth") {
+        config.async_queue_depth = static_cast<unsigned int>(std::stoul(value));
+    } else if (name == "compressed-size") {
+        config.compressed_capacity = parse_size(value);
+    } else if (name == "shared-cache") {
+        // Конфигурация хранит указатель: строка живет до конца программы
+        static std::string shared_cache_name;
+        shared_cache_name = value;
+        config.shared_cache_name = shared_cache_name.c_str();
+    } else if (name == "shared-size") {
+        config.shared_cache_capacity = parse_size(value);
+    } else if (name == "deferred-close") {
+        config.deferred_close = std::stoi(value) != 0;
+    } else if (name == "numa-nodes") {
+        config.numa_nodes = std::stoull(value);
+    } else if (name == "numa-policy") {
+        if (!parse_numa_policy(value, config.numa_policy)) {
+            std::cerr << "Unknown NUMA policy: " << value << std::endl;
+            return false;
+        }
+    } else if (name == "policy") {
+        if (!parse_policy(value, config.eviction_policy)) {
+            std::cerr << "Unknown eviction policy: " << value << std::endl;
+            return false;
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+typedef std::map<std::string, std::string> BenchmarkFlags; // Собственные флаги бенчмарка: имя -> значение
+
+// Позиционные аргументы отделяются от флагов; конфигурация применяется через lab2_init,
+// флаги из own_flags и флаги вывода статистики (--stats, --stats-interval) складываются в flags.
+// --record=TRACE сразу начинает запись трассы вызовов (lab2_trace_start)
+inline bool parse_benchmark_args(int argc, char* argv[], std::vector<std::string>& positional, Lab2Config& config,
+                                 BenchmarkFlags* flags = nullptr, const std::vector<std::string>& own_flags = {}) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+
+        const size_t separator = arg.find('=');
+        const std::string name = arg.substr(2, separator == std::string::npos ? std::string::npos : separator - 2);
+        const bool stats_flag = name == "stats" || name == "stats-interval";
+        if (name == "record" && separator != std::string::npos) {
+            if (lab2_trace_start(arg.substr(separator + 1).c_str()) != 0) {
+                return false;
+            }
+        } else if (flags && (stats_flag || std::find(own_flags.begin(), own_flags.end(), name) != own_flags.end())) {
+            (*flags)[name] = separator == std::string::npos ? "1" : arg.substr(separator + 1);
+        } else if (!parse_cache_flag(arg, config)) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
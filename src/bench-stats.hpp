@@ -0,0 +1,109 @@
+#ifndef LAB2_BENCH_STATS_H
+#define LAB2_BENCH_STATS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "cache.hpp"
+#include "bench-config.hpp"
+
+#define STATS_FLAGS_USAGE "[--stats=json|prometheus] [--stats-interval=MS]"
+
+constexpr double STATS_QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+inline void write_stats_json(std::ostream& out, const Lab2Stats& stats) {
+    out << "{\"counters\":{";
+    for (int i = 0; i < LAB2_STAT_COUNT; ++i) {
+        out << (i ? "," : "") << "\"" << lab2_counter_name(static_cast<Lab2Counter>(i)) << "\":" << stats.counters[i];
+    }
+    out << "},\"latency_ns\":{";
+    for (int kind = 0; kind < LAB2_LATENCY_COUNT; ++kind) {
+        const Lab2Histogram& histogram = stats.latency[kind];
+        out << (kind ? "," : "") << "\"" << lab2_latency_name(static_cast<Lab2LatencyKind>(kind)) << "\":{\"count\":"
+            << histogram.count << ",\"mean\":" << (histogram.count ? histogram.total_ns / histogram.count : 0);
+        for (const double quantile : STATS_QUANTILES) {
+            out << ",\"p" << quantile * 100 << "\":" << lab2_histogram_percentile(&histogram, quantile);
+        }
+        out << ",\"max\":" << lab2_histogram_percentile(&histogram, 1.0) << "}";
+    }
+    out << "}}\n";
+}
+
+// Текстовый формат Prometheus: счетчики как counter, гистограммы как summary в секундах
+inline void write_stats_prometheus(std::ostream& out, const Lab2Stats& stats) {
+    for (int i = 0; i < LAB2_STAT_COUNT; ++i) {
+        const std::string name = std::string("lab2_") + lab2_counter_name(static_cast<Lab2Counter>(i)) + "_total";
+        out << "# TYPE " << name << " counter\n" << name << " " << stats.counters[i] << "\n";
+    }
+    for (int kind = 0; kind < LAB2_LATENCY_COUNT; ++kind) {
+        const Lab2Histogram& histogram = stats.latency[kind];
+        const std::string name = std::string("lab2_") + lab2_latency_name(static_cast<Lab2LatencyKind>(kind)) + "_latency_seconds";
+        out << "# TYPE " << name << " summary\n";
+        for (const double quantile : STATS_QUANTILES) {
+            out << name << "{quantile=\"" << quantile << "\"} " << lab2_histogram_percentile(&histogram, quantile) * 1e-9 << "\n";
+        }
+        out << name << "_sum " << histogram.total_ns * 1e-9 << "\n" << name << "_count " << histogram.count << "\n";
+    }
+}
+
+// С --stats печатает снимок lab2_get_stats в stderr каждые --stats-interval мс (по умолчанию 1000)
+// и еще раз при разрушении, после всех замеров
+class StatsDumper {
+public:
+    explicit StatsDumper(BenchmarkFlags& flags) {
+        if (!flags.count("stats")) {
+            return;
+        }
+        prometheus = flags["stats"] == "prometheus";
+        const auto interval = std::chrono::milliseconds(flags.count("stats-interval") ? std::stoul(flags["stats-interval"]) : 1000);
+        enabled = true;
+        if (interval.count() > 0) {
+            worker = std::thread([this, interval] {
+                std::unique_lock<std::mutex> lock(this->lock);
+                while (!wakeup.wait_for(lock, interval, [this] { return stopping; })) {
+                    dump();
+                }
+            });
+        }
+    }
+
+    ~StatsDumper() {
+        if (worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            wakeup.notify_one();
+            worker.join();
+        }
+        if (enabled) {
+            dump();
+        }
+    }
+
+    void dump() const {
+        Lab2Stats stats;
+        lab2_get_stats(&stats);
+        std::ostringstream out;
+        if (prometheus) {
+            write_stats_prometheus(out, stats);
+        } else {
+            write_stats_json(out, stats);
+        }
+        std::cerr << out.str() << std::flush;
+    }
+
+private:
+    bool enabled = false;
+    bool prometheus = false;
+    bool stopping = false;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::thread worker;
+};
+
+#endif
@@ -1,353 +1,3421 @@
 #include "cache.hpp"
-#include <windows.h>
+#include "compression.hpp"
+#include "eviction.hpp"
+#include "shared_cache.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <map>
+#include <unordered_map>
+#include <set>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <deque>
 #include <cstring>
 #include <chrono>
 #include <numeric>
 #include <algorithm>
+#include <cstdio>
+#include <fstream>
 
-static unsigned long cache_hits = 0;
-static unsigned long cache_misses = 0;
+struct CacheKey {
+    LONGLONG file_id;
+    LONGLONG block_id;
+
+    bool operator==(const CacheKey& other) const {
+        return file_id == other.file_id && block_id == other.block_id;
+    }
+};
 
 struct CacheBlock {
+    CacheKey key; // (file_id, block_id)
     char* data;
+    bool is_used; // Занят ли слот
     bool is_dirty; // Изменен ли блок
-    bool was_accessed; // Был ли блок недавно использован
+    bool is_prefetched; // Загружен упреждающим чтением и еще не прочитан
+    bool is_writeback; // Блок сейчас пишет фоновый поток: вытеснять нельзя
+    bool is_reserved; // Вызывающий заполняет блок на месте (lab2_write_reserve)
+    bool is_loading; // Слот занят промахом, чтение с диска еще идет: данных пока нет
+    struct AsyncBlockLoad* async_load; // Чтение идет через кольцо: к нему можно присоединиться
+    uint32_t pin_count; // Закрепления lab2_read_pinned / lab2_write_reserve: вытеснять нельзя
+    uint32_t generation; // Счетчик изменений: запись на диск снимает is_dirty, только если он не сдвинулся
+    LONGLONG dirty_since; // Момент (мс), когда блок стал грязным
+    // Действительный диапазон байт: промах записи не читает блок с диска, недостающие байты
+    // дочитываются только перед чтением из блока или записью его на диск
+    uint32_t valid_begin;
+    uint32_t valid_end;
+    // Соседи в списке занятых слотов того же файла в сегменте; -1 — соседа нет
+    int32_t file_prev;
+    int32_t file_next;
+};
+
+// Состояние детектора последовательного доступа дескриптора
+struct ReadaheadState {
+    LONGLONG last_block = -1; // Последний блок предыдущего чтения
+    unsigned int sequential_run = 0; // Сколько чтений подряд шли последовательно
+    LONGLONG next_block = 0; // Первый блок, который еще не запрошен упреждением
+    size_t window = 0; // Текущий размер окна упреждения в блоках
+};
+
+struct FileDescriptor;
+
+// Состояние открытого файла, общее для всех его дескрипторов (как inode). Создается первым
+// lab2_open файла и удаляется последним lab2_close; все поля, кроме size, под fd_table_lock
+struct SharedFile {
+    // Логический размер. Запись за конец увеличивает его раньше, чем данные могут уйти на диск,
+    // поэтому усечение по нему в lab2_fsync не отрезает записанное
+    std::atomic<LONGLONG> size{0};
+    size_t sector_size = 0; // Запрашивается у устройства один раз на файл
+    size_t open_count = 0; // Дескрипторы в fd_table, включая закрывающиеся
+    size_t active_count = 0; // Дескрипторы, для которых еще не вызван lab2_close
+    size_t active_writers = 0; // Из них открытые на запись
+    FileDescriptor* writeback = nullptr; // Через него пишутся грязные блоки; записывающий, если такой есть
+    std::atomic<unsigned long long> counters[LAB2_STAT_COUNT] = {}; // Сумма вызовов через дескрипторы файла
+
+    // Групповая фиксация lab2_fsync / lab2_fdatasync; поля ниже под sync_lock. Вызов получает номер,
+    // и фиксация, начатая после его прихода, покрывает все номера до нее
+    std::mutex sync_lock;
+    std::condition_variable sync_done;
+    unsigned long long sync_requested = 0; // Номер последнего пришедшего вызова
+    unsigned long long sync_completed = 0; // Вызовы до этого номера зафиксированы
+    bool sync_running = false;
+    bool sync_metadata = false; // Кто-то из ждущих вызвал lab2_fsync: группе нужен полный сброс
+    int sync_result = 0; // Итог последней фиксации и код ошибки для ее группы
+    DWORD sync_error = 0;
 };
 
 struct FileDescriptor {
     HANDLE file_handle;
     LONGLONG file_id; // Уникальный идентификатор файла
-    LARGE_INTEGER offset;
+    LONGLONG offset;
+    bool is_writable; // Можно ли через этот дескриптор записывать грязные блоки
+    bool is_readable; // ОС-дескриптор открыт и на чтение: через него дочитываются частичные блоки
+    bool is_closing; // lab2_close начат: дескриптор еще может писать блоки, но не выбирается для записи
+    SharedFile* file;
+    size_t sector_size; // Выравнивание буферов для чтения/записи в обход кэша
+    bool is_mapped; // Открыт с LAB2_OPEN_MAPPED: чтения идут из отображения
+    const char* mapping; // nullptr у пустого файла
+    size_t mapping_size;
+    PlatformAccessHint mapping_hint; // Последняя подсказка ОС о характере доступа, под readahead_lock
+    std::atomic<uint32_t> mapped_reads{0}; // Счетчик для выборочной проверки резидентности
+    std::mutex lock; // Защищает offset: один вызов read/write/lseek за раз
+    std::mutex readahead_lock; // Защищает readahead: его обновляют и lab2_pread без lock
+    ReadaheadState readahead;
+};
+
+struct ReadaheadRequest {
+    HANDLE file_handle;
+    LONGLONG file_id;
+    LONGLONG first_block;
+    size_t block_count;
+};
+
+// Пул фоновых потоков упреждающего чтения
+struct ReadaheadPool {
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::deque<ReadaheadRequest> queue;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    ~ReadaheadPool();
+};
+
+// Фоновый поток записи грязных блоков
+struct Flusher {
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::thread worker;
+    std::atomic<bool> pending{false}; // Запрошен внеочередной проход
+    bool stopping = false;
+
+    ~Flusher();
+};
+
+// Файл из сохраненного состояния кэша и его блоки для прогрева
+struct WarmupFile {
+    std::string path;
+    LONGLONG file_id;
+    std::vector<LONGLONG> hot_blocks; // Отсортированы: читаются первыми, подряд идущие — одним вызовом
+    std::vector<LONGLONG> cold_blocks;
+};
+
+// Фоновый поток, читающий блоки после lab2_load_cache_state
+struct WarmupLoader {
+    std::thread worker;
+    std::atomic<bool> stopping{false};
+    std::vector<WarmupFile> files;
+
+    ~WarmupLoader();
+};
+
+// Промах, под который уже занят слот: блок помечен is_loading и закреплен до конца чтения
+struct PendingLoad {
+    LONGLONG block_id;
+    struct CacheShard* shard;
+    int32_t slot;
+    size_t buffer_offset; // Куда в буфере вызывающего копировать данные блока
+    size_t block_offset;
+    size_t length;
+};
+
+// Асинхронное чтение ждет свои блоки, которые читает кольцо; завершается последним из них
+struct AsyncRead {
+    Lab2AsyncQueue* queue;
+    char* buffer;
+    size_t count;
+    void* user_data;
+    std::atomic<size_t> waiting_blocks; // Плюс одна ссылка у отправителя, пока он обходит блоки
+    std::atomic<bool> failed;
+};
+
+struct LoadWaiter {
+    AsyncRead* read;
+    size_t buffer_offset;
+    size_t block_offset;
+    size_t length;
+};
+
+struct AsyncBlockLoad {
+    struct CacheShard* shard;
+    int32_t slot;
+    std::vector<LoadWaiter> waiters; // Первый — запрос, вызвавший промах, остальные присоединились
+};
+
+// Серия подряд идущих промахов, читаемая одной операцией кольца
+struct AsyncRun {
+    HANDLE file_handle;
+    LONGLONG first_block;
+    size_t block_count;
+    std::deque<AsyncBlockLoad> blocks; // deque: адреса элементов не меняются при росте
+    std::vector<PlatformIoVec> vectors;
+    uint64_t shared_generation; // Поколение записей сегмента разделяемой памяти до чтения серии
+};
+
+// Кольцо io_uring на весь кэш: отправляют вызывающие потоки, завершения разбирает свой поток
+struct AsyncRing {
+    std::mutex lock; // Отправка в кольцо и пулы
+    std::condition_variable room; // Уменьшилось число операций в полете
+    PlatformAsyncRing* ring = nullptr;
+    std::thread reaper;
+    size_t depth = 0;
+    size_t in_flight = 0;
+    bool unavailable = false; // Кольцо не создалось: асинхронные запросы выполняются синхронно
+    std::vector<std::unique_ptr<AsyncRun>> runs;
+    std::vector<AsyncRun*> free_runs;
+    std::vector<std::unique_ptr<AsyncRead>> reads;
+    std::vector<AsyncRead*> free_reads;
+
+    ~AsyncRing();
+};
+
+struct FlushCandidate {
+    LONGLONG block_id;
+    struct CacheShard* shard;
+    int32_t slot;
+    uint32_t generation;
+};
+
+// Сегмент кэша со своей блокировкой; блок попадает в сегмент по хэшу (file_id, block_id)
+struct CacheShard {
+    std::mutex lock;
+    // Кольцо слотов фиксированного размера, по которому ходит стрелка clock
+    std::vector<CacheBlock> slots;
+    std::vector<uint32_t> free_slots;
+    // Индекс с открытой адресацией (линейное пробирование): (file_id, block_id) -> номер слота
+    std::vector<int32_t> index;
+    size_t index_mask = 0;
+    std::unique_ptr<EvictionPolicy> policy; // Порядок вытеснения слотов сегмента
+    std::condition_variable block_released; // Блок сегмента освободился: закончилась запись, снято закрепление
+    // Упорядоченные номера грязных блоков каждого файла: fsync и фоновая запись не обходят весь кэш
+    std::unordered_map<LONGLONG, std::set<LONGLONG>> dirty_by_file;
+    // file_id -> первый слот списка блоков файла в сегменте: усечение не обходит весь кэш
+    std::unordered_map<LONGLONG, int32_t> file_blocks;
+    std::unique_ptr<CompressedTier> compressed; // Сжатые копии вытесненных блоков; nullptr — уровня нет
+    size_t partition = 0; // Раздел NUMA: буферы, слоты и индекс сегмента лежат в памяти его узла
+};
+
+constexpr int32_t EMPTY_INDEX_ENTRY = -1;
+constexpr int32_t RETRY_CACHE_LOOKUP = -2; // Блокировка сегмента отпускалась: поиск блока нужно повторить
+constexpr int32_t WRITEBACK_FAILED = -3; // Слот не освободился: грязную жертву не удалось записать, она осталась в кэше
+constexpr size_t READAHEAD_MIN_WINDOW = 4; // Начальное окно упреждения в блоках
+constexpr unsigned int READAHEAD_TRIGGER_RUN = 2; // Последовательных чтений до включения упреждения
+constexpr size_t READAHEAD_MAX_QUEUE = 64; // Запросы сверх очереди отбрасываются
+constexpr size_t READAHEAD_THREADS = 2;
+constexpr size_t FLUSH_MAX_RUN_BLOCKS = 256; // Максимум блоков в одной объединенной записи
+constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(100);
+constexpr size_t EVICTION_DIRTY_SKIP_LIMIT = 32; // Сколько грязных кандидатов можно пропустить до синхронной записи
+constexpr size_t READ_BATCH_MAX_BLOCKS = 256; // Максимум промахов, собираемых до одного прохода чтения
+constexpr int BYPASS_READ_ATTEMPTS = 4; // Попыток чтения в обход кэша, прежде чем читать через кэш
+constexpr size_t WARMUP_MAX_RUN_BLOCKS = 256; // Максимум блоков в одном чтении прогрева
+constexpr LONGLONG WARMUP_MAX_GAP_BLOCKS = 8; // Промежуток между блоками, который прогрев читает, а не пропускает
+constexpr char CACHE_STATE_MAGIC[8] = { 'L', 'A', 'B', '2', 'W', 'A', 'R', 'M' };
+constexpr uint32_t CACHE_STATE_VERSION = 1;
+constexpr uint32_t MAPPED_RESIDENCY_SAMPLE = 8; // Резидентность страниц проверяет каждое 8-е чтение из отображения
+constexpr size_t FILE_HOME_BUCKETS = 4096; // Корзины file_id с разделом NUMA файла (LAB2_NUMA_FILE_HOME)
+constexpr uint16_t NO_HOME_PARTITION = UINT16_MAX;
+
+// Порядок блокировок: lock дескриптора -> lock сегмента -> fd_table_lock (на чтение);
+// lock сегмента -> async_ring.lock, lock очереди Lab2AsyncQueue
+struct Lab2AsyncQueue {
+    std::mutex lock;
+    std::condition_variable completed_changed;
+    std::deque<Lab2AsyncCompletion> completed;
+    size_t outstanding = 0; // Запросы, чье завершение еще не в completed
+};
+
+std::shared_mutex fd_table_lock;
+std::map<HANDLE, FileDescriptor> fd_table;
+std::unordered_map<LONGLONG, SharedFile> shared_files; // file_id -> состояние открытого файла
+// file_id -> путь последнего открытия: блоки закрытого файла остаются в кэше, и сохранению
+// состояния нужен путь, чтобы при загрузке открыть файл снова
+std::unordered_map<LONGLONG, std::string> file_paths;
+
+std::vector<std::unique_ptr<CacheShard>> cache_shards;
+size_t cache_capacity = DEFAULT_CACHE_CAPACITY / DEFAULT_BLOCK_SIZE; // В блоках
+size_t shard_count = DEFAULT_SHARD_COUNT;
+size_t block_size = DEFAULT_BLOCK_SIZE;
+unsigned int block_shift = 12; // log2(block_size)
+Lab2EvictionPolicy eviction_policy = LAB2_POLICY_CLOCK;
+size_t readahead_max_blocks = DEFAULT_READAHEAD_MAX_BLOCKS; // 0 — упреждение выключено
+bool writeback_enabled = true;
+unsigned int dirty_ratio = DEFAULT_DIRTY_RATIO; // Процент грязных блоков, после которого пишем все
+LONGLONG dirty_expire_ms = DEFAULT_DIRTY_EXPIRE_MS; // Возраст, после которого грязный блок пишется
+std::atomic<size_t> dirty_blocks{0};
+bool use_huge_pages = false;
+bool lock_cache_memory = false;
+size_t bypass_threshold = 0; // 0 — запросы не обходят кэш
+unsigned int async_queue_depth = DEFAULT_ASYNC_QUEUE_DEPTH;
+size_t compressed_capacity = 0; // В байтах; 0 — сжатого уровня нет
+bool deferred_close = false;
+// Хэндлы, закрытые с отложенной записью: еще в fd_table, пока у файла есть грязные блоки; под fd_table_lock
+std::vector<HANDLE> deferred_handles;
+std::string shared_cache_name; // Пустое — сегмента разделяемой памяти нет
+size_t shared_cache_capacity = DEFAULT_SHARED_CACHE_CAPACITY;
+std::unique_ptr<SharedBlockCache> shared_block_cache;
+
+size_t numa_nodes = 0; // Разделов кэша по узлам NUMA; 0 — по числу узлов системы
+Lab2NumaPolicy numa_policy = LAB2_NUMA_INTERLEAVE;
+// Сегменты раздела p — cache_shards[p * partition_shards, (p + 1) * partition_shards)
+size_t numa_partitions = 1;
+size_t partition_shards = 0;
+std::vector<uint16_t> cpu_partitions; // Номер процессора -> раздел его узла
+std::unique_ptr<std::atomic<uint16_t>[]> file_home_partitions; // FILE_HOME_BUCKETS корзин; только с LAB2_NUMA_FILE_HOME
+
+struct CacheArena {
+    char* data;
+    size_t size;
+};
+
+// Буферы всех блоков выделяются при первом открытии файла, по одной области на раздел NUMA:
+// промахи и вытеснения не обращаются к аллокатору, а слот навсегда владеет своим участком области
+std::vector<CacheArena> cache_arenas;
+
+// Увеличивается при каждой записи блока на диск: упреждение не кладет в кэш данные,
+// прочитанные с диска до записи более новой версии
+std::atomic<unsigned long> disk_write_generation{0};
+ReadaheadPool readahead_pool;
+Flusher flusher;
+AsyncRing async_ring;
+WarmupLoader warmup_loader;
+
+FileDescriptor& get_file_descriptor(const HANDLE file_handle) {
+    std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+    const auto iterator = fd_table.find(file_handle);
+    if (iterator == fd_table.end()) {
+        static FileDescriptor invalid_fd = { INVALID_HANDLE_VALUE, -1, 0, false, false, false, nullptr };
+        return invalid_fd;
+    }
+    return iterator->second;
+}
+
+// Дескриптор, через который пишутся грязные блоки файла; вызывается под fd_table_lock
+static FileDescriptor* get_writeback_descriptor(const LONGLONG file_id) {
+    const auto file = shared_files.find(file_id);
+    return file == shared_files.end() ? nullptr : file->second.writeback;
+}
+
+static LONGLONG get_file_size(const FileDescriptor& descriptor) {
+    return descriptor.file->size.load(std::memory_order_acquire);
+}
+
+// Запись за конец файла сначала увеличивает размер, затем помечает блоки грязными
+static void extend_file_size(const FileDescriptor& descriptor, const LONGLONG end) {
+    std::atomic<LONGLONG>& file_size = descriptor.file->size;
+    LONGLONG size = file_size.load(std::memory_order_relaxed);
+    while (size < end && !file_size.compare_exchange_weak(size, end, std::memory_order_acq_rel)) {
+    }
+}
+
+// Разница счетчиков потока за вызов через хэндл достается файлу дескриптора; с timed время
+// вызова идет в гистограмму промахов, если вызов читал диск, иначе — попаданий
+struct FileCallStats {
+    FileCallStats(const FileDescriptor& descriptor, const bool timed)
+        : file(*descriptor.file), slot(local_stats()), timed(timed), start(std::chrono::steady_clock::now()) {
+        for (size_t i = 0; i < LAB2_STAT_COUNT; ++i) {
+            before[i] = slot.counters[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    ~FileCallStats() {
+        unsigned long long delta[LAB2_STAT_COUNT];
+        for (size_t i = 0; i < LAB2_STAT_COUNT; ++i) {
+            delta[i] = slot.counters[i].load(std::memory_order_relaxed) - before[i];
+            if (delta[i] != 0) {
+                file.counters[i].fetch_add(delta[i], std::memory_order_relaxed);
+            }
+        }
+        if (timed) {
+            const bool missed = delta[LAB2_STAT_MISSES] != 0 || delta[LAB2_STAT_DISK_READS] != 0;
+            record_latency(missed ? LAB2_LATENCY_MISS : LAB2_LATENCY_HIT, start);
+        }
+    }
+
+    SharedFile& file;
+    StatsSlot& slot;
+    const bool timed;
+    const std::chrono::steady_clock::time_point start;
+    unsigned long long before[LAB2_STAT_COUNT];
 };
 
-typedef std::pair<LONGLONG, LONGLONG> CacheKey; // (file_id, block_id)
+int lab2_get_stats(Lab2Stats* stats) {
+    if (!stats) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    collect_stats(stats, false);
+    return 0;
+}
+
+int lab2_get_file_stats(const HANDLE file_handle, unsigned long long counters[LAB2_STAT_COUNT]) {
+    std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+    const auto iterator = fd_table.find(file_handle);
+    if (iterator == fd_table.end()) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+    if (!counters) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    for (size_t i = 0; i < LAB2_STAT_COUNT; ++i) {
+        counters[i] = iterator->second.file->counters[i].load(std::memory_order_relaxed);
+    }
+    return 0;
+}
+
+static unsigned long get_counter(const Lab2Counter counter) {
+    return static_cast<unsigned long>(collect_counter(counter));
+}
+
+unsigned long lab2_get_cache_hits() {
+    return get_counter(LAB2_STAT_HITS);
+}
+
+unsigned long lab2_get_cache_misses() {
+    return get_counter(LAB2_STAT_MISSES);
+}
+
+unsigned long lab2_get_readahead_hits() {
+    return get_counter(LAB2_STAT_READAHEAD_HITS);
+}
+
+unsigned long lab2_get_readahead_wasted() {
+    return get_counter(LAB2_STAT_READAHEAD_WASTED);
+}
+
+unsigned long lab2_get_disk_reads() {
+    return get_counter(LAB2_STAT_DISK_READS);
+}
+
+unsigned long lab2_get_fsync_write_bytes() {
+    return get_counter(LAB2_STAT_FSYNC_WRITE_BYTES);
+}
+
+unsigned long lab2_get_fsync_write_ios() {
+    return get_counter(LAB2_STAT_FSYNC_WRITES);
+}
+
+unsigned long lab2_get_coalesced_misses() {
+    return get_counter(LAB2_STAT_COALESCED_MISSES);
+}
+
+void lab2_reset_cache_counters() {
+    reset_stats();
+}
+
+static size_t hash_cache_key(const CacheKey& key) {
+    // Перемешивание splitmix64, чтобы соседние блоки не попадали в соседние ячейки
+    uint64_t x = static_cast<uint64_t>(key.file_id) * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(key.block_id);
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return static_cast<size_t>(x);
+}
+
+// Раздел узла, на котором сейчас выполняется поток
+static size_t current_partition() {
+    const int cpu = platform_current_cpu();
+    return cpu >= 0 && static_cast<size_t>(cpu) < cpu_partitions.size() ? cpu_partitions[cpu] : 0;
+}
+
+// Раздел файла при LAB2_NUMA_FILE_HOME: узел потока, первым открывшего файл. Раздел закреплен
+// за корзиной file_id до следующей разметки кэша: блоки закрытого файла остаются на своем месте,
+// а файлы одной корзины живут на одном узле
+static size_t file_home_partition(const LONGLONG file_id) {
+    std::atomic<uint16_t>& home = file_home_partitions[hash_cache_key({ file_id, 0 }) & (FILE_HOME_BUCKETS - 1)];
+    const uint16_t partition = home.load(std::memory_order_relaxed);
+    if (partition != NO_HOME_PARTITION) {
+        return partition;
+    }
+    uint16_t expected = NO_HOME_PARTITION;
+    const uint16_t local = static_cast<uint16_t>(current_partition());
+    return home.compare_exchange_strong(expected, local, std::memory_order_relaxed) ? local : expected;
+}
+
+// Старшие биты хэша выбирают сегмент, младшие — ячейку индекса внутри него. Без LAB2_NUMA_FILE_HOME
+// сегменты всех разделов идут подряд, и хэш заодно выбирает раздел
+static CacheShard& get_cache_shard(const CacheKey& key, const size_t hash) {
+    const uint64_t high = static_cast<uint64_t>(hash) >> 32;
+    if (numa_partitions == 1 || numa_policy != LAB2_NUMA_FILE_HOME) {
+        return *cache_shards[(high * cache_shards.size()) >> 32];
+    }
+    return *cache_shards[file_home_partition(key.file_id) * partition_shards + ((high * partition_shards) >> 32)];
+}
+
+// Попадание; при разделении по узлам NUMA еще и местное или удаленное для потока
+static void count_cache_hit(const CacheShard& shard) {
+    count_stat(LAB2_STAT_HITS);
+    if (numa_partitions > 1) {
+        count_stat(shard.partition == current_partition() ? LAB2_STAT_NUMA_LOCAL_HITS : LAB2_STAT_NUMA_REMOTE_HITS);
+    }
+}
+
+static void release_cache_memory() {
+    cache_shards.clear();
+    shared_block_cache.reset();
+    for (const CacheArena& arena : cache_arenas) {
+        platform_free_arena(arena.data, arena.size);
+    }
+    cache_arenas.clear();
+    file_home_partitions.reset();
+    dirty_blocks = 0;
+}
+
+// Сегмент из capacity слотов, чьи буферы идут подряд с начала data
+static std::unique_ptr<CacheShard> make_cache_shard(const size_t shard_id, const size_t shards, const size_t capacity,
+                                                    char* data, const size_t partition) {
+    auto shard = std::make_unique<CacheShard>();
+    shard->partition = partition;
+
+    CacheBlock empty_block = {};
+    empty_block.key = { -1, -1 };
+    shard->slots.assign(capacity, empty_block);
+    for (size_t slot = 0; slot < capacity; ++slot) {
+        shard->slots[slot].data = data + (slot << block_shift);
+    }
+    shard->free_slots.reserve(capacity);
+    for (size_t slot = capacity; slot > 0; --slot) {
+        shard->free_slots.push_back(static_cast<uint32_t>(slot - 1));
+    }
+
+    // Заполненность индекса не больше 50%, чтобы цепочки пробирования оставались короткими
+    size_t index_size = 1;
+    while (index_size < capacity * 2) {
+        index_size <<= 1;
+    }
+    shard->index.assign(index_size, EMPTY_INDEX_ENTRY);
+    shard->index_mask = index_size - 1;
+    shard->policy = make_eviction_policy(eviction_policy, capacity);
+    if (compressed_capacity != 0) {
+        const size_t compressed_bytes = compressed_capacity / shards + (shard_id < compressed_capacity % shards ? 1 : 0);
+        shard->compressed = std::make_unique<CompressedTier>(compressed_bytes, block_size);
+    }
+    return shard;
+}
+
+// Кэш размечается один раз: все структуры дальше работают без выделений памяти
+static bool init_cache() {
+    if (!cache_shards.empty()) {
+        return true;
+    }
+
+    if (!shared_cache_name.empty()) {
+        shared_block_cache = SharedBlockCache::attach(shared_cache_name, shared_cache_capacity, block_size);
+        if (!shared_block_cache) {
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return false;
+        }
+    }
+
+    // Каждому разделу хотя бы один блок и один сегмент
+    const std::vector<unsigned int> system_nodes = platform_numa_nodes();
+    numa_partitions = std::min(numa_nodes ? numa_nodes : system_nodes.size(), cache_capacity);
+    partition_shards = std::max<size_t>(1, std::min(shard_count, cache_capacity) / numa_partitions);
+    const size_t shards = numa_partitions * partition_shards;
+    cpu_partitions.clear();
+    if (numa_partitions > 1) {
+        cpu_partitions.resize(platform_cpu_count(), 0);
+        // Раздел процессора — по месту его узла в списке узлов с памятью; процессоры узлов
+        // без памяти и с неизвестным узлом идут в раздел 0
+        for (size_t cpu = 0; cpu < cpu_partitions.size(); ++cpu) {
+            const int node = platform_numa_node_of_cpu(static_cast<unsigned int>(cpu));
+            const auto position = std::find(system_nodes.begin(), system_nodes.end(), static_cast<unsigned int>(node));
+            const size_t index = node >= 0 && position != system_nodes.end() ? position - system_nodes.begin() : 0;
+            cpu_partitions[cpu] = static_cast<uint16_t>(index % numa_partitions);
+        }
+        if (numa_policy == LAB2_NUMA_FILE_HOME) {
+            file_home_partitions = std::make_unique<std::atomic<uint16_t>[]>(FILE_HOME_BUCKETS);
+            for (size_t bucket = 0; bucket < FILE_HOME_BUCKETS; ++bucket) {
+                file_home_partitions[bucket].store(NO_HOME_PARTITION, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Остаток ёмкости распределяется по первым сегментам
+    const auto shard_capacity = [shards](const size_t shard_id) {
+        return cache_capacity / shards + (shard_id < cache_capacity % shards ? 1 : 0);
+    };
+    bool huge_pages_missing = false;
+    for (size_t partition = 0; partition < numa_partitions; ++partition) {
+        // Раздел p на p-м узле с памятью; разделов больше, чем узлов, — только если так задано в конфигурации
+        const int node = numa_partitions > 1 ? static_cast<int>(system_nodes[partition % system_nodes.size()]) : -1;
+        const size_t first_shard = partition * partition_shards;
+        size_t partition_blocks = 0;
+        for (size_t shard_id = first_shard; shard_id < first_shard + partition_shards; ++shard_id) {
+            partition_blocks += shard_capacity(shard_id);
+        }
+
+        CacheArena arena = { nullptr, partition_blocks << block_shift };
+        bool used_huge_pages = false;
+        arena.data = static_cast<char*>(platform_alloc_arena(arena.size, use_huge_pages, used_huge_pages, node));
+        if (!arena.data) {
+            std::cerr << "cache arena allocation failed: " << GetLastError() << std::endl;
+            release_cache_memory();
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return false;
+        }
+        cache_arenas.push_back(arena);
+        huge_pages_missing = huge_pages_missing || (use_huge_pages && !used_huge_pages);
+        if (lock_cache_memory && platform_lock_memory(arena.data, arena.size) != 0) {
+            std::cerr << "cache memory lock failed: " << GetLastError() << std::endl;
+        }
+
+        const auto build_shards = [&] {
+            char* data = arena.data;
+            for (size_t shard_id = first_shard; shard_id < first_shard + partition_shards; ++shard_id) {
+                const size_t capacity = shard_capacity(shard_id);
+                cache_shards.push_back(make_cache_shard(shard_id, shards, capacity, data, partition));
+                data += capacity << block_shift;
+            }
+        };
+        if (node < 0) {
+            build_shards();
+        } else {
+            // Слоты и индекс выделяются и впервые заполняются потоком на узле раздела, и их страницы
+            // достаются этому узлу
+            std::thread builder([&] {
+                platform_pin_thread_to_node(static_cast<unsigned int>(node));
+                build_shards();
+            });
+            builder.join();
+        }
+    }
+    if (huge_pages_missing) {
+        std::cerr << "huge pages unavailable, cache uses regular pages" << std::endl;
+    }
+    return true;
+}
+
+static void start_background_threads();
+static void stop_background_threads();
+static void close_deferred_files(bool flush);
+
+int lab2_init(const Lab2Config* config) {
+    // Фоновые потоки останавливаются до захвата fd_table_lock: они сами берут его на чтение
+    stop_background_threads();
+    close_deferred_files(true);
+
+    std::unique_lock<std::shared_mutex> table_lock(fd_table_lock);
+    if (!config || !fd_table.empty()) {
+        SetLastError(ERROR_INVALID_PARAMETER); // Конфигурация меняется только без открытых файлов
+        if (!cache_shards.empty()) {
+            start_background_threads();
+        }
+        return -1;
+    }
+
+    const size_t new_block_size = config->block_size ? config->block_size : DEFAULT_BLOCK_SIZE;
+    const size_t new_capacity = config->cache_capacity ? config->cache_capacity : DEFAULT_CACHE_CAPACITY;
+    const size_t new_block_count = new_capacity / new_block_size;
+
+    if (new_block_size < 512 || (new_block_size & (new_block_size - 1)) != 0) {
+        std::cerr << "Block size must be a power of two >= 512" << std::endl;
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    if (new_block_count == 0 || new_block_count > INT32_MAX) {
+        std::cerr << "Cache capacity must hold from 1 to INT32_MAX blocks" << std::endl;
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    if (config->eviction_policy != LAB2_POLICY_CLOCK && config->eviction_policy != LAB2_POLICY_2Q &&
+        config->eviction_policy != LAB2_POLICY_ARC) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    if ((config->numa_policy != LAB2_NUMA_INTERLEAVE && config->numa_policy != LAB2_NUMA_FILE_HOME) ||
+        config->numa_nodes >= NO_HOME_PARTITION) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+
+    release_cache_memory();
+    block_size = new_block_size;
+    block_shift = 0;
+    while ((static_cast<size_t>(1) << block_shift) < block_size) {
+        ++block_shift;
+    }
+    cache_capacity = new_block_count;
+    shard_count = config->shard_count ? config->shard_count : DEFAULT_SHARD_COUNT;
+    eviction_policy = config->eviction_policy;
+    if (config->readahead_disabled) {
+        readahead_max_blocks = 0;
+    } else {
+        readahead_max_blocks = config->readahead_max_blocks ? config->readahead_max_blocks : DEFAULT_READAHEAD_MAX_BLOCKS;
+    }
+    writeback_enabled = !config->writeback_disabled;
+    dirty_ratio = config->dirty_ratio ? std::min(config->dirty_ratio, 100u) : DEFAULT_DIRTY_RATIO;
+    dirty_expire_ms = config->dirty_expire_ms ? config->dirty_expire_ms : DEFAULT_DIRTY_EXPIRE_MS;
+    use_huge_pages = config->huge_pages;
+    lock_cache_memory = config->lock_memory;
+    bypass_threshold = config->bypass_threshold;
+    async_queue_depth = config->async_queue_depth ? config->async_queue_depth : DEFAULT_ASYNC_QUEUE_DEPTH;
+    compressed_capacity = config->compressed_capacity;
+    shared_cache_name = config->shared_cache_name ? config->shared_cache_name : "";
+    shared_cache_capacity = config->shared_cache_capacity ? config->shared_cache_capacity : DEFAULT_SHARED_CACHE_CAPACITY;
+    deferred_close = config->deferred_close;
+    numa_nodes = config->numa_nodes;
+    numa_policy = config->numa_policy;
+    return 0;
+}
+
+size_t lab2_get_block_size() {
+    return block_size;
+}
+
+int lab2_shared_cache_unlink(const char* name) {
+    if (!name || !*name) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    return platform_shm_unlink(name);
+}
+
+static int32_t find_cache_slot(const CacheShard& shard, const CacheKey& key, const size_t hash) {
+    size_t position = hash & shard.index_mask;
+    while (shard.index[position] != EMPTY_INDEX_ENTRY) {
+        const int32_t slot = shard.index[position];
+        if (shard.slots[slot].key == key) {
+            return slot;
+        }
+        position = (position + 1) & shard.index_mask;
+    }
+    return EMPTY_INDEX_ENTRY;
+}
+
+static void insert_cache_index(CacheShard& shard, const size_t hash, const int32_t slot) {
+    size_t position = hash & shard.index_mask;
+    while (shard.index[position] != EMPTY_INDEX_ENTRY) {
+        position = (position + 1) & shard.index_mask;
+    }
+    shard.index[position] = slot;
+}
+
+// Удаление со сдвигом назад: без надгробий цепочки не деградируют со временем
+static void erase_cache_index(CacheShard& shard, const CacheKey& key) {
+    const size_t mask = shard.index_mask;
+    size_t position = hash_cache_key(key) & mask;
+    while (!(shard.slots[shard.index[position]].key == key)) {
+        position = (position + 1) & mask;
+    }
+
+    size_t next = position;
+    while (true) {
+        next = (next + 1) & mask;
+        if (shard.index[next] == EMPTY_INDEX_ENTRY) {
+            break;
+        }
+        const size_t home = hash_cache_key(shard.slots[shard.index[next]].key) & mask;
+        // Элемент можно перенести в дырку, если его домашняя ячейка не лежит в (position, next]
+        if (((next - home) & mask) >= ((next - position) & mask)) {
+            shard.index[position] = shard.index[next];
+            position = next;
+        }
+    }
+    shard.index[position] = EMPTY_INDEX_ENTRY;
+}
+
+static bool is_partial_block(const CacheBlock& block) {
+    return block.valid_end - block.valid_begin < block_size;
+}
+
+// Буфер блока сейчас нельзя менять: его пишет на диск фоновый поток, заполняет вызывающий
+// или в него еще читаются данные с диска
+// Слот становится первым в списке блоков своего файла
+static void link_file_block(CacheShard& shard, const int32_t slot) {
+    CacheBlock& block = shard.slots[slot];
+    const auto [head, inserted] = shard.file_blocks.try_emplace(block.key.file_id, slot);
+    block.file_prev = EMPTY_INDEX_ENTRY;
+    block.file_next = inserted ? EMPTY_INDEX_ENTRY : head->second;
+    if (!inserted) {
+        shard.slots[head->second].file_prev = slot;
+        head->second = slot;
+    }
+}
+
+static void unlink_file_block(CacheShard& shard, const int32_t slot) {
+    const CacheBlock& block = shard.slots[slot];
+    if (block.file_next != EMPTY_INDEX_ENTRY) {
+        shard.slots[block.file_next].file_prev = block.file_prev;
+    }
+    if (block.file_prev != EMPTY_INDEX_ENTRY) {
+        shard.slots[block.file_prev].file_next = block.file_next;
+    } else if (block.file_next != EMPTY_INDEX_ENTRY) {
+        shard.file_blocks[block.key.file_id] = block.file_next;
+    } else {
+        shard.file_blocks.erase(block.key.file_id);
+    }
+}
+
+static bool is_block_busy(const CacheBlock& block) {
+    return block.is_writeback || block.is_reserved || block.is_loading;
+}
+
+// Расширяет действительный диапазон записью [offset, offset + length), если она к нему примыкает
+static bool merge_valid_range(CacheBlock& block, const size_t offset, const size_t length) {
+    if (offset > block.valid_end || offset + length < block.valid_begin) {
+        return false;
+    }
+    block.valid_begin = static_cast<uint32_t>(std::min<size_t>(block.valid_begin, offset));
+    block.valid_end = static_cast<uint32_t>(std::max<size_t>(block.valid_end, offset + length));
+    return true;
+}
+
+static void count_disk_read(const SSIZE_T bytes_read) {
+    count_stat(LAB2_STAT_DISK_READS);
+    if (bytes_read > 0) {
+        count_stat(LAB2_STAT_DISK_READ_BYTES, static_cast<unsigned long long>(bytes_read));
+    }
+}
+
+static void count_disk_write(const SSIZE_T bytes_written) {
+    count_stat(LAB2_STAT_DISK_WRITES);
+    if (bytes_written > 0) {
+        count_stat(LAB2_STAT_DISK_WRITE_BYTES, static_cast<unsigned long long>(bytes_written));
+    }
+}
+
+// Частичному блоку с действительным диапазоном [begin, end) нужны байты с диска: вне диапазона
+// есть байты до конца файла. Остальное за концом файла — нули
+static bool partial_range_needs_disk(const LONGLONG block_id, const size_t begin, const size_t end,
+                                     const LONGLONG file_size) {
+    const LONGLONG block_start = block_id << block_shift;
+    return (begin > 0 && file_size > block_start) || file_size > block_start + static_cast<LONGLONG>(end);
+}
+
+// Частичный блок, чьи недостающие байты целиком за концом файла, дополняется нулями без чтения диска
+static bool complete_block_past_eof(CacheBlock& block, const LONGLONG file_size) {
+    if (!is_partial_block(block)) {
+        return true;
+    }
+    if (partial_range_needs_disk(block.key.block_id, block.valid_begin, block.valid_end, file_size)) {
+        return false;
+    }
+    std::memset(block.data, 0, block.valid_begin);
+    std::memset(block.data + block.valid_end, 0, block_size - block.valid_end);
+    block.valid_begin = 0;
+    block.valid_end = static_cast<uint32_t>(block_size);
+    return true;
+}
+
+// Отложенное чтение-изменение-запись: дочитывает с диска байты вокруг действительного диапазона.
+// Нужен дескриптор, открытый на чтение; байты за концом файла не читаются
+static bool fill_partial_block(CacheBlock& block, const FileDescriptor& descriptor) {
+    if (complete_block_past_eof(block, descriptor.file->size.load(std::memory_order_acquire))) {
+        return true;
+    }
+    const HANDLE file_handle = descriptor.file_handle;
+
+    thread_local std::vector<char> valid_bytes;
+    valid_bytes.assign(block.data + block.valid_begin, block.data + block.valid_end);
+
+    const SSIZE_T bytes_read = platform_pread(file_handle, block.data, block_size, block.key.block_id << block_shift);
+    count_disk_read(bytes_read);
+    if (bytes_read < 0) {
+        std::cerr << "pread failed: " << GetLastError() << std::endl;
+        std::memcpy(block.data + block.valid_begin, valid_bytes.data(), valid_bytes.size());
+        return false;
+    }
+    if (static_cast<size_t>(bytes_read) < block_size) {
+        std::memset(block.data + bytes_read, 0, block_size - bytes_read);
+    }
+
+    std::memcpy(block.data + block.valid_begin, valid_bytes.data(), valid_bytes.size());
+    block.valid_begin = 0;
+    block.valid_end = static_cast<uint32_t>(block_size);
+    return true;
+}
+
+static bool fill_partial_block_from_owner(CacheBlock& block) {
+    if (!is_partial_block(block)) {
+        return true;
+    }
+    std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+    const FileDescriptor* owner = get_writeback_descriptor(block.key.file_id);
+    return owner && fill_partial_block(block, *owner);
+}
+
+// Дескриптор, который ОС не дала открыть на чтение, не сможет дочитать блок: запись [begin, end),
+// после которой блоку понадобятся байты с диска, отвергается сразу, а не теряется при записи блока.
+// block — блок в кэше или nullptr
+static bool can_write_partial(const FileDescriptor& descriptor, const CacheBlock* block, const LONGLONG block_id,
+                              size_t begin, size_t end, const LONGLONG file_size) {
+    if (descriptor.is_readable || end - begin == block_size || (block && !is_partial_block(*block))) {
+        return true;
+    }
+    if (block && begin <= block->valid_end && end >= block->valid_begin) {
+        begin = std::min<size_t>(begin, block->valid_begin);
+        end = std::max<size_t>(end, block->valid_end);
+    }
+    if (!partial_range_needs_disk(block_id, begin, end, file_size)) {
+        return true;
+    }
+    SetLastError(ERROR_INVALID_HANDLE);
+    return false;
+}
+
+// Поколение записей сегмента разделяемой памяти; снимается до чтения блока с диска
+static uint64_t shared_write_generation() {
+    return shared_block_cache ? shared_block_cache->write_generation() : 0;
+}
+
+// Прочитанный с диска целый блок кладется в сегмент для других процессов
+static void publish_shared_block(const CacheKey& key, const char* data, const uint64_t generation) {
+    if (shared_block_cache &&
+        shared_block_cache->insert(key.file_id, key.block_id, hash_cache_key(key), data, generation)) {
+        count_stat(LAB2_STAT_SHARED_INSERTS);
+    }
+}
+
+// Вызывается после записи блока на диск: копия в сегменте устарела
+static void invalidate_shared_block(const CacheKey& key) {
+    if (shared_block_cache) {
+        shared_block_cache->invalidate(key.file_id, key.block_id, hash_cache_key(key));
+    }
+}
+
+// false — блок не записан (не удалось дочитать или записать): он должен остаться грязным
+static bool write_back_block(CacheBlock& block) {
+    // Дескриптор не может закрыться, пока держим fd_table_lock на чтение
+    std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+    const FileDescriptor* owner = get_writeback_descriptor(block.key.file_id);
+    if (!owner) {
+        return true; // Файл закрыт: писать блок некуда
+    }
+
+    const HANDLE file_handle = owner->file_handle;
+    if (!fill_partial_block(block, *owner)) {
+        return false;
+    }
+    disk_write_generation.fetch_add(1, std::memory_order_acq_rel);
+    const auto start = std::chrono::steady_clock::now();
+    const SSIZE_T bytes_written = platform_pwrite(file_handle, block.data, block_size, block.key.block_id << block_shift);
+    record_latency(LAB2_LATENCY_FLUSH, start);
+    count_disk_write(bytes_written);
+    invalidate_shared_block(block.key);
+    if (bytes_written < 0) {
+        std::cerr << "pwrite failed: " << GetLastError() << std::endl;
+        return false;
+    }
+    count_stat(LAB2_STAT_WRITEBACK_BLOCKS);
+    return true;
+}
+
+static LONGLONG now_ms() {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+}
+
+static void wake_flusher() {
+    if (!flusher.pending.exchange(true, std::memory_order_acq_rel)) {
+        std::lock_guard<std::mutex> flusher_lock(flusher.lock);
+        flusher.wakeup.notify_one();
+    }
+}
+
+static void mark_block_dirty(CacheShard& shard, CacheBlock& block) {
+    block.generation++;
+    if (block.is_dirty) {
+        return;
+    }
+    block.is_dirty = true;
+    block.dirty_since = now_ms();
+    shard.dirty_by_file[block.key.file_id].insert(block.key.block_id);
+
+    const size_t dirty = dirty_blocks.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (writeback_enabled && dirty * 100 > cache_capacity * dirty_ratio) {
+        wake_flusher();
+    }
+}
+
+static void mark_block_clean(CacheShard& shard, CacheBlock& block) {
+    if (!block.is_dirty) {
+        return;
+    }
+    block.is_dirty = false;
+    dirty_blocks.fetch_sub(1, std::memory_order_relaxed);
+
+    const auto file_blocks = shard.dirty_by_file.find(block.key.file_id);
+    file_blocks->second.erase(block.key.block_id);
+    if (file_blocks->second.empty()) {
+        shard.dirty_by_file.erase(file_blocks);
+    }
+}
+
+// Сжатая копия вытесняемого блока во втором уровне сегмента
+static void store_compressed_block(CacheShard& shard, const CacheBlock& block) {
+    size_t compressed_size;
+    if (!shard.compressed->store(block.key.file_id, block.key.block_id, block.data, compressed_size)) {
+        count_stat(LAB2_STAT_COMPRESSED_REJECTS);
+        return;
+    }
+    count_stat(LAB2_STAT_COMPRESSED_STORES);
+    count_stat(LAB2_STAT_COMPRESSED_INPUT_BYTES, block_size);
+    count_stat(LAB2_STAT_COMPRESSED_OUTPUT_BYTES, compressed_size);
+}
+
+// to_compressed_tier — вытеснение ради места: чистый полный блок уходит в сжатый уровень. Его копия
+// совпадает с диском; грязные и частичные блоки, а также невостребованное упреждение туда не попадают.
+// false — грязный блок не удалось записать: он остается в кэше грязным
+static bool evict_cache_slot(CacheShard& shard, const unsigned int victim, const bool to_compressed_tier = false) {
+    CacheBlock& block = shard.slots[victim];
+    if (to_compressed_tier && shard.compressed && !block.is_dirty && !block.is_prefetched && !is_partial_block(block)) {
+        store_compressed_block(shard, block);
+    }
+    if (block.is_dirty) { // Запись на диск, если блок изменен
+        if (!write_back_block(block)) {
+            return false;
+        }
+        mark_block_clean(shard, block);
+    }
+    if (block.is_prefetched) {
+        count_stat(LAB2_STAT_READAHEAD_WASTED);
+    }
+
+    // Буфер остается за слотом и будет переиспользован следующим блоком
+    shard.policy->on_evict(victim);
+    erase_cache_index(shard, block.key);
+    unlink_file_block(shard, static_cast<int32_t>(victim));
+    block.is_used = false;
+    shard.free_slots.push_back(victim);
+    return true;
+}
+
+// Жертву выбирает политика сегмента; вытеснение добавляет резерв чистых блоков: пока работает
+// фоновая запись, грязные кандидаты пропускаются, и промах не ждет диска. Синхронная запись
+// остается запасным путем, если чистых кандидатов нет.
+// false — слот не освободился: с may_wait пришлось ждать освобождения блоков с отпущенной
+// блокировкой сегмента, без него вызывающий сам решает, что делать. write_failed — жертвы были,
+// но их запись на диск не удалась; тогда не ждем: вызывающий вернет ошибку
+bool free_cache_block(CacheShard& shard, std::unique_lock<std::mutex>& shard_lock, const bool may_wait,
+                      bool& write_failed) {
+    int32_t dirty_victim = EMPTY_INDEX_ENTRY;
+    size_t dirty_skips = 0;
+    write_failed = false;
+
+    // Синхронная запись грязной жертвы; неудачная оставляет ее в кэше, и поиск продолжается
+    const auto evict_dirty_victim = [&] {
+        if (evict_cache_slot(shard, dirty_victim, true)) {
+            count_stat(LAB2_STAT_EVICTIONS);
+            count_stat(LAB2_STAT_DIRTY_EVICTIONS);
+            return true;
+        }
+        write_failed = true;
+        dirty_victim = EMPTY_INDEX_ENTRY;
+        dirty_skips = 0;
+        return false;
+    };
+
+    shard.policy->begin_scan();
+    while (true) {
+        if (dirty_victim != EMPTY_INDEX_ENTRY && dirty_skips >= EVICTION_DIRTY_SKIP_LIMIT && evict_dirty_victim()) {
+            return true;
+        }
+
+        const int32_t victim = shard.policy->next_candidate();
+        if (victim == EMPTY_INDEX_ENTRY) {
+            if (dirty_victim != EMPTY_INDEX_ENTRY && evict_dirty_victim()) {
+                return true;
+            }
+            // Все кандидаты закреплены или их пишет фоновый поток: ждем освобождения
+            if (may_wait && !write_failed) {
+                shard.block_released.wait(shard_lock);
+            }
+            return false;
+        }
+        count_stat(LAB2_STAT_EVICTION_SCAN_STEPS);
+
+        const CacheBlock& block = shard.slots[victim];
+        if (block.is_writeback || block.pin_count > 0) {
+            continue;
+        }
+
+        if (block.is_dirty && writeback_enabled) {
+            if (dirty_victim == EMPTY_INDEX_ENTRY) {
+                dirty_victim = victim;
+            }
+            dirty_skips++;
+            wake_flusher();
+            continue;
+        }
+
+        const bool dirty = block.is_dirty; // Без фоновой записи грязный блок пишет само вытеснение
+        if (!evict_cache_slot(shard, victim, true)) {
+            write_failed = true;
+            continue;
+        }
+        count_stat(LAB2_STAT_EVICTIONS);
+        if (dirty) {
+            count_stat(LAB2_STAT_DIRTY_EVICTIONS);
+        }
+        return true;
+    }
+}
+
+// Свободный слот под новый блок; при заполненном сегменте вытесняет жертву.
+// Без may_wait вместо ожидания закрепленных блоков возвращает EMPTY_INDEX_ENTRY,
+// WRITEBACK_FAILED — вытеснять можно было только блоки, которые не удалось записать
+static int32_t acquire_cache_slot(CacheShard& shard, std::unique_lock<std::mutex>& shard_lock, const bool may_wait = true) {
+    bool write_failed = false;
+    if (shard.free_slots.empty() && !free_cache_block(shard, shard_lock, may_wait, write_failed)) {
+        if (write_failed) {
+            return WRITEBACK_FAILED;
+        }
+        return may_wait ? RETRY_CACHE_LOOKUP : EMPTY_INDEX_ENTRY;
+    }
+
+    const uint32_t slot = shard.free_slots.back();
+    shard.free_slots.pop_back();
+    return static_cast<int32_t>(slot);
+}
+
+static CacheBlock& install_cache_block(CacheShard& shard, const int32_t slot, const CacheKey& key, const size_t hash,
+                                       const bool prefetched = false) {
+    CacheBlock& block = shard.slots[slot];
+    block.key = key;
+    block.is_used = true;
+    block.is_dirty = false;
+    block.is_prefetched = prefetched;
+    block.is_writeback = false;
+    block.is_reserved = false;
+    block.is_loading = false;
+    block.async_load = nullptr;
+    block.pin_count = 0;
+    block.valid_begin = 0;
+    block.valid_end = static_cast<uint32_t>(block_size);
+    insert_cache_index(shard, hash, slot);
+    link_file_block(shard, slot);
+    if (shard.compressed) { // Сжатая копия могла устареть: источником данных блока теперь будет кэш
+        shard.compressed->erase(key.file_id, key.block_id);
+    }
+    shard.policy->on_insert(static_cast<uint32_t>(slot), hash, prefetched);
+    return block;
+}
+
+static void release_cache_slot(CacheShard& shard, const int32_t slot) {
+    shard.free_slots.push_back(static_cast<uint32_t>(slot));
+}
+
+// Промах, закрытый без чтения диска: сжатая копия распаковывается прямо в буфер занятого слота
+// и из уровня удаляется, иначе блок копируется из сегмента разделяемой памяти (копия там остается).
+// Вызывающий затем ставит блок в кэш как прочитанный с диска
+static bool take_tier_block(CacheShard& shard, const int32_t slot, const CacheKey& key, const size_t hash) {
+    if (shard.compressed) {
+        const auto start = std::chrono::steady_clock::now();
+        if (shard.compressed->take(key.file_id, key.block_id, shard.slots[slot].data)) {
+            record_latency(LAB2_LATENCY_DECOMPRESS, start);
+            count_stat(LAB2_STAT_COMPRESSED_HITS);
+            return true;
+        }
+    }
+    if (shared_block_cache && shared_block_cache->read(key.file_id, key.block_id, hash, shard.slots[slot].data)) {
+        count_stat(LAB2_STAT_SHARED_HITS);
+        return true;
+    }
+    return false;
+}
+
+// Упрежденный блок ставится без флага доступа: непрочитанным он первым уйдет при вытеснении.
+// Прогрев ставит горячие блоки сохраненного состояния как обычные (prefetched = false)
+static void install_prefetched_block(const CacheKey& key, const char* data, const unsigned long generation,
+                                     const bool prefetched = true) {
+    const size_t hash = hash_cache_key(key);
+    CacheShard& shard = get_cache_shard(key, hash);
+    std::unique_lock<std::mutex> shard_lock(shard.lock);
+
+    // Пока шло чтение, блок мог попасть в кэш или более новая версия могла уйти на диск
+    if (find_cache_slot(shard, key, hash) != EMPTY_INDEX_ENTRY ||
+        disk_write_generation.load(std::memory_order_acquire) != generation) {
+        return;
+    }
+
+    const int32_t slot = acquire_cache_slot(shard, shard_lock);
+    if (slot < 0) {
+        return;
+    }
+    std::memcpy(shard.slots[slot].data, data, block_size);
+    install_cache_block(shard, slot, key, hash, prefetched);
+}
+
+static void run_readahead_request(const ReadaheadRequest& request, char* staging_buffer) {
+    const unsigned long generation = disk_write_generation.load(std::memory_order_acquire);
+    const uint64_t shared_generation = shared_write_generation();
+    SSIZE_T bytes_read;
+    {
+        // Хэндл мог быть закрыт (и номер переиспользован) после постановки запроса в очередь
+        std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+        const auto iterator = fd_table.find(request.file_handle);
+        if (iterator == fd_table.end() || iterator->second.file_id != request.file_id) {
+            return;
+        }
+        // Одно большое чтение на все окно вместо отдельного вызова на блок
+        bytes_read = platform_pread(request.file_handle, staging_buffer, request.block_count << block_shift,
+                                    request.first_block << block_shift);
+        count_disk_read(bytes_read);
+    }
+    if (bytes_read <= 0) {
+        return;
+    }
+
+    const size_t blocks_read = (static_cast<size_t>(bytes_read) + block_size - 1) >> block_shift;
+    count_stat(LAB2_STAT_READAHEAD_BLOCKS, blocks_read);
+    if (static_cast<size_t>(bytes_read) < (blocks_read << block_shift)) {
+        std::memset(staging_buffer + bytes_read, 0, (blocks_read << block_shift) - bytes_read);
+    }
+    for (size_t i = 0; i < blocks_read; ++i) {
+        const CacheKey key = { request.file_id, request.first_block + static_cast<LONGLONG>(i) };
+        install_prefetched_block(key, staging_buffer + (i << block_shift), generation);
+        publish_shared_block(key, staging_buffer + (i << block_shift), shared_generation);
+    }
+}
+
+static void readahead_worker() {
+    char* staging_buffer = static_cast<char*>(platform_aligned_alloc(readahead_max_blocks << block_shift, block_size));
+    if (!staging_buffer) {
+        std::cerr << "aligned allocation failed" << std::endl;
+        return;
+    }
+
+    while (true) {
+        ReadaheadRequest request;
+        {
+            std::unique_lock<std::mutex> queue_lock(readahead_pool.lock);
+            readahead_pool.wakeup.wait(queue_lock, [] { return readahead_pool.stopping || !readahead_pool.queue.empty(); });
+            if (readahead_pool.stopping) {
+                break;
+            }
+            request = readahead_pool.queue.front();
+            readahead_pool.queue.pop_front();
+        }
+        run_readahead_request(request, staging_buffer);
+    }
+    platform_aligned_free(staging_buffer);
+}
+
+static void start_readahead_pool() {
+    if (readahead_max_blocks == 0 || !readahead_pool.workers.empty()) {
+        return;
+    }
+    readahead_pool.stopping = false;
+    for (size_t i = 0; i < READAHEAD_THREADS; ++i) {
+        readahead_pool.workers.emplace_back(readahead_worker);
+    }
+}
+
+static void stop_readahead_pool() {
+    {
+        std::lock_guard<std::mutex> queue_lock(readahead_pool.lock);
+        readahead_pool.stopping = true;
+        readahead_pool.queue.clear();
+    }
+    readahead_pool.wakeup.notify_all();
+    for (auto& worker : readahead_pool.workers) {
+        worker.join();
+    }
+    readahead_pool.workers.clear();
+}
+
+ReadaheadPool::~ReadaheadPool() {
+    stop_readahead_pool();
+}
+
+static void submit_readahead(const ReadaheadRequest& request) {
+    {
+        std::lock_guard<std::mutex> queue_lock(readahead_pool.lock);
+        if (readahead_pool.workers.empty() || readahead_pool.queue.size() >= READAHEAD_MAX_QUEUE) {
+            return;
+        }
+        readahead_pool.queue.push_back(request);
+    }
+    readahead_pool.wakeup.notify_one();
+}
+
+// Детектор последовательного доступа: после READAHEAD_TRIGGER_RUN последовательных чтений
+// запрашивает следующее окно, удваивая его до readahead_max_blocks. Новое окно запрашивается,
+// когда чтение дошло до середины предыдущего, чтобы диск работал, пока читаются уже готовые блоки
+static void update_readahead(FileDescriptor& descriptor, const LONGLONG first_block, const LONGLONG last_block) {
+    std::lock_guard<std::mutex> readahead_lock(descriptor.readahead_lock);
+    ReadaheadState& state = descriptor.readahead;
+    if (first_block == state.last_block || first_block == state.last_block + 1) {
+        state.sequential_run++;
+    } else {
+        state.sequential_run = 0;
+        state.window = READAHEAD_MIN_WINDOW;
+        state.next_block = last_block + 1;
+    }
+    state.last_block = last_block;
+
+    if (descriptor.is_mapped && descriptor.mapping) {
+        // Отображение ядро читает наперед само: ему сообщается, последовательный доступ или случайный
+        const PlatformAccessHint hint = state.sequential_run >= READAHEAD_TRIGGER_RUN ? PLATFORM_ACCESS_SEQUENTIAL :
+                                        state.sequential_run == 0 ? PLATFORM_ACCESS_RANDOM : descriptor.mapping_hint;
+        if (hint != descriptor.mapping_hint) {
+            platform_advise(descriptor.mapping, descriptor.mapping_size, hint);
+            descriptor.mapping_hint = hint;
+        }
+    }
+
+    if (readahead_max_blocks == 0 || state.sequential_run < READAHEAD_TRIGGER_RUN) {
+        return;
+    }
+    if (state.next_block <= last_block) {
+        state.next_block = last_block + 1;
+    }
+    if (static_cast<size_t>(state.next_block - last_block) > state.window / 2 + 1) {
+        return;
+    }
+
+    const size_t window = std::min(std::max(state.window, READAHEAD_MIN_WINDOW), readahead_max_blocks);
+    const size_t window_start = static_cast<size_t>(state.next_block) << block_shift;
+    // Окно не заходит за конец файла: блоки за ним читать незачем
+    const LONGLONG end_block = (get_file_size(descriptor) + static_cast<LONGLONG>(block_size) - 1) >> block_shift;
+    if (!descriptor.is_mapped && state.next_block < end_block) {
+        submit_readahead({ descriptor.file_handle, descriptor.file_id, state.next_block,
+                           std::min(window, static_cast<size_t>(end_block - state.next_block)) });
+    } else if (descriptor.is_mapped && window_start < descriptor.mapping_size) {
+        platform_advise(descriptor.mapping + window_start, std::min(window << block_shift, descriptor.mapping_size - window_start),
+                        PLATFORM_ACCESS_WILLNEED);
+    }
+    state.next_block += static_cast<LONGLONG>(window);
+    state.window = std::min(window * 2, readahead_max_blocks);
+}
+
+// Подряд идущие блоки файла уходят одним pwritev прямо из буферов кэша. На время записи блоки
+// помечены is_writeback и остаются грязными; флаг снимается, только если блок не менялся
+static bool flush_run(const LONGLONG file_id, const FlushCandidate* run, const size_t count) {
+    std::vector<PlatformIoVec> vectors(count);
+    for (size_t i = 0; i < count; ++i) {
+        vectors[i] = { run[i].shard->slots[run[i].slot].data, block_size };
+    }
+
+    bool written = false;
+    {
+        std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+        const FileDescriptor* owner = get_writeback_descriptor(file_id);
+        if (owner && owner->is_writable) {
+            disk_write_generation.fetch_add(1, std::memory_order_acq_rel);
+            const auto start = std::chrono::steady_clock::now();
+            const SSIZE_T result = platform_pwritev(owner->file_handle, vectors.data(), static_cast<int>(count),
+                                                    run[0].block_id << block_shift);
+            record_latency(LAB2_LATENCY_FLUSH, start);
+            count_disk_write(result);
+            written = result == static_cast<SSIZE_T>(count << block_shift);
+            for (size_t i = 0; i < count; ++i) {
+                invalidate_shared_block({ file_id, run[i].block_id });
+            }
+            if (written) {
+                count_stat(LAB2_STAT_WRITEBACK_BLOCKS, count);
+            } else {
+                std::cerr << "pwritev failed: " << GetLastError() << std::endl;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        CacheShard& shard = *run[i].shard;
+        std::lock_guard<std::mutex> shard_lock(shard.lock);
+        CacheBlock& block = shard.slots[run[i].slot];
+        if (written && block.generation == run[i].generation) {
+            mark_block_clean(shard, block);
+        }
+        block.is_writeback = false;
+        shard.block_released.notify_all();
+    }
+    return written;
+}
+
+// Сортирует помеченные is_writeback блоки файла и пишет подряд идущие одной записью.
+// ios — число выданных записей; false, если хотя бы одна не удалась
+static bool flush_file_blocks(const LONGLONG file_id, std::vector<FlushCandidate>& blocks, size_t& ios) {
+    std::sort(blocks.begin(), blocks.end(), [](const FlushCandidate& a, const FlushCandidate& b) {
+        return a.block_id < b.block_id;
+    });
+
+    bool written = true;
+    size_t run_start = 0;
+    for (size_t i = 1; i <= blocks.size(); ++i) {
+        if (i == blocks.size() || blocks[i].block_id != blocks[i - 1].block_id + 1 || i - run_start == FLUSH_MAX_RUN_BLOCKS) {
+            written = flush_run(file_id, blocks.data() + run_start, i - run_start) && written;
+            ios++;
+            run_start = i;
+        }
+    }
+    return written;
+}
+
+// Помечает блок is_writeback и добавляет в blocks; частичный блок сначала дочитывается
+static bool start_block_writeback(CacheShard& shard, const int32_t slot, std::vector<FlushCandidate>& blocks) {
+    CacheBlock& block = shard.slots[slot];
+    if (!fill_partial_block_from_owner(block)) {
+        return false;
+    }
+    block.is_writeback = true;
+    blocks.push_back({ block.key.block_id, &shard, slot, block.generation });
+    return true;
+}
+
+// Проход фоновой записи: блоки старше dirty_expire_ms, а при превышении dirty_ratio — все грязные
+static void flush_dirty_blocks(const bool flush_all) {
+    const LONGLONG expire_before = now_ms() - dirty_expire_ms;
+    std::map<LONGLONG, std::vector<FlushCandidate>> candidates; // file_id -> блоки
+
+    for (const auto& shard : cache_shards) {
+        std::lock_guard<std::mutex> shard_lock(shard->lock);
+        for (const auto& [file_id, block_ids] : shard->dirty_by_file) {
+            for (const LONGLONG block_id : block_ids) {
+                const CacheKey key = { file_id, block_id };
+                const int32_t slot = find_cache_slot(*shard, key, hash_cache_key(key));
+                const CacheBlock& block = shard->slots[slot];
+                if (block.is_writeback || block.is_reserved || (!flush_all && block.dirty_since > expire_before)) {
+                    continue;
+                }
+                start_block_writeback(*shard, slot, candidates[file_id]);
+            }
+        }
+    }
+
+    for (auto& [file_id, blocks] : candidates) {
+        size_t ios = 0;
+        flush_file_blocks(file_id, blocks, ios);
+    }
+}
+
+static void flusher_worker() {
+    std::unique_lock<std::mutex> flusher_lock(flusher.lock);
+    while (!flusher.stopping) {
+        flusher.wakeup.wait_for(flusher_lock, FLUSH_INTERVAL, [] {
+            return flusher.stopping || flusher.pending.load(std::memory_order_acquire);
+        });
+        if (flusher.stopping) {
+            break;
+        }
+        flusher.pending = false;
+        flusher_lock.unlock();
+
+        const bool over_ratio = dirty_blocks.load(std::memory_order_relaxed) * 100 > cache_capacity * dirty_ratio;
+        flush_dirty_blocks(over_ratio);
+        close_deferred_files(false);
+
+        flusher_lock.lock();
+    }
+}
+
+static void start_flusher() {
+    if (!writeback_enabled || flusher.worker.joinable()) {
+        return;
+    }
+    flusher.stopping = false;
+    flusher.worker = std::thread(flusher_worker);
+}
+
+static void stop_flusher() {
+    {
+        std::lock_guard<std::mutex> flusher_lock(flusher.lock);
+        flusher.stopping = true;
+    }
+    flusher.wakeup.notify_all();
+    if (flusher.worker.joinable()) {
+        flusher.worker.join();
+    }
+}
+
+// Выход из программы: отложенные закрытия дописывают свои блоки
+Flusher::~Flusher() {
+    stop_flusher();
+    close_deferred_files(true);
+}
+
+static void stop_async_ring(); // Кольцо асинхронного API создается при первом асинхронном запросе
+
+// Читает блоки одного списка сериями по возрастанию номера. Короткие промежутки читаются вместе
+// с серией (одно чтение дешевле нескольких), но их блоки в кэш не ставятся; false — прогрев остановлен
+static bool warm_file_blocks(const HANDLE file_handle, const WarmupFile& file, const std::vector<LONGLONG>& blocks,
+                             const bool hot, char* staging_buffer) {
+    size_t run_start = 0;
+    for (size_t i = 1; i <= blocks.size(); ++i) {
+        if (i < blocks.size() && blocks[i] - blocks[i - 1] <= WARMUP_MAX_GAP_BLOCKS + 1 &&
+            static_cast<size_t>(blocks[i] - blocks[run_start]) < WARMUP_MAX_RUN_BLOCKS) {
+            continue;
+        }
+        if (warmup_loader.stopping.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        const size_t run_end = i;
+        const LONGLONG first_block = blocks[run_start];
+        const size_t block_count = static_cast<size_t>(blocks[run_end - 1] - first_block) + 1;
+
+        const unsigned long generation = disk_write_generation.load(std::memory_order_acquire);
+        const SSIZE_T bytes_read = platform_pread(file_handle, staging_buffer, block_count << block_shift, first_block << block_shift);
+        count_disk_read(bytes_read);
+        if (bytes_read <= 0) {
+            run_start = run_end;
+            continue;
+        }
+        const size_t blocks_read = (static_cast<size_t>(bytes_read) + block_size - 1) >> block_shift;
+        count_stat(LAB2_STAT_WARMUP_BLOCKS, run_end - run_start);
+        if (static_cast<size_t>(bytes_read) < (blocks_read << block_shift)) {
+            std::memset(staging_buffer + bytes_read, 0, (blocks_read << block_shift) - bytes_read);
+        }
+        for (; run_start < run_end; ++run_start) {
+            const size_t block = static_cast<size_t>(blocks[run_start] - first_block);
+            if (block < blocks_read) {
+                install_prefetched_block({ file.file_id, blocks[run_start] }, staging_buffer + (block << block_shift),
+                                         generation, !hot);
+            }
+        }
+    }
+    return true;
+}
+
+// Файлы читаются через свои хэндлы, без fd_table: файл может быть еще не открыт через lab2_open
+static void warmup_worker() {
+    char* staging_buffer = static_cast<char*>(platform_aligned_alloc(WARMUP_MAX_RUN_BLOCKS << block_shift, block_size));
+    if (!staging_buffer) {
+        std::cerr << "aligned allocation failed" << std::endl;
+        return;
+    }
+    for (const WarmupFile& file : warmup_loader.files) {
+        const HANDLE file_handle = platform_open_direct(file.path.c_str(), GENERIC_READ, OPEN_EXISTING);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            continue;
+        }
+        const bool finished = warm_file_blocks(file_handle, file, file.hot_blocks, true, staging_buffer) &&
+                              warm_file_blocks(file_handle, file, file.cold_blocks, false, staging_buffer);
+        platform_close(file_handle);
+        if (!finished) {
+            break;
+        }
+    }
+    platform_aligned_free(staging_buffer);
+}
+
+static void stop_warmup_loader() {
+    warmup_loader.stopping.store(true, std::memory_order_relaxed);
+    if (warmup_loader.worker.joinable()) {
+        warmup_loader.worker.join();
+    }
+    warmup_loader.files.clear();
+}
+
+static void start_warmup_loader(std::vector<WarmupFile> files) {
+    stop_warmup_loader();
+    warmup_loader.files = std::move(files);
+    warmup_loader.stopping.store(false, std::memory_order_relaxed);
+    warmup_loader.worker = std::thread(warmup_worker);
+}
+
+WarmupLoader::~WarmupLoader() {
+    stop_warmup_loader();
+}
+
+// Открытие с усечением: блоки прежнего содержимого файла (или файла с тем же номером inode)
+// в кэше больше не действительны и выбрасываются без записи на диск
+static void drop_file_blocks(const LONGLONG file_id) {
+    // Прочитанное до усечения упреждением или прогревом в кэш уже не попадет
+    disk_write_generation.fetch_add(1, std::memory_order_acq_rel);
+    // Блоки файла берутся из его списка в сегменте; пока ждем занятый блок, список может
+    // измениться, поэтому после ожидания обход начинается с головы
+    for (const auto& shard : cache_shards) {
+        std::unique_lock<std::mutex> shard_lock(shard->lock);
+        for (auto head = shard->file_blocks.find(file_id); head != shard->file_blocks.end();
+             head = shard->file_blocks.find(file_id)) {
+            const int32_t slot = head->second;
+            CacheBlock& block = shard->slots[slot];
+            shard->block_released.wait(shard_lock, [&block, file_id] {
+                return !block.is_used || block.key.file_id != file_id || (!is_block_busy(block) && block.pin_count == 0);
+            });
+            if (block.is_used && block.key.file_id == file_id) {
+                mark_block_clean(*shard, block);
+                evict_cache_slot(*shard, static_cast<uint32_t>(slot));
+            }
+        }
+        if (shard->compressed) {
+            shard->compressed->erase_file(file_id);
+        }
+    }
+    if (shared_block_cache) {
+        shared_block_cache->invalidate_file(file_id);
+    }
+}
+
+static void start_background_threads() {
+    start_readahead_pool();
+    start_flusher();
+}
+
+static void stop_background_threads() {
+    stop_warmup_loader();
+    stop_readahead_pool();
+    stop_flusher();
+    stop_async_ring();
+}
+
+static int sync_file(const HANDLE file_handle, const bool metadata);
+static bool trim_file_tail(const LONGLONG file_id, const LONGLONG file_size);
+
+// Вторая половина закрытия: дескриптор удаляется из fd_table, ОС-хэндл закрывается
+static void release_descriptor(const HANDLE file_handle) {
+    std::unique_lock<std::shared_mutex> table_lock(fd_table_lock);
+    const auto iterator = fd_table.find(file_handle);
+    FileDescriptor& fd = iterator->second;
+    SharedFile& file = *fd.file;
+    const LONGLONG file_id = fd.file_id;
+    if (--file.open_count == 0) {
+        shared_files.erase(file_id);
+    } else if (file.writeback == &fd) {
+        // Передаем запись другому дескриптору файла: незакрывающемуся записывающему, если он есть
+        FileDescriptor* successor = nullptr;
+        int successor_rank = -1;
+        for (auto& [handle, other] : fd_table) {
+            const int rank = (other.is_writable ? 2 : 0) + (other.is_closing ? 0 : 1);
+            if (handle != file_handle && other.file_id == file_id && rank > successor_rank) {
+                successor = &other;
+                successor_rank = rank;
+            }
+        }
+        file.writeback = successor;
+    }
+
+    platform_unmap_file(fd.mapping, fd.mapping_size);
+    platform_close(file_handle);
+    fd_table.erase(iterator);
+}
+
+// Отложенное закрытие завершает тот, кто уберет хэндл из списка; false — его уже завершили
+static bool take_deferred_handle(const HANDLE file_handle) {
+    std::unique_lock<std::shared_mutex> table_lock(fd_table_lock);
+    const auto iterator = std::find(deferred_handles.begin(), deferred_handles.end(), file_handle);
+    if (iterator == deferred_handles.end()) {
+        return false;
+    }
+    deferred_handles.erase(iterator);
+    return true;
+}
+
+static bool has_dirty_blocks(const LONGLONG file_id) {
+    return std::any_of(cache_shards.begin(), cache_shards.end(), [file_id](const std::unique_ptr<CacheShard>& shard) {
+        std::lock_guard<std::mutex> shard_lock(shard->lock);
+        return shard->dirty_by_file.count(file_id) != 0;
+    });
+}
+
+// Завершает отложенные закрытия: дескриптор закрывается, когда грязных блоков файла не осталось или
+// их запись перешла к другому дескриптору. flush — сначала дописать блоки (lab2_init, выход);
+// вызывают поток фоновой записи или код, который его остановил
+static void close_deferred_files(const bool flush) {
+    std::vector<HANDLE> handles;
+    {
+        std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+        handles = deferred_handles;
+    }
+    for (const HANDLE file_handle : handles) {
+        LONGLONG file_id;
+        bool is_writeback;
+        {
+            // Пока хэндл в списке, его дескриптор жив
+            std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+            if (std::find(deferred_handles.begin(), deferred_handles.end(), file_handle) == deferred_handles.end()) {
+                continue;
+            }
+            const FileDescriptor& fd = fd_table.at(file_handle);
+            file_id = fd.file_id;
+            is_writeback = fd.file->writeback == &fd;
+        }
+        if (is_writeback) {
+            if (flush) {
+                sync_file(file_handle, false);
+            } else if (has_dirty_blocks(file_id)) {
+                continue;
+            } else {
+                // Фоновая запись хвостового блока продлила файл до границы блока
+                trim_file_tail(file_id, get_file_size(get_file_descriptor(file_handle)));
+            }
+        }
+        if (take_deferred_handle(file_handle)) {
+            release_descriptor(file_handle);
+        }
+    }
+}
+
+HANDLE lab2_open(const char* path, DWORD access_mode, DWORD creation_disposition) {
+    const bool traced = trace_enabled.load(std::memory_order_acquire);
+    const LONGLONG trace_start = traced ? trace_now_us() : 0;
+    const DWORD requested_access = access_mode;
+    const bool mapped = (access_mode & LAB2_OPEN_MAPPED) != 0;
+    access_mode &= ~LAB2_OPEN_MAPPED;
+    if (mapped && (access_mode & GENERIC_WRITE)) {
+        SetLastError(ERROR_INVALID_PARAMETER); // Отображение только для чтения
+        return INVALID_HANDLE_VALUE;
+    }
+
+    // Частичные блоки дочитываются с диска перед записью, поэтому открытый только на запись файл
+    // ОС-дескриптор открывает и на чтение; если прав на чтение нет — как просили. Другие ошибки
+    // первой попытки (нет файла, файл уже есть) окончательные и не повторяются
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    bool readable = (access_mode & GENERIC_READ) != 0;
+    if (!readable && (access_mode & GENERIC_WRITE)) {
+        file_handle = platform_open_direct(path, access_mode | GENERIC_READ, creation_disposition, true);
+        readable = file_handle != INVALID_HANDLE_VALUE;
+        const DWORD error = GetLastError();
+        if (!readable && error != ERROR_ACCESS_DENIED && error != ERROR_PRIVILEGE_NOT_HELD) {
+            std::cerr << "open failed: " << error << std::endl;
+            SetLastError(error);
+            return INVALID_HANDLE_VALUE;
+        }
+    }
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        file_handle = platform_open_direct(path, access_mode, creation_disposition);
+    }
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    // Один запрос к ФС на открытие: размер и сектор уже открытого файла берутся из SharedFile
+    PlatformFileInfo file_info;
+    if (platform_get_file_info(file_handle, &file_info) != 0) {
+        platform_close(file_handle);
+        return INVALID_HANDLE_VALUE;
+    }
+    const LONGLONG file_id = file_info.file_id;
+
+    size_t sector_size = 0;
+    {
+        std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+        const auto file = shared_files.find(file_id);
+        if (file != shared_files.end()) {
+            sector_size = file->second.sector_size;
+        }
+    }
+    if (sector_size == 0) {
+        sector_size = platform_get_sector_size(file_handle);
+    }
+
+    // Прямой ввод-вывод требует, чтобы блок был кратен логическому сектору устройства
+    if (!mapped && block_size % sector_size != 0) {
+        std::cerr << "Block size " << block_size << " is not a multiple of sector size " << sector_size << std::endl;
+        platform_close(file_handle);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    std::unique_lock<std::shared_mutex> table_lock(fd_table_lock);
+    if (!init_cache()) {
+        platform_close(file_handle);
+        return INVALID_HANDLE_VALUE;
+    }
+    start_background_threads();
+    if (file_home_partitions) {
+        file_home_partition(file_id); // Блоки файла будут жить на узле открывающего потока
+    }
+
+    const char* mapping = nullptr;
+    size_t mapping_size = 0;
+    if (mapped) {
+        mapping_size = file_info.size > 0 ? static_cast<size_t>(file_info.size) : 0;
+        if (mapping_size > 0 && !(mapping = platform_map_file(file_handle, mapping_size))) {
+            platform_close(file_handle);
+            return INVALID_HANDLE_VALUE;
+        }
+    }
+
+    FileDescriptor& fd = fd_table[file_handle];
+    fd.file_handle = file_handle;
+    fd.file_id = file_id;
+    fd.offset = 0;
+    fd.is_writable = (access_mode & GENERIC_WRITE) != 0;
+    fd.is_readable = readable;
+    fd.is_closing = false;
+    fd.sector_size = sector_size;
+    fd.is_mapped = mapped;
+    fd.mapping = mapping;
+    fd.mapping_size = mapping_size;
+    fd.mapping_hint = PLATFORM_ACCESS_NORMAL;
+    fd.mapped_reads = 0;
+    fd.readahead = ReadaheadState();
+
+    // Размер читается с диска только при первом открытии: у уже открытого файла он может
+    // включать еще не записанные блоки
+    const bool truncated = creation_disposition == CREATE_ALWAYS || creation_disposition == TRUNCATE_EXISTING ||
+                           creation_disposition == CREATE_NEW;
+    const auto [entry, first_open] = shared_files.try_emplace(file_id);
+    SharedFile& file = entry->second;
+    if (first_open) {
+        file.size.store(std::max<LONGLONG>(file_info.size, 0), std::memory_order_release);
+        file.sector_size = sector_size;
+    } else if (truncated) {
+        file.size.store(0, std::memory_order_release);
+    }
+    file.open_count++;
+    file.active_count++;
+    if (fd.is_writable) {
+        file.active_writers++;
+    }
+    // Записывающий дескриптор вытесняет читающего или закрывающийся (отложенное закрытие ждет,
+    // пока запись перейдет к другому дескриптору или грязных блоков не останется)
+    HANDLE replaced_deferred = INVALID_HANDLE_VALUE;
+    if (!file.writeback || (fd.is_writable && (!file.writeback->is_writable || file.writeback->is_closing))) {
+        if (file.writeback && std::find(deferred_handles.begin(), deferred_handles.end(), file.writeback->file_handle) != deferred_handles.end()) {
+            replaced_deferred = file.writeback->file_handle;
+        }
+        file.writeback = &fd;
+    }
+    fd.file = &file;
+    file_paths[file_id] = path;
+    table_lock.unlock();
+
+    // Блоки отложенно закрытого дескриптора теперь пишет новый: старый больше не нужен
+    if (replaced_deferred != INVALID_HANDLE_VALUE && take_deferred_handle(replaced_deferred)) {
+        release_descriptor(replaced_deferred);
+    }
+
+    if (truncated) {
+        drop_file_blocks(file_id);
+    }
+    if (traced) {
+        trace_open(file_handle, path, requested_access, creation_disposition, trace_start);
+    }
+    return file_handle;
+}
+
+int lab2_close(const HANDLE file_handle) {
+    // Пишется до закрытия: после него номер хэндла может достаться другому открытию
+    if (trace_enabled.load(std::memory_order_acquire)) {
+        trace_call(TRACE_CLOSE, file_handle, trace_now_us());
+    }
+    // Грязные блоки файла пишет закрытие последнего дескриптора, а если остаются только
+    // читающие — последнего записывающего: другие закрытия на диск не ходят
+    bool flush_file = false;
+    {
+        std::unique_lock<std::shared_mutex> table_lock(fd_table_lock);
+        const auto iterator = fd_table.find(file_handle);
+        if (iterator == fd_table.end() || iterator->second.is_closing) {
+            SetLastError(ERROR_INVALID_HANDLE);
+            return -1;
+        }
+        FileDescriptor& fd = iterator->second;
+        SharedFile& file = *fd.file;
+        fd.is_closing = true;
+        file.active_count--;
+        if (fd.is_writable) {
+            file.active_writers--;
+        }
+        flush_file = file.active_count == 0 || (fd.is_writable && file.active_writers == 0);
+        // Отложенное закрытие: дескриптор остается, пока через него пишутся грязные блоки файла
+        if (flush_file && deferred_close && fd.is_writable && file.writeback == &fd) {
+            deferred_handles.push_back(file_handle);
+            return 0;
+        }
+    }
+
+    // Дескриптор остается в fd_table до конца записи: через него еще может писать фоновый поток.
+    // Хэндл освобождается и при неудачной записи, но закрытие тогда возвращает ее ошибку
+    if (flush_file && sync_file(file_handle, true) != 0) { // Синхронизация данных с диском
+        const DWORD error = GetLastError();
+        release_descriptor(file_handle);
+        SetLastError(error);
+        return -1;
+    }
+    release_descriptor(file_handle);
+    return 0;
+}
+
+// Находит блок в кэше или читает его с диска; блокировка сегмента при этом удерживается.
+// Байты блока за концом данных на диске (дыра или еще не записанный хвост) читаются как нули
+static int32_t load_cache_block(CacheShard& shard, std::unique_lock<std::mutex>& shard_lock, const CacheKey& key,
+                                const size_t hash, const FileDescriptor& descriptor, const size_t block_offset,
+                                const size_t length) {
+    const int32_t found_slot = find_cache_slot(shard, key, hash);
+    if (found_slot != EMPTY_INDEX_ENTRY) {
+        CacheBlock& found_block = shard.slots[found_slot];
+        if (found_block.is_loading) {
+            // Блок читает с диска другой поток: после ожидания слот мог освободиться, ищем заново
+            count_stat(LAB2_STAT_COALESCED_MISSES);
+            shard.block_released.wait(shard_lock, [&found_block] { return !found_block.is_loading; });
+            return RETRY_CACHE_LOOKUP;
+        }
+        if ((block_offset < found_block.valid_begin || block_offset + length > found_block.valid_end) &&
+            !fill_partial_block(found_block, descriptor)) {
+            return EMPTY_INDEX_ENTRY;
+        }
+        count_cache_hit(shard);
+        shard.policy->on_hit(static_cast<uint32_t>(found_slot), found_block.is_prefetched);
+        if (found_block.is_prefetched) {
+            count_stat(LAB2_STAT_READAHEAD_HITS);
+            found_block.is_prefetched = false;
+        }
+        return found_slot;
+    }
+
+    const int32_t slot = acquire_cache_slot(shard, shard_lock);
+    if (slot < 0) {
+        return slot;
+    }
+    count_stat(LAB2_STAT_MISSES);
+    // std::cout << "Cache miss: block_id = " << key.block_id << std::endl;
+    if (take_tier_block(shard, slot, key, hash)) {
+        install_cache_block(shard, slot, key, hash);
+        return slot;
+    }
+    char* aligned_buf = shard.slots[slot].data;
+
+    const uint64_t shared_generation = shared_write_generation();
+    const SSIZE_T bytes_read_from_disk = platform_pread(descriptor.file_handle, aligned_buf, block_size,
+                                                        key.block_id << block_shift);
+    count_disk_read(bytes_read_from_disk);
+    if (bytes_read_from_disk < 0) {
+        std::cerr << "pread failed: " << GetLastError() << std::endl;
+        release_cache_slot(shard, slot);
+        return EMPTY_INDEX_ENTRY;
+    }
+
+    if (static_cast<size_t>(bytes_read_from_disk) < block_size) {
+        std::memset(aligned_buf + bytes_read_from_disk, 0, block_size - bytes_read_from_disk);
+    }
+
+    install_cache_block(shard, slot, key, hash);
+    publish_shared_block(key, aligned_buf, shared_generation);
+    return slot;
+}
+
+// Дочитывает подряд идущие промахи одним preadv прямо в буферы их слотов, копирует данные
+// вызывающему и снимает is_loading. Запрос уже ограничен размером файла, поэтому короткое чтение
+// означает дыру или хвост, который еще не ушел на диск: недостающие байты — нули
+static bool load_pending_run(const HANDLE file_handle, const PendingLoad* run, const size_t count, char* buffer) {
+    thread_local std::vector<PlatformIoVec> vectors;
+    vectors.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        vectors[i] = { run[i].shard->slots[run[i].slot].data, block_size };
+    }
+
+    const uint64_t shared_generation = shared_write_generation();
+    const SSIZE_T bytes_read = platform_preadv(file_handle, vectors.data(), static_cast<int>(count), run[0].block_id << block_shift);
+    count_disk_read(bytes_read);
+    if (bytes_read < 0) {
+        std::cerr << "preadv failed: " << GetLastError() << std::endl;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        CacheShard& shard = *run[i].shard;
+        std::lock_guard<std::mutex> shard_lock(shard.lock);
+        CacheBlock& block = shard.slots[run[i].slot];
+        block.is_loading = false;
+        block.pin_count--;
+        shard.block_released.notify_all();
+        if (bytes_read < 0) {
+            evict_cache_slot(shard, run[i].slot); // Блок без данных не остается в кэше
+            continue;
+        }
+        const size_t block_start = i << block_shift;
+        const size_t filled = static_cast<size_t>(bytes_read) > block_start ?
+                              std::min(static_cast<size_t>(bytes_read) - block_start, block_size) : 0;
+        if (filled < block_size) {
+            std::memset(block.data + filled, 0, block_size - filled);
+        }
+        publish_shared_block(block.key, block.data, shared_generation);
+        std::memcpy(buffer + run[i].buffer_offset, block.data + run[i].block_offset, run[i].length);
+    }
+    return bytes_read >= 0;
+}
+
+// Чтение через кэш в два прохода: попадания копируются сразу, а под промахи занимаются слоты;
+// затем каждая серия подряд идущих промахов читается с диска одним вызовом
+static SSIZE_T read_cached(const FileDescriptor& descriptor, char* buffer, const size_t count, const LONGLONG offset) {
+    thread_local std::vector<PendingLoad> pending;
+    size_t bytes_read = 0;
+
+    while (bytes_read < count) {
+        pending.clear();
+        bool failed = false;
+        size_t cursor = bytes_read;
+        while (cursor < count && pending.size() < READ_BATCH_MAX_BLOCKS) {
+            const LONGLONG position = offset + static_cast<LONGLONG>(cursor);
+            const LONGLONG block_id = position >> block_shift;
+            const size_t block_offset = position & (block_size - 1);
+            const size_t length = std::min(block_size - block_offset, count - cursor);
+
+            const CacheKey key = { descriptor.file_id, block_id };
+            const size_t hash = hash_cache_key(key);
+            CacheShard& shard = get_cache_shard(key, hash);
+            std::unique_lock<std::mutex> shard_lock(shard.lock);
+
+            const int32_t found_slot = find_cache_slot(shard, key, hash);
+            if (found_slot != EMPTY_INDEX_ENTRY) {
+                CacheBlock& block = shard.slots[found_slot];
+                if (block.is_loading) {
+                    // Свои промахи сначала дочитываем: с закрепленными слотами ждать нельзя
+                    if (!pending.empty()) {
+                        break;
+                    }
+                    count_stat(LAB2_STAT_COALESCED_MISSES);
+                    shard.block_released.wait(shard_lock, [&block] { return !block.is_loading; });
+                    continue;
+                }
+                if ((block_offset < block.valid_begin || block_offset + length > block.valid_end) &&
+                    !fill_partial_block(block, descriptor)) {
+                    failed = true;
+                    break;
+                }
+                count_cache_hit(shard);
+                shard.policy->on_hit(static_cast<uint32_t>(found_slot), block.is_prefetched);
+                if (block.is_prefetched) {
+                    count_stat(LAB2_STAT_READAHEAD_HITS);
+                    block.is_prefetched = false;
+                }
+                std::memcpy(buffer + cursor, block.data + block_offset, length);
+                cursor += length;
+                continue;
+            }
+
+            // Пока держим закрепленные слоты, ждать вытеснения нельзя: если свободного слота нет,
+            // сначала дочитываем уже собранные промахи
+            const int32_t slot = acquire_cache_slot(shard, shard_lock, pending.empty());
+            if (slot == RETRY_CACHE_LOOKUP) {
+                continue;
+            }
+            if (slot == WRITEBACK_FAILED) {
+                failed = true;
+                break;
+            }
+            if (slot == EMPTY_INDEX_ENTRY) {
+                break;
+            }
+            count_stat(LAB2_STAT_MISSES);
+            if (take_tier_block(shard, slot, key, hash)) {
+                const CacheBlock& block = install_cache_block(shard, slot, key, hash);
+                std::memcpy(buffer + cursor, block.data + block_offset, length);
+                cursor += length;
+                continue;
+            }
+            CacheBlock& block = install_cache_block(shard, slot, key, hash);
+            block.is_loading = true;
+            block.pin_count++;
+            pending.push_back({ block_id, &shard, slot, cursor, block_offset, length });
+            cursor += length;
+        }
+
+        size_t run_start = 0;
+        for (size_t i = 1; i <= pending.size(); ++i) {
+            if (i == pending.size() || pending[i].block_id != pending[i - 1].block_id + 1) {
+                failed = !load_pending_run(descriptor.file_handle, pending.data() + run_start, i - run_start, buffer) || failed;
+                run_start = i;
+            }
+        }
+        if (failed) {
+            return -1;
+        }
+        bytes_read = cursor;
+    }
+    return static_cast<SSIZE_T>(bytes_read);
+}
+
+// Выровненный буфер потока для ввода-вывода в обход кэша, когда буфер вызывающего не выровнен
+static char* get_bounce_buffer(const size_t size) {
+    struct BounceBuffer {
+        char* data = nullptr;
+        size_t size = 0;
+        size_t alignment = 0;
+        ~BounceBuffer() { platform_aligned_free(data); }
+    };
+    thread_local BounceBuffer bounce;
+    if (bounce.size < size || bounce.alignment < block_size) {
+        platform_aligned_free(bounce.data);
+        bounce.data = static_cast<char*>(platform_aligned_alloc(size, block_size));
+        bounce.size = bounce.data ? size : 0;
+        bounce.alignment = block_size;
+    }
+    return bounce.data;
+}
+
+static bool should_bypass_cache(const size_t count, const LONGLONG offset) {
+    return bypass_threshold != 0 && count >= bypass_threshold && (offset & (block_size - 1)) == 0;
+}
+
+// Вызывает visit(block) для грязных блоков файла из [first_block, last_block] сегмента
+template <typename Visitor>
+static void for_each_dirty_block(const CacheShard& shard, const LONGLONG file_id, const LONGLONG first_block,
+                                 const LONGLONG last_block, Visitor visit) {
+    const auto file_blocks = shard.dirty_by_file.find(file_id);
+    if (file_blocks == shard.dirty_by_file.end()) {
+        return;
+    }
+    for (auto block_id = file_blocks->second.lower_bound(first_block);
+         block_id != file_blocks->second.end() && *block_id <= last_block; ++block_id) {
+        const CacheKey key = { file_id, *block_id };
+        visit(shard.slots[find_cache_slot(shard, key, hash_cache_key(key))]);
+    }
+}
+
+// Чтение в обход кэша: данные читаются с диска, а грязные блоки кэша накладываются поверх,
+// потому что они новее диска. Если за время чтения какой-то блок ушел на диск (и мог перестать
+// быть грязным раньше, чем мы его увидели), чтение повторяется
+static SSIZE_T read_direct(const FileDescriptor& descriptor, char* buffer, const size_t count, const LONGLONG offset) {
+    const bool aligned = reinterpret_cast<uintptr_t>(buffer) % descriptor.sector_size == 0 && count % descriptor.sector_size == 0;
+    const size_t length = aligned ? count : (count + block_size - 1) & ~(block_size - 1);
+    char* target = aligned ? buffer : get_bounce_buffer(length);
+    if (!target) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return -1;
+    }
+    const LONGLONG first_block = offset >> block_shift;
+    const LONGLONG last_block = (offset + static_cast<LONGLONG>(count) - 1) >> block_shift;
+
+    for (int attempt = 0; attempt < BYPASS_READ_ATTEMPTS; ++attempt) {
+        const unsigned long generation = disk_write_generation.load(std::memory_order_acquire);
+        // Уже начатые записи блоков диапазона дожидаемся: их данные могли не дойти до диска
+        for (const auto& shard : cache_shards) {
+            std::unique_lock<std::mutex> shard_lock(shard->lock);
+            shard->block_released.wait(shard_lock, [&] {
+                bool writeback = false;
+                for_each_dirty_block(*shard, descriptor.file_id, first_block, last_block, [&writeback](const CacheBlock& block) {
+                    writeback = writeback || block.is_writeback;
+                });
+                return !writeback;
+            });
+        }
+
+        const SSIZE_T disk_bytes = platform_pread(descriptor.file_handle, target, length, offset);
+        count_disk_read(disk_bytes);
+        if (disk_bytes < 0) {
+            std::cerr << "pread failed: " << GetLastError() << std::endl;
+            return -1;
+        }
+        if (static_cast<size_t>(disk_bytes) < count) {
+            std::memset(target + disk_bytes, 0, count - disk_bytes); // Хвост еще в грязных блоках или дыра
+        }
+
+        for (const auto& shard : cache_shards) {
+            std::lock_guard<std::mutex> shard_lock(shard->lock);
+            for_each_dirty_block(*shard, descriptor.file_id, first_block, last_block, [&](const CacheBlock& block) {
+                if (block.is_reserved) {
+                    return; // Вызывающий еще заполняет блок
+                }
+                const LONGLONG block_start = (block.key.block_id << block_shift) - offset;
+                const LONGLONG copy_begin = std::max<LONGLONG>(block_start + block.valid_begin, 0);
+                const LONGLONG copy_end = std::min<LONGLONG>(block_start + block.valid_end, static_cast<LONGLONG>(count));
+                if (copy_begin < copy_end) {
+                    std::memcpy(target + copy_begin, block.data + (copy_begin - block_start), copy_end - copy_begin);
+                }
+            });
+        }
+
+        if (disk_write_generation.load(std::memory_order_acquire) == generation) {
+            if (!aligned) {
+                std::memcpy(buffer, target, count);
+            }
+            return static_cast<SSIZE_T>(count);
+        }
+    }
+    return read_cached(descriptor, buffer, count, offset); // Запись идет непрерывно: читаем через кэш
+}
+
+// Выборочный учет для отображения: до копирования mincore показывает, какие блоки уже в памяти.
+// Проверяется каждое MAPPED_RESIDENCY_SAMPLE-е чтение, его блоки засчитываются с весом выборки
+static void account_mapped_residency(FileDescriptor& descriptor, const size_t offset, const size_t length) {
+    if (descriptor.mapped_reads.fetch_add(1, std::memory_order_relaxed) % MAPPED_RESIDENCY_SAMPLE != 0) {
+        return;
+    }
+    const size_t first_byte = offset & ~(block_size - 1);
+    const size_t last_byte = std::min(((offset + length - 1) | (block_size - 1)) + 1, descriptor.mapping_size);
+    const size_t blocks = (last_byte - first_byte + block_size - 1) >> block_shift;
+    const size_t resident = platform_count_resident(descriptor.mapping + first_byte, last_byte - first_byte, block_size);
+    count_stat(LAB2_STAT_HITS, resident * MAPPED_RESIDENCY_SAMPLE);
+    count_stat(LAB2_STAT_MISSES, (blocks - resident) * MAPPED_RESIDENCY_SAMPLE);
+}
+
+// Чтение из отображения: одна копия из страниц ОС, без O_DIRECT и слотов кэша. Грязные блоки
+// других дескрипторов того же файла видны только после их записи на диск
+static SSIZE_T read_mapped(FileDescriptor& descriptor, char* buffer, const size_t count, const LONGLONG offset) {
+    if (static_cast<size_t>(offset) >= descriptor.mapping_size || count == 0) {
+        return 0;
+    }
+    const size_t length = std::min(count, descriptor.mapping_size - static_cast<size_t>(offset));
+    account_mapped_residency(descriptor, static_cast<size_t>(offset), length);
+    update_readahead(descriptor, offset >> block_shift, (offset + length - 1) >> block_shift);
+    std::memcpy(buffer, descriptor.mapping + offset, length);
+    return static_cast<SSIZE_T>(length);
+}
+
+static SSIZE_T read_at(FileDescriptor& descriptor, char* buffer, size_t count, const LONGLONG offset) {
+    const FileCallStats call_stats(descriptor, true);
+    if (descriptor.is_mapped) {
+        return read_mapped(descriptor, buffer, count, offset);
+    }
+    // Конец файла известен без обращения к диску: хвост последнего блока за ним не возвращается
+    const LONGLONG file_size = get_file_size(descriptor);
+    if (offset >= file_size || count == 0) {
+        return 0;
+    }
+    count = std::min(count, static_cast<size_t>(file_size - offset));
+    if (should_bypass_cache(count, offset)) {
+        return read_direct(descriptor, buffer, count, offset);
+    }
+    const SSIZE_T bytes_read = read_cached(descriptor, buffer, count, offset);
+    if (bytes_read > 0) {
+        update_readahead(descriptor, offset >> block_shift, (offset + bytes_read - 1) >> block_shift);
+    }
+    return bytes_read;
+}
+
+SSIZE_T lab2_read(const HANDLE file_handle, void* buf, const size_t count) {
+    const TraceCall trace(TRACE_READ, file_handle, static_cast<LONGLONG>(count));
+    FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    if (descriptor.file_handle == INVALID_HANDLE_VALUE || descriptor.file_id == -1) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> descriptor_lock(descriptor.lock);
+    const SSIZE_T bytes_read = read_at(descriptor, static_cast<char*>(buf), count, descriptor.offset);
+    if (bytes_read > 0) {
+        descriptor.offset += bytes_read;
+    }
+    return bytes_read;
+}
+
+SSIZE_T lab2_pread(const HANDLE file_handle, void* buf, const size_t count, const LONGLONG offset) {
+    const TraceCall trace(TRACE_PREAD, file_handle, offset, static_cast<LONGLONG>(count));
+    FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    if (descriptor.file_handle == INVALID_HANDLE_VALUE || descriptor.file_id == -1) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+    if (offset < 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    return read_at(descriptor, static_cast<char*>(buf), count, offset);
+}
+
+SSIZE_T lab2_readv(const HANDLE file_handle, const Lab2IoVec* vectors, const int count) {
+    FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    if (descriptor.file_handle == INVALID_HANDLE_VALUE || descriptor.file_id == -1) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+    if (!vectors || count < 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> descriptor_lock(descriptor.lock);
+    SSIZE_T total = 0;
+    for (int i = 0; i < count; ++i) {
+        const SSIZE_T bytes_read = read_at(descriptor, static_cast<char*>(vectors[i].base), vectors[i].length, descriptor.offset);
+        if (bytes_read < 0) {
+            return total > 0 ? total : -1;
+        }
+        descriptor.offset += bytes_read;
+        total += bytes_read;
+        if (static_cast<size_t>(bytes_read) < vectors[i].length) {
+            break; // Конец файла
+        }
+    }
+    return total;
+}
+
+SSIZE_T lab2_read_pinned(const HANDLE file_handle, const size_t count, Lab2PinnedView* view) {
+    FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    const HANDLE found_handle = descriptor.file_handle;
+    const LONGLONG file_id = descriptor.file_id;
+    if (found_handle == INVALID_HANDLE_VALUE || file_id == -1 || descriptor.is_mapped) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+    if (!view) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    *view = { nullptr, 0, nullptr };
+
+    std::lock_guard<std::mutex> descriptor_lock(descriptor.lock);
+    const FileCallStats call_stats(descriptor, true);
+    LONGLONG& offset = descriptor.offset;
+
+    while (true) {
+        const LONGLONG file_size = get_file_size(descriptor);
+        if (offset >= file_size || count == 0) {
+            return 0;
+        }
+        const LONGLONG block_id = offset >> block_shift;
+        const size_t block_offset = offset & (block_size - 1);
+        const size_t length = std::min({ block_size - block_offset, count, static_cast<size_t>(file_size - offset) });
+
+        const CacheKey key = { file_id, block_id };
+        const size_t hash = hash_cache_key(key);
+        CacheShard& shard = get_cache_shard(key, hash);
+        std::unique_lock<std::mutex> shard_lock(shard.lock);
+
+        const int32_t slot = load_cache_block(shard, shard_lock, key, hash, descriptor, block_offset, length);
+        if (slot == RETRY_CACHE_LOOKUP) {
+            continue;
+        }
+        if (slot < 0) {
+            return -1;
+        }
+
+        CacheBlock& block = shard.slots[slot];
+        block.pin_count++;
+        *view = { block.data + block_offset, length, &block };
+        offset += length;
+        shard_lock.unlock();
+
+        update_readahead(descriptor, block_id, block_id);
+        return static_cast<SSIZE_T>(length);
+    }
+}
+
+int lab2_release(Lab2PinnedView* view) {
+    if (!view || !view->block) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+
+    // Ключ закрепленного блока не меняется, поэтому сегмент находится без блокировки
+    CacheBlock& block = *static_cast<CacheBlock*>(view->block);
+    CacheShard& shard = get_cache_shard(block.key, hash_cache_key(block.key));
+    {
+        std::lock_guard<std::mutex> shard_lock(shard.lock);
+        block.pin_count--;
+        shard.block_released.notify_all();
+    }
+    *view = { nullptr, 0, nullptr };
+    return 0;
+}
+
+static SSIZE_T write_cached(const FileDescriptor& descriptor, const char* buffer, const size_t count, const LONGLONG offset) {
+    size_t bytes_written = 0;
+
+    while (bytes_written < count) {
+        const LONGLONG position = offset + static_cast<LONGLONG>(bytes_written);
+        const LONGLONG block_id = position >> block_shift;
+        const size_t block_offset = position & (block_size - 1);
+        const size_t to_write = std::min(block_size - block_offset, count - bytes_written);
+
+        const CacheKey key = { descriptor.file_id, block_id };
+        const size_t hash = hash_cache_key(key);
+        CacheShard& shard = get_cache_shard(key, hash);
+        std::unique_lock<std::mutex> shard_lock(shard.lock);
+
+        const int32_t found_slot = find_cache_slot(shard, key, hash);
+        CacheBlock* block_ptr = nullptr;
+        const LONGLONG file_size = descriptor.file->size.load(std::memory_order_acquire);
+
+        if (found_slot != EMPTY_INDEX_ENTRY) {
+            block_ptr = &shard.slots[found_slot];
+            if (is_block_busy(*block_ptr)) {
+                // Буфер сейчас уходит на диск, заполняется на месте или читается: меняем его только после этого
+                shard.block_released.wait(shard_lock, [block_ptr] { return !is_block_busy(*block_ptr); });
+                continue;
+            }
+            if (!can_write_partial(descriptor, block_ptr, block_id, block_offset, block_offset + to_write, file_size)) {
+                return -1;
+            }
+            // Запись, не примыкающая к действительному диапазону частичного блока, требует дочитать его
+            if (is_partial_block(*block_ptr) && !merge_valid_range(*block_ptr, block_offset, to_write) &&
+                !fill_partial_block(*block_ptr, descriptor)) {
+                return -1;
+            }
+            count_cache_hit(shard);
+
+            if (std::memcmp(block_ptr->data + block_offset, buffer + bytes_written, to_write) != 0) {
+                std::memcpy(block_ptr->data + block_offset, buffer + bytes_written, to_write);
+                mark_block_dirty(shard, *block_ptr);
+            }
+
+            shard.policy->on_hit(static_cast<uint32_t>(found_slot), block_ptr->is_prefetched);
+            block_ptr->is_prefetched = false;
+        } else {
+            if (!can_write_partial(descriptor, nullptr, block_id, block_offset, block_offset + to_write, file_size)) {
+                return -1;
+            }
+            const int32_t slot = acquire_cache_slot(shard, shard_lock);
+            if (slot == RETRY_CACHE_LOOKUP) {
+                continue;
+            }
+            if (slot < 0) {
+                return -1;
+            }
+            count_stat(LAB2_STAT_MISSES);
+
+            // Блок не читается с диска: запись целого блока его полностью перекрывает, а для частичной
+            // остальные байты дочитаются, только если понадобятся. Копия из сжатого уровня или
+            // сегмента разделяемой памяти дает весь блок сразу
+            const bool from_tier = take_tier_block(shard, slot, key, hash);
+            block_ptr = &install_cache_block(shard, slot, key, hash);
+            if (!from_tier) {
+                block_ptr->valid_begin = static_cast<uint32_t>(block_offset);
+                block_ptr->valid_end = static_cast<uint32_t>(block_offset + to_write);
+            }
+
+            std::memcpy(block_ptr->data + block_offset, buffer + bytes_written, to_write);
+            mark_block_dirty(shard, *block_ptr); // Помечаем блок как "грязный"
+        }
+        // Хвост блока за концом файла — нули: дочитывать с диска нечего
+        complete_block_past_eof(*block_ptr, file_size);
+
+        bytes_written += to_write;
+    }
+    return static_cast<SSIZE_T>(bytes_written);
+}
+
+
+// Запись целых блоков в обход кэша. Блоки диапазона, которые уже есть в кэше, обновляются
+// на месте и на время записи помечаются is_writeback, как при фоновой записи; блоки, которые
+// промах успел прочитать с диска во время записи, выбрасываются как устаревшие
+static SSIZE_T write_direct(const FileDescriptor& descriptor, const char* buffer, const size_t count, const LONGLONG offset) {
+    const char* source = buffer;
+    if (reinterpret_cast<uintptr_t>(buffer) % descriptor.sector_size != 0) {
+        char* bounce = get_bounce_buffer(count);
+        if (!bounce) {
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return -1;
+        }
+        std::memcpy(bounce, buffer, count);
+        source = bounce;
+    }
+
+    const LONGLONG first_block = offset >> block_shift;
+    const size_t block_count = count >> block_shift;
+    thread_local std::vector<FlushCandidate> cached;
+    cached.clear();
+    for (size_t i = 0; i < block_count; ++i) {
+        const CacheKey key = { descriptor.file_id, first_block + static_cast<LONGLONG>(i) };
+        const size_t hash = hash_cache_key(key);
+        CacheShard& shard = get_cache_shard(key, hash);
+        std::unique_lock<std::mutex> shard_lock(shard.lock);
+        int32_t slot;
+        while ((slot = find_cache_slot(shard, key, hash)) != EMPTY_INDEX_ENTRY && is_block_busy(shard.slots[slot])) {
+            shard.block_released.wait(shard_lock);
+        }
+        if (slot == EMPTY_INDEX_ENTRY) {
+            continue;
+        }
+        CacheBlock& block = shard.slots[slot];
+        std::memcpy(block.data, buffer + (i << block_shift), block_size);
+        block.valid_begin = 0;
+        block.valid_end = static_cast<uint32_t>(block_size);
+        block.is_writeback = true;
+        cached.push_back({ key.block_id, &shard, slot, block.generation });
+    }
+
+    disk_write_generation.fetch_add(1, std::memory_order_acq_rel);
+    const SSIZE_T bytes_written = platform_pwrite(descriptor.file_handle, source, count, offset);
+    count_disk_write(bytes_written);
+    if (bytes_written < 0) {
+        std::cerr << "pwrite failed: " << GetLastError() << std::endl;
+    }
+    for (size_t i = 0; i < block_count; ++i) {
+        invalidate_shared_block({ descriptor.file_id, first_block + static_cast<LONGLONG>(i) });
+    }
+
+    for (const FlushCandidate& candidate : cached) {
+        CacheShard& shard = *candidate.shard;
+        std::lock_guard<std::mutex> shard_lock(shard.lock);
+        CacheBlock& block = shard.slots[candidate.slot];
+        block.is_writeback = false;
+        if (bytes_written == static_cast<SSIZE_T>(count)) {
+            mark_block_clean(shard, block);
+        } else {
+            mark_block_dirty(shard, block); // Новые данные есть только в кэше
+        }
+        shard.block_released.notify_all();
+    }
+
+    for (size_t i = 0, next_cached = 0; i < block_count; ++i) {
+        const CacheKey key = { descriptor.file_id, first_block + static_cast<LONGLONG>(i) };
+        if (next_cached < cached.size() && cached[next_cached].block_id == key.block_id) {
+            next_cached++;
+            continue;
+        }
+        const size_t hash = hash_cache_key(key);
+        CacheShard& shard = get_cache_shard(key, hash);
+        std::lock_guard<std::mutex> shard_lock(shard.lock);
+        const int32_t slot = find_cache_slot(shard, key, hash);
+        if (slot == EMPTY_INDEX_ENTRY) {
+            // Блок мог уйти в сжатый уровень со старыми данными, пока шла запись
+            if (shard.compressed) {
+                shard.compressed->erase(key.file_id, key.block_id);
+            }
+        } else if (!is_block_busy(shard.slots[slot]) && !shard.slots[slot].is_dirty && shard.slots[slot].pin_count == 0) {
+            evict_cache_slot(shard, slot);
+        }
+    }
+    return bytes_written;
+}
+
+static SSIZE_T write_at(const FileDescriptor& descriptor, const char* buffer, const size_t count, const LONGLONG offset) {
+    const FileCallStats call_stats(descriptor, true);
+    if (descriptor.is_mapped) {
+        SetLastError(ERROR_INVALID_HANDLE); // Хэндл открыт только для чтения из отображения
+        return -1;
+    }
+    // Грязный блок записывает только открытый на запись дескриптор файла: без него блок не уйдет на диск
+    if (!descriptor.is_writable) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+    // Размер растет до того, как данные станут грязными блоками или уйдут на диск в обход кэша.
+    // Если запись не удастся, файл останется продленным дырой
+    if (count > 0) {
+        extend_file_size(descriptor, offset + static_cast<LONGLONG>(count));
+    }
+    if (should_bypass_cache(count, offset) && (count & (block_size - 1)) == 0) {
+        return write_direct(descriptor, buffer, count, offset);
+    }
+    return write_cached(descriptor, buffer, count, offset);
+}
+
+SSIZE_T lab2_write(const HANDLE file_handle, const void* buf, const size_t count) {
+    const TraceCall trace(TRACE_WRITE, file_handle, static_cast<LONGLONG>(count));
+    FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    if (descriptor.file_handle == INVALID_HANDLE_VALUE || descriptor.file_id == -1) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> descriptor_lock(descriptor.lock);
+    const SSIZE_T bytes_written = write_at(descriptor, static_cast<const char*>(buf), count, descriptor.offset);
+    if (bytes_written > 0) {
+        descriptor.offset += bytes_written;
+    }
+    return bytes_written;
+}
 
-std::map<HANDLE, FileDescriptor> fd_table;
-std::map<CacheKey, CacheBlock> cache_table;
-std::vector<CacheKey> cache_order;
-unsigned int clock_hand = 0;
+SSIZE_T lab2_pwrite(const HANDLE file_handle, const void* buf, const size_t count, const LONGLONG offset) {
+    const TraceCall trace(TRACE_PWRITE, file_handle, offset, static_cast<LONGLONG>(count));
+    const FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    if (descriptor.file_handle == INVALID_HANDLE_VALUE || descriptor.file_id == -1) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+    if (offset < 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    return write_at(descriptor, static_cast<const char*>(buf), count, offset);
+}
 
-// Функция для получения уникального идентификатора файла
-LONGLONG get_file_id(HANDLE file_handle) {
-    BY_HANDLE_FILE_INFORMATION file_info;
-    if (!GetFileInformationByHandle(file_handle, &file_info)) {
-        std::cerr << "GetFileInformationByHandle failed: " << GetLastError() << std::endl;
+SSIZE_T lab2_writev(const HANDLE file_handle, const Lab2IoVec* vectors, const int count) {
+    FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    if (descriptor.file_handle == INVALID_HANDLE_VALUE || descriptor.file_id == -1) {
+        SetLastError(ERROR_INVALID_HANDLE);
         return -1;
     }
-    // Сочетание индекса тома и идентификатора файла уникально
-    return (static_cast<LONGLONG>(file_info.nFileIndexHigh) << 32) | file_info.nFileIndexLow;
+    if (!vectors || count < 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> descriptor_lock(descriptor.lock);
+    SSIZE_T total = 0;
+    for (int i = 0; i < count; ++i) {
+        const SSIZE_T bytes_written = write_at(descriptor, static_cast<const char*>(vectors[i].base), vectors[i].length, descriptor.offset);
+        if (bytes_written < 0) {
+            return total > 0 ? total : -1;
+        }
+        descriptor.offset += bytes_written;
+        total += bytes_written;
+        if (static_cast<size_t>(bytes_written) < vectors[i].length) {
+            break;
+        }
+    }
+    return total;
 }
 
-FileDescriptor& get_file_descriptor(const HANDLE file_handle) {
-    const auto iterator = fd_table.find(file_handle);
-    if (iterator == fd_table.end()) {
-        static FileDescriptor invalid_fd = { INVALID_HANDLE_VALUE, -1, {0} };
-        return invalid_fd;
+SSIZE_T lab2_write_reserve(const HANDLE file_handle, const size_t count, Lab2WriteReservation* reservation) {
+    FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    const HANDLE found_handle = descriptor.file_handle;
+    const LONGLONG file_id = descriptor.file_id;
+    if (found_handle == INVALID_HANDLE_VALUE || file_id == -1 || descriptor.is_mapped || !descriptor.is_writable) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+    if (!reservation || count == 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    *reservation = { nullptr, 0, nullptr };
+
+    std::lock_guard<std::mutex> descriptor_lock(descriptor.lock);
+    const FileCallStats call_stats(descriptor, true);
+    LONGLONG& offset = descriptor.offset;
+
+    while (true) {
+        const LONGLONG block_id = offset >> block_shift;
+        const size_t block_offset = offset & (block_size - 1);
+        const size_t to_write = std::min(block_size - block_offset, count);
+
+        const CacheKey key = { file_id, block_id };
+        const size_t hash = hash_cache_key(key);
+        CacheShard& shard = get_cache_shard(key, hash);
+        std::unique_lock<std::mutex> shard_lock(shard.lock);
+
+        const int32_t found_slot = find_cache_slot(shard, key, hash);
+        CacheBlock* block_ptr = nullptr;
+        const LONGLONG file_size = descriptor.file->size.load(std::memory_order_acquire);
+        if (found_slot != EMPTY_INDEX_ENTRY) {
+            block_ptr = &shard.slots[found_slot];
+            if (is_block_busy(*block_ptr)) {
+                shard.block_released.wait(shard_lock, [block_ptr] { return !is_block_busy(*block_ptr); });
+                continue;
+            }
+            if (!can_write_partial(descriptor, block_ptr, block_id, block_offset, block_offset + to_write, file_size)) {
+                return -1;
+            }
+            if (is_partial_block(*block_ptr) && !merge_valid_range(*block_ptr, block_offset, to_write) &&
+                !fill_partial_block(*block_ptr, descriptor)) {
+                return -1;
+            }
+            count_cache_hit(shard);
+            shard.policy->on_hit(static_cast<uint32_t>(found_slot), block_ptr->is_prefetched);
+            block_ptr->is_prefetched = false;
+        } else {
+            if (!can_write_partial(descriptor, nullptr, block_id, block_offset, block_offset + to_write, file_size)) {
+                return -1;
+            }
+            const int32_t slot = acquire_cache_slot(shard, shard_lock);
+            if (slot == RETRY_CACHE_LOOKUP) {
+                continue;
+            }
+            if (slot < 0) {
+                return -1;
+            }
+            count_stat(LAB2_STAT_MISSES);
+            const bool from_tier = take_tier_block(shard, slot, key, hash);
+            block_ptr = &install_cache_block(shard, slot, key, hash);
+            if (!from_tier) {
+                block_ptr->valid_begin = static_cast<uint32_t>(block_offset);
+                block_ptr->valid_end = static_cast<uint32_t>(block_offset + to_write);
+            }
+        }
+        complete_block_past_eof(*block_ptr, file_size);
+
+        // До lab2_commit_write блок не вытесняется и не пишется на диск, а lab2_write к нему ждет
+        block_ptr->is_reserved = true;
+        block_ptr->pin_count++;
+        extend_file_size(descriptor, offset + static_cast<LONGLONG>(to_write));
+        *reservation = { block_ptr->data + block_offset, to_write, block_ptr };
+        offset += to_write;
+        return static_cast<SSIZE_T>(to_write);
     }
-    return iterator->second;
 }
 
-unsigned long lab2_get_cache_hits() {
-    return cache_hits;
+int lab2_commit_write(Lab2WriteReservation* reservation) {
+    if (!reservation || !reservation->block) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+
+    CacheBlock& block = *static_cast<CacheBlock*>(reservation->block);
+    CacheShard& shard = get_cache_shard(block.key, hash_cache_key(block.key));
+    {
+        std::lock_guard<std::mutex> shard_lock(shard.lock);
+        mark_block_dirty(shard, block);
+        block.is_reserved = false;
+        block.pin_count--;
+        shard.block_released.notify_all();
+    }
+    *reservation = { nullptr, 0, nullptr };
+    return 0;
 }
 
-unsigned long lab2_get_cache_misses() {
-    return cache_misses;
+static void push_async_completion(Lab2AsyncQueue* queue, void* user_data, const SSIZE_T result) {
+    std::lock_guard<std::mutex> queue_lock(queue->lock);
+    queue->outstanding--;
+    queue->completed.push_back({ user_data, result });
+    queue->completed_changed.notify_all();
 }
 
-void lab2_reset_cache_counters() {
-    cache_hits = 0;
-    cache_misses = 0;
+static AsyncRead* allocate_async_read() {
+    std::lock_guard<std::mutex> ring_lock(async_ring.lock);
+    if (async_ring.free_reads.empty()) {
+        async_ring.reads.push_back(std::make_unique<AsyncRead>());
+        return async_ring.reads.back().get();
+    }
+    AsyncRead* read = async_ring.free_reads.back();
+    async_ring.free_reads.pop_back();
+    return read;
 }
 
-void free_cache_block() {
-    while (!cache_order.empty()) {
-        CacheKey key = cache_order[clock_hand];
-        CacheBlock& block = cache_table[key];
+// Снимает одну ссылку; последняя отдает завершение в очередь вызывающего
+static void release_async_read(AsyncRead* read) {
+    if (read->waiting_blocks.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    const SSIZE_T result = read->failed.load(std::memory_order_relaxed) ? -1 : static_cast<SSIZE_T>(read->count);
+    push_async_completion(read->queue, read->user_data, result);
 
-        if (block.was_accessed) {
-            block.was_accessed = false; // Сброс флага доступа
-        } else {
-            if (block.is_dirty) { // Запись на диск, если блок изменен
-                const LONGLONG file_id = key.first;
-                const LONGLONG block_id = key.second;
-
-                // Находим file_handle по file_id
-                HANDLE file_handle = INVALID_HANDLE_VALUE;
-                for (const auto& [handle, fd] : fd_table) {
-                    if (fd.file_id == file_id) {
-                        file_handle = handle;
-                        break;
-                    }
-                }
+    std::lock_guard<std::mutex> ring_lock(async_ring.lock);
+    async_ring.free_reads.push_back(read);
+}
+
+static AsyncRun* allocate_async_run(const HANDLE file_handle, const LONGLONG first_block) {
+    std::lock_guard<std::mutex> ring_lock(async_ring.lock);
+    AsyncRun* run;
+    if (async_ring.free_runs.empty()) {
+        async_ring.runs.push_back(std::make_unique<AsyncRun>());
+        run = async_ring.runs.back().get();
+    } else {
+        run = async_ring.free_runs.back();
+        async_ring.free_runs.pop_back();
+    }
+    run->file_handle = file_handle;
+    run->first_block = first_block;
+    run->block_count = 0;
+    run->vectors.clear();
+    run->shared_generation = shared_write_generation();
+    return run;
+}
 
-                if (file_handle != INVALID_HANDLE_VALUE) {
-                    LARGE_INTEGER offset;
-                    offset.QuadPart = block_id * BLOCK_SIZE;
+// Разбор завершения серии: как load_pending_run, но данные раздаются всем ждущим запросам
+static void complete_async_run(AsyncRun* run, const SSIZE_T result) {
+    if (result < 0) {
+        std::cerr << "async read failed: " << -result << std::endl;
+    } else {
+        count_stat(LAB2_STAT_DISK_READ_BYTES, static_cast<unsigned long long>(result)); // Само чтение учтено при отправке
+    }
+    for (size_t i = 0; i < run->block_count; ++i) {
+        AsyncBlockLoad& load = run->blocks[i];
+        CacheShard& shard = *load.shard;
+        {
+            std::lock_guard<std::mutex> shard_lock(shard.lock);
+            CacheBlock& block = shard.slots[load.slot];
+            block.is_loading = false;
+            block.async_load = nullptr;
+            block.pin_count--;
+            shard.block_released.notify_all();
 
-                    DWORD bytes_written;
-                    if (!SetFilePointerEx(file_handle, offset, nullptr, FILE_BEGIN) ||
-                        !WriteFile(file_handle, block.data, BLOCK_SIZE, &bytes_written, nullptr)) {
-                        std::cerr << "WriteFile failed: " << GetLastError() << std::endl;
-                    }
+            if (result < 0) {
+                for (const LoadWaiter& waiter : load.waiters) {
+                    waiter.read->failed.store(true, std::memory_order_relaxed);
+                }
+                evict_cache_slot(shard, load.slot);
+            } else {
+                const size_t block_start = i << block_shift;
+                const size_t filled = static_cast<size_t>(result) > block_start ?
+                                      std::min(static_cast<size_t>(result) - block_start, block_size) : 0;
+                if (filled < block_size) {
+                    std::memset(block.data + filled, 0, block_size - filled);
+                }
+                publish_shared_block(block.key, block.data, run->shared_generation);
+                for (const LoadWaiter& waiter : load.waiters) {
+                    std::memcpy(waiter.read->buffer + waiter.buffer_offset, block.data + waiter.block_offset, waiter.length);
                 }
             }
+        }
+        for (const LoadWaiter& waiter : load.waiters) {
+            release_async_read(waiter.read);
+        }
+    }
+
+    std::lock_guard<std::mutex> ring_lock(async_ring.lock);
+    async_ring.free_runs.push_back(run);
+}
+
+// Отправка серии; ждет, пока в полете меньше depth операций. Блокировки сегментов не держим:
+// поток завершений берет их, чтобы освободить место
+static void submit_async_run(AsyncRun* run) {
+    std::unique_lock<std::mutex> ring_lock(async_ring.lock);
+    async_ring.room.wait(ring_lock, [] { return async_ring.in_flight < async_ring.depth; });
+    count_stat(LAB2_STAT_DISK_READS);
+    if (platform_async_readv(async_ring.ring, run->file_handle, run->vectors.data(), static_cast<int>(run->block_count),
+                             run->first_block << block_shift, run)) {
+        async_ring.in_flight++;
+        return;
+    }
+    ring_lock.unlock();
+    complete_async_run(run, -static_cast<SSIZE_T>(GetLastError()));
+}
 
-            // Освобождение памяти и удаление блока из кэша
-            _aligned_free(block.data);
-            cache_table.erase(key);
-            cache_order.erase(cache_order.begin() + clock_hand);
+static void async_reaper() {
+    constexpr int REAP_BATCH = 32;
+    PlatformAsyncCompletion completions[REAP_BATCH];
+    while (true) {
+        const int count = platform_async_wait(async_ring.ring, completions, REAP_BATCH);
+        if (count < 0) {
+            std::cerr << "io_uring wait failed: " << GetLastError() << std::endl;
+            continue;
+        }
 
-            if (clock_hand >= cache_order.size()) {
-                clock_hand = 0; // Сброс указателя clock_hand
+        // Место в кольце освобождается до разбора: завершения уже сняты с очереди ядра. Блокировка
+        // заодно упорядочивает разбор после отправки, которая заполняла серию под этой же блокировкой
+        bool stopping = false;
+        {
+            std::lock_guard<std::mutex> ring_lock(async_ring.lock);
+            for (int i = 0; i < count; ++i) {
+                if (completions[i].user_data) {
+                    async_ring.in_flight--;
+                } else {
+                    stopping = true; // Пустая операция из stop_async_ring
+                }
             }
-            break;
         }
+        async_ring.room.notify_all();
+        for (int i = 0; i < count; ++i) {
+            if (completions[i].user_data) {
+                complete_async_run(static_cast<AsyncRun*>(completions[i].user_data), completions[i].result);
+            }
+        }
+        if (stopping) {
+            return;
+        }
+    }
+}
 
-        // Перемещение указателя clock_hand
-        clock_hand = (clock_hand + 1) % cache_order.size();
+static bool start_async_ring() {
+    std::lock_guard<std::mutex> ring_lock(async_ring.lock);
+    if (async_ring.ring) {
+        return true;
+    }
+    if (async_ring.unavailable) {
+        return false;
     }
+    async_ring.ring = platform_async_create(async_queue_depth);
+    if (!async_ring.ring) {
+        std::cerr << "io_uring unavailable, async requests complete synchronously" << std::endl;
+        async_ring.unavailable = true;
+        return false;
+    }
+    async_ring.depth = async_queue_depth;
+    async_ring.in_flight = 0;
+    async_ring.reaper = std::thread(async_reaper);
+    return true;
 }
 
-char* allocate_aligned_buffer() {
-    void* buf = _aligned_malloc(BLOCK_SIZE, BLOCK_SIZE);
-    if (!buf) {
-        std::cerr << "_aligned_malloc failed" << std::endl;
-        return nullptr;
+static void stop_async_ring() {
+    std::unique_lock<std::mutex> ring_lock(async_ring.lock);
+    async_ring.unavailable = false;
+    if (!async_ring.ring) {
+        return;
     }
-    return static_cast<char*>(buf);
+    async_ring.room.wait(ring_lock, [] { return async_ring.in_flight == 0; });
+    platform_async_nop(async_ring.ring, nullptr);
+    ring_lock.unlock();
+
+    async_ring.reaper.join();
+    ring_lock.lock();
+    platform_async_destroy(async_ring.ring);
+    async_ring.ring = nullptr;
 }
 
-HANDLE lab2_open(const char* path, DWORD access_mode, DWORD creation_disposition) {
-    HANDLE file_handle = CreateFileA(
-        path,
-        access_mode,
-        FILE_SHARE_READ | FILE_SHARE_WRITE,
-        nullptr,
-        creation_disposition,
-        FILE_FLAG_NO_BUFFERING, // Отключение кэширования ОС
-        nullptr
-    );
+AsyncRing::~AsyncRing() {
+    stop_async_ring();
+}
 
-    if (file_handle == INVALID_HANDLE_VALUE) {
-        std::cerr << "CreateFile failed: " << GetLastError() << std::endl;
-        return INVALID_HANDLE_VALUE;
-    }
+Lab2AsyncQueue* lab2_async_queue_create() {
+    return new Lab2AsyncQueue();
+}
 
-    LONGLONG file_id = get_file_id(file_handle);
-    if (file_id == -1) {
-        CloseHandle(file_handle);
-        return INVALID_HANDLE_VALUE;
+void lab2_async_queue_destroy(Lab2AsyncQueue* queue) {
+    if (!queue) {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> queue_lock(queue->lock);
+        queue->completed_changed.wait(queue_lock, [queue] { return queue->outstanding == 0; });
     }
+    delete queue;
+}
 
-    FileDescriptor fd = { file_handle, file_id, {0} };
-    fd_table[file_handle] = fd;
-    return file_handle;
+static void complete_inline(Lab2AsyncQueue* queue, void* user_data, const SSIZE_T result) {
+    {
+        std::lock_guard<std::mutex> queue_lock(queue->lock);
+        queue->outstanding++;
+    }
+    push_async_completion(queue, user_data, result);
 }
 
-int lab2_close(const HANDLE file_handle) {
-    const auto iterator = fd_table.find(file_handle);
-    if (iterator == fd_table.end()) {
+// Попадания копируются сразу, промах занимает слот (is_loading, закреплен) и попадает в серию
+// подряд идущих промахов; если блок уже читает кольцо, запрос присоединяется к этому чтению
+int lab2_read_async(Lab2AsyncQueue* queue, const HANDLE file_handle, void* buf, size_t count,
+                    const LONGLONG offset, void* user_data) {
+    FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    if (descriptor.file_handle == INVALID_HANDLE_VALUE || descriptor.file_id == -1) {
         SetLastError(ERROR_INVALID_HANDLE);
         return -1;
     }
+    if (!queue || offset < 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    const auto buffer = static_cast<char*>(buf);
+    if (descriptor.is_mapped || should_bypass_cache(count, offset) || !start_async_ring()) {
+        complete_inline(queue, user_data, read_at(descriptor, buffer, count, offset));
+        return 0;
+    }
+    const LONGLONG file_size = get_file_size(descriptor);
+    if (offset >= file_size || count == 0) {
+        complete_inline(queue, user_data, 0); // Конец файла
+        return 0;
+    }
+    count = std::min(count, static_cast<size_t>(file_size - offset));
 
-    lab2_fsync(file_handle); // Синхронизация данных с диском
-    CloseHandle(file_handle);
-    fd_table.erase(iterator);
+    AsyncRead* read = allocate_async_read();
+    read->queue = queue;
+    read->buffer = buffer;
+    read->count = count;
+    read->user_data = user_data;
+    read->waiting_blocks = 1;
+    read->failed = false;
+    {
+        std::lock_guard<std::mutex> queue_lock(queue->lock);
+        queue->outstanding++;
+    }
+
+    AsyncRun* run = nullptr;
+    size_t cursor = 0;
+    while (cursor < count) {
+        const LONGLONG position = offset + static_cast<LONGLONG>(cursor);
+        const LONGLONG block_id = position >> block_shift;
+        const size_t block_offset = position & (block_size - 1);
+        const size_t length = std::min(block_size - block_offset, count - cursor);
+
+        const CacheKey key = { descriptor.file_id, block_id };
+        const size_t hash = hash_cache_key(key);
+        CacheShard& shard = get_cache_shard(key, hash);
+        std::unique_lock<std::mutex> shard_lock(shard.lock);
+
+        const int32_t found_slot = find_cache_slot(shard, key, hash);
+        if (found_slot != EMPTY_INDEX_ENTRY) {
+            CacheBlock& block = shard.slots[found_slot];
+            if (block.is_loading && block.async_load) {
+                block.async_load->waiters.push_back({ read, cursor, block_offset, length });
+                read->waiting_blocks.fetch_add(1, std::memory_order_relaxed);
+                count_stat(LAB2_STAT_COALESCED_MISSES);
+                cursor += length;
+                continue;
+            }
+            if (block.is_loading) {
+                // Блок читает синхронный вызов, он не ждет с закрепленными слотами; свою серию
+                // отправляем до ожидания
+                if (run) {
+                    shard_lock.unlock();
+                    submit_async_run(run);
+                    run = nullptr;
+                    continue;
+                }
+                count_stat(LAB2_STAT_COALESCED_MISSES);
+                shard.block_released.wait(shard_lock, [&block] { return !block.is_loading; });
+                continue;
+            }
+            if ((block_offset < block.valid_begin || block_offset + length > block.valid_end) &&
+                !fill_partial_block(block, descriptor)) {
+                read->failed = true;
+                break;
+            }
+            count_cache_hit(shard);
+            shard.policy->on_hit(static_cast<uint32_t>(found_slot), block.is_prefetched);
+            if (block.is_prefetched) {
+                count_stat(LAB2_STAT_READAHEAD_HITS);
+                block.is_prefetched = false;
+            }
+            std::memcpy(buffer + cursor, block.data + block_offset, length);
+            cursor += length;
+            continue;
+        }
+
+        // Серия продолжается только следующим блоком; отправляем ее без блокировки сегмента
+        if (run && (block_id != run->first_block + static_cast<LONGLONG>(run->block_count) ||
+                    run->block_count == READ_BATCH_MAX_BLOCKS)) {
+            shard_lock.unlock();
+            submit_async_run(run);
+            run = nullptr;
+            continue;
+        }
+        const int32_t slot = acquire_cache_slot(shard, shard_lock, run == nullptr);
+        if (slot == RETRY_CACHE_LOOKUP) {
+            continue;
+        }
+        if (slot == WRITEBACK_FAILED) {
+            read->failed = true;
+            break;
+        }
+        if (slot == EMPTY_INDEX_ENTRY) {
+            shard_lock.unlock();
+            submit_async_run(run);
+            run = nullptr;
+            continue;
+        }
+        count_stat(LAB2_STAT_MISSES);
+        if (take_tier_block(shard, slot, key, hash)) {
+            const CacheBlock& block = install_cache_block(shard, slot, key, hash);
+            std::memcpy(buffer + cursor, block.data + block_offset, length);
+            cursor += length;
+            continue;
+        }
+        if (!run) {
+            run = allocate_async_run(descriptor.file_handle, block_id);
+        }
+        if (run->block_count == run->blocks.size()) {
+            run->blocks.emplace_back();
+        }
+        AsyncBlockLoad& load = run->blocks[run->block_count++];
+        load.shard = &shard;
+        load.slot = slot;
+        load.waiters.clear();
+        load.waiters.push_back({ read, cursor, block_offset, length });
+        read->waiting_blocks.fetch_add(1, std::memory_order_relaxed);
+
+        CacheBlock& block = install_cache_block(shard, slot, key, hash);
+        block.is_loading = true;
+        block.async_load = &load;
+        block.pin_count++;
+        run->vectors.push_back({ block.data, block_size });
+        cursor += length;
+    }
+
+    if (run) {
+        submit_async_run(run);
+    }
+    release_async_read(read);
     return 0;
 }
 
-SSIZE_T lab2_read(const HANDLE file_handle, void* buf, const size_t count) {
-    auto& [found_handle, file_id, offset] = get_file_descriptor(file_handle);
-    if (found_handle == INVALID_HANDLE_VALUE || file_id == -1) {
+// Запись поглощает кэш без чтения с диска, поэтому завершается сразу
+int lab2_write_async(Lab2AsyncQueue* queue, const HANDLE file_handle, const void* buf, const size_t count,
+                     const LONGLONG offset, void* user_data) {
+    const FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    if (descriptor.file_handle == INVALID_HANDLE_VALUE || descriptor.file_id == -1) {
         SetLastError(ERROR_INVALID_HANDLE);
         return -1;
     }
+    if (!queue || offset < 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    complete_inline(queue, user_data, write_at(descriptor, static_cast<const char*>(buf), count, offset));
+    return 0;
+}
 
-    size_t bytes_read = 0;
-    const auto buffer = static_cast<char*>(buf);
+static int take_completions(Lab2AsyncQueue* queue, Lab2AsyncCompletion* completions, const int max) {
+    int taken = 0;
+    while (taken < max && !queue->completed.empty()) {
+        completions[taken++] = queue->completed.front();
+        queue->completed.pop_front();
+    }
+    return taken;
+}
 
-    while (bytes_read < count) {
-        LONGLONG block_id = offset.QuadPart / BLOCK_SIZE;
-        const size_t block_offset = offset.QuadPart % BLOCK_SIZE;
-        const size_t bytes_to_read = std::min(BLOCK_SIZE - block_offset, count - bytes_read);
-
-        CacheKey key = { file_id, block_id };
-
-        auto cache_iterator = cache_table.find(key);
-        if (cache_iterator != cache_table.end()) {
-            cache_hits++;
-            CacheBlock& found_block = cache_iterator->second;
-            found_block.was_accessed = true; // Обновление флага доступа
-
-            size_t available_bytes = BLOCK_SIZE - block_offset;
-            const size_t bytes_from_block = std::min(bytes_to_read, available_bytes);
-            std::memcpy(buffer + bytes_read, found_block.data + block_offset, bytes_from_block);
-            offset.QuadPart += bytes_from_block;
-            bytes_read += bytes_from_block;
-        } else {
-            cache_misses++;
-            // std::cout << "Cache miss: block_id = " << block_id << std::endl;
+int lab2_async_poll(Lab2AsyncQueue* queue, Lab2AsyncCompletion* completions, const int max) {
+    if (!queue || !completions || max < 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    std::lock_guard<std::mutex> queue_lock(queue->lock);
+    return take_completions(queue, completions, max);
+}
 
-            if (cache_table.size() >= MAX_CACHE_SIZE) {
-                free_cache_block();
-            }
+int lab2_async_wait(Lab2AsyncQueue* queue, Lab2AsyncCompletion* completions, const int min_completions, const int max) {
+    if (!queue || !completions || min_completions < 0 || max < min_completions) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    std::unique_lock<std::mutex> queue_lock(queue->lock);
+    queue->completed_changed.wait(queue_lock, [queue, min_completions] {
+        return queue->completed.size() >= std::min(static_cast<size_t>(min_completions), queue->completed.size() + queue->outstanding);
+    });
+    return take_completions(queue, completions, max);
+}
 
-            char* aligned_buf = allocate_aligned_buffer();
-            LARGE_INTEGER read_offset;
-            read_offset.QuadPart = block_id * BLOCK_SIZE;
+LONGLONG lab2_lseek(const HANDLE file_handle, const LONGLONG offset, const int whence) {
+    const TraceCall trace(TRACE_LSEEK, file_handle, offset, whence);
+    FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    if (descriptor.file_handle == INVALID_HANDLE_VALUE || descriptor.file_id == -1) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
 
-            DWORD bytes_read_from_disk;
-            if (!SetFilePointerEx(found_handle, read_offset, nullptr, FILE_BEGIN) ||
-                !ReadFile(found_handle, aligned_buf, BLOCK_SIZE, &bytes_read_from_disk, nullptr)) {
-                std::cerr << "ReadFile failed: " << GetLastError() << std::endl;
-                _aligned_free(aligned_buf);
-                return -1;
-            }
+    std::lock_guard<std::mutex> descriptor_lock(descriptor.lock);
+    LONGLONG base;
+    switch (whence) {
+        case FILE_BEGIN: base = 0; break;
+        case FILE_CURRENT: base = descriptor.offset; break;
+        case FILE_END: base = descriptor.is_mapped ? static_cast<LONGLONG>(descriptor.mapping_size) : get_file_size(descriptor); break;
+        default:
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return -1;
+    }
 
-            if (bytes_read_from_disk < BLOCK_SIZE) {
-                std::memset(aligned_buf + bytes_read_from_disk, 0, BLOCK_SIZE - bytes_read_from_disk);
-            }
+    // Позиция за концом файла допустима: запись туда продлит файл дырой
+    if (offset < -base) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    descriptor.offset = base + offset;
+    return descriptor.offset;
+}
 
-            const CacheBlock new_block = { aligned_buf, false, true };
-            cache_table[key] = new_block;
-            cache_order.push_back(key);
+// Блоки пишутся целиком (O_DIRECT), и запись хвостового блока продлевает файл до границы блока;
+// лишнее обрезается до логического размера. Размер только растет, поэтому данные, уже ушедшие
+// на диск, обрезка не задевает
+static bool trim_file_tail(const LONGLONG file_id, const LONGLONG file_size) {
+    std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+    const FileDescriptor* owner = get_writeback_descriptor(file_id);
+    if (!owner || !owner->is_writable) {
+        return true;
+    }
+    const HANDLE file_handle = owner->file_handle;
+    if (platform_get_file_size(file_handle) > file_size && platform_set_file_size(file_handle, file_size) != 0) {
+        std::cerr << "truncate failed: " << GetLastError() << std::endl;
+        return false;
+    }
+    return true;
+}
 
-            size_t available_bytes = bytes_read_from_disk - block_offset;
-            if (available_bytes <= 0) {
-                break;
+// Одна фиксация группы: запись всех грязных блоков файла, обрезка хвоста и сброс на устройство
+static int commit_file(const FileDescriptor& descriptor, const bool metadata) {
+    const LONGLONG file_id = descriptor.file_id;
+    std::vector<FlushCandidate> blocks;
+    bool filled = true;
+    for (const auto& shard : cache_shards) {
+        std::unique_lock<std::mutex> shard_lock(shard->lock);
+        // Блоки, которые сейчас пишет фоновый поток или заполняет вызывающий, дожидаемся:
+        // иначе после fsync на диске может оказаться незаконченная запись
+        shard->block_released.wait(shard_lock, [&shard, file_id] {
+            const auto file_blocks = shard->dirty_by_file.find(file_id);
+            if (file_blocks == shard->dirty_by_file.end()) {
+                return true;
             }
-            const size_t bytes_from_block = std::min(bytes_to_read, available_bytes);
-            std::memcpy(buffer + bytes_read, aligned_buf + block_offset, bytes_from_block);
-            offset.QuadPart += bytes_from_block;
-            bytes_read += bytes_from_block;
+            return std::none_of(file_blocks->second.begin(), file_blocks->second.end(), [&shard, file_id](const LONGLONG block_id) {
+                const CacheKey key = { file_id, block_id };
+                const CacheBlock& block = shard->slots[find_cache_slot(*shard, key, hash_cache_key(key))];
+                return block.is_writeback || block.is_reserved;
+            });
+        });
+
+        const auto file_blocks = shard->dirty_by_file.find(file_id);
+        if (file_blocks == shard->dirty_by_file.end()) {
+            continue;
+        }
+        for (const LONGLONG block_id : file_blocks->second) {
+            const CacheKey key = { file_id, block_id };
+            filled = start_block_writeback(*shard, find_cache_slot(*shard, key, hash_cache_key(key)), blocks) && filled;
         }
     }
-    return static_cast<SSIZE_T>(bytes_read);
+
+    size_t ios = 0;
+    const bool written = flush_file_blocks(file_id, blocks, ios);
+    count_stat(LAB2_STAT_FSYNC_WRITES, ios);
+    count_stat(LAB2_STAT_FSYNC_WRITE_BYTES, blocks.size() << block_shift);
+    if (!written || !filled || !trim_file_tail(file_id, get_file_size(descriptor))) {
+        return -1;
+    }
+
+    count_stat(LAB2_STAT_SYNC_FLUSHES);
+    const int flushed = metadata ? platform_flush(descriptor.file_handle) : platform_flush_data(descriptor.file_handle);
+    if (flushed != 0) {
+        //std::cerr << "flush failed: " << GetLastError() << std::endl;
+        return -1;
+    }
+
+    return 0;
 }
 
-SSIZE_T lab2_write(const HANDLE file_handle, const void* buf, const size_t count) {
-    auto& [found_handle, file_id, offset] = get_file_descriptor(file_handle);
-    if (found_handle == INVALID_HANDLE_VALUE || file_id == -1) {
+// Групповая фиксация: первый пришедший пишет и сбрасывает файл, пришедшие во время его работы ждут,
+// и следующий из них фиксирует сразу всех ждущих. Вызов, покрытый чужой фиксацией, получает ее итог
+static int sync_file(const HANDLE file_handle, const bool metadata) {
+    const FileDescriptor& descriptor = get_file_descriptor(file_handle);
+    if (descriptor.file_handle == INVALID_HANDLE_VALUE) {
         SetLastError(ERROR_INVALID_HANDLE);
         return -1;
     }
+    const FileCallStats call_stats(descriptor, false);
+    count_stat(LAB2_STAT_SYNC_CALLS);
+    SharedFile& file = *descriptor.file;
 
-    size_t bytes_written = 0;
-    const auto buffer = static_cast<const char*>(buf);
-
-    while (bytes_written < count) {
-        LONGLONG block_id = offset.QuadPart / BLOCK_SIZE;
-        const size_t block_offset = offset.QuadPart % BLOCK_SIZE;
-        const size_t to_write = std::min(BLOCK_SIZE - block_offset, count - bytes_written);
+    std::unique_lock<std::mutex> sync_lock(file.sync_lock);
+    const unsigned long long ticket = ++file.sync_requested;
+    file.sync_metadata = file.sync_metadata || metadata;
+    // Уже идущая фиксация могла собрать блоки до записей этого вызова: ждем ее конца
+    file.sync_done.wait(sync_lock, [&file, ticket] { return file.sync_completed >= ticket || !file.sync_running; });
+    if (file.sync_completed >= ticket) {
+        if (file.sync_result != 0) {
+            SetLastError(file.sync_error);
+        }
+        return file.sync_result;
+    }
 
-        CacheKey key = { file_id, block_id };
-        auto cache_it = cache_table.find(key);
-        CacheBlock* block_ptr = nullptr;
+    file.sync_running = true;
+    const unsigned long long batch = file.sync_requested;
+    const bool batch_metadata = file.sync_metadata;
+    file.sync_metadata = false;
+    sync_lock.unlock();
 
+    const int result = commit_file(descriptor, batch_metadata);
+    const DWORD error = result == 0 ? 0 : GetLastError();
 
-        if (cache_it != cache_table.end()) {
-            cache_hits++;
-            block_ptr = &cache_it->second;
+    sync_lock.lock();
+    file.sync_running = false;
+    file.sync_completed = batch;
+    file.sync_result = result;
+    file.sync_error = error;
+    file.sync_done.notify_all();
+    return result;
+}
 
-            if (std::memcmp(block_ptr->data + block_offset, buffer + bytes_written, to_write) != 0) {
-                std::memcpy(block_ptr->data + block_offset, buffer + bytes_written, to_write);
-                block_ptr->is_dirty = true;
-            }
+int lab2_fsync(const HANDLE file_handle) {
+    const TraceCall trace(TRACE_FSYNC, file_handle);
+    return sync_file(file_handle, true);
+}
 
-            block_ptr->was_accessed = true;
-        } else {
-            cache_misses++;
+int lab2_fdatasync(const HANDLE file_handle) {
+    const TraceCall trace(TRACE_FDATASYNC, file_handle);
+    return sync_file(file_handle, false);
+}
+// Состояние кэша на диске (числа — в порядке байт машины):
+//   "LAB2WARM", версия, размер блока, число файлов (uint32)
+//   на файл: file_id, время изменения, размер (int64), длина пути (uint32), путь,
+//            число блоков (uint32), блоки (uint64: номер блока << 1 | горячий)
+template <typename T>
+static void write_value(std::ostream& out, const T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
 
-            if (cache_table.size() >= MAX_CACHE_SIZE) {
-                free_cache_block();
-            }
+template <typename T>
+static bool read_value(std::istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
 
-            char* aligned_buf = allocate_aligned_buffer();
-            if (!aligned_buf) {
-                return -1;
-            }
+struct SavedFile {
+    std::string path;
+    PlatformFileInfo info;
+    std::vector<uint64_t> blocks;
+};
 
-            LARGE_INTEGER read_offset;
-            read_offset.QuadPart = block_id * BLOCK_SIZE;
+int lab2_save_cache_state(const char* path) {
+    if (!path) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    // Грязные блоки пишутся до снимка: иначе их запись изменит файлы после сохранения,
+    // и загрузка их отвергнет
+    flush_dirty_blocks(true);
 
-            DWORD bytes_read;
-            if (!SetFilePointerEx(found_handle, read_offset, nullptr, FILE_BEGIN) ||
-                !ReadFile(found_handle, aligned_buf, BLOCK_SIZE, &bytes_read, nullptr)) {
-                std::cerr << "ReadFile failed: " << GetLastError() << std::endl;
-                _aligned_free(aligned_buf);
-                return -1;
+    std::map<LONGLONG, SavedFile> files;
+    for (const auto& shard : cache_shards) {
+        std::lock_guard<std::mutex> shard_lock(shard->lock);
+        for (uint32_t slot = 0; slot < shard->slots.size(); ++slot) {
+            const CacheBlock& block = shard->slots[slot];
+            if (block.is_used && !block.is_loading) {
+                const uint64_t hot = shard->policy->is_hot(slot) ? 1 : 0;
+                files[block.key.file_id].blocks.push_back(static_cast<uint64_t>(block.key.block_id) << 1 | hot);
             }
-
-            if (bytes_read < BLOCK_SIZE) {
-                std::memset(aligned_buf + bytes_read, 0, BLOCK_SIZE - bytes_read);
+        }
+    }
+    {
+        std::shared_lock<std::shared_mutex> table_lock(fd_table_lock);
+        for (auto& [file_id, file] : files) {
+            const auto known_path = file_paths.find(file_id);
+            if (known_path != file_paths.end()) {
+                file.path = known_path->second;
             }
+        }
+    }
 
-            CacheBlock& block = cache_table[key] = { aligned_buf, false, true };
-            cache_order.push_back(key);
-            block_ptr = &block;
+    // Файл пишется рядом под временным именем и заменяет прежний целиком
+    const std::string temporary_path = std::string(path) + ".tmp";
+    std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Cannot create cache state " << temporary_path << std::endl;
+        return -1;
+    }
+    size_t saved_count = 0;
+    for (auto& [file_id, file] : files) {
+        // Время изменения берется по пути: файл мог быть уже закрыт или подменен другим
+        const HANDLE file_handle = file.path.empty() ? INVALID_HANDLE_VALUE :
+                                   platform_open_direct(file.path.c_str(), GENERIC_READ, OPEN_EXISTING);
+        const bool valid = file_handle != INVALID_HANDLE_VALUE && platform_get_file_info(file_handle, &file.info) == 0 &&
+                           file.info.file_id == file_id;
+        if (file_handle != INVALID_HANDLE_VALUE) {
+            platform_close(file_handle);
+        }
+        if (!valid) {
+            file.path.clear();
+            continue;
+        }
+        std::sort(file.blocks.begin(), file.blocks.end());
+        saved_count++;
+    }
 
-            std::memcpy(block_ptr->data + block_offset, buffer + bytes_written, to_write);
-            block_ptr->is_dirty = true; // Помечаем блок как "грязный"
+    out.write(CACHE_STATE_MAGIC, sizeof(CACHE_STATE_MAGIC));
+    write_value(out, CACHE_STATE_VERSION);
+    write_value(out, static_cast<uint32_t>(block_size));
+    write_value(out, static_cast<uint32_t>(saved_count));
+    for (const auto& [file_id, file] : files) {
+        if (file.path.empty()) {
+            continue;
         }
-        
-        offset.QuadPart += to_write;
-        bytes_written += to_write;
+        write_value(out, file.info.file_id);
+        write_value(out, file.info.modified);
+        write_value(out, file.info.size);
+        write_value(out, static_cast<uint32_t>(file.path.size()));
+        out.write(file.path.data(), static_cast<std::streamsize>(file.path.size()));
+        write_value(out, static_cast<uint32_t>(file.blocks.size()));
+        out.write(reinterpret_cast<const char*>(file.blocks.data()), static_cast<std::streamsize>(file.blocks.size() * sizeof(uint64_t)));
     }
-    return static_cast<SSIZE_T>(bytes_written);
+    out.close();
+    if (!out || std::rename(temporary_path.c_str(), path) != 0) {
+        std::cerr << "Cannot write cache state " << path << std::endl;
+        std::remove(temporary_path.c_str());
+        return -1;
+    }
+    return 0;
 }
 
-LONGLONG lab2_lseek(const HANDLE file_handle, const LONGLONG offset, const int whence) {
-    auto& [found_handle, file_id, file_offset] = get_file_descriptor(file_handle);
-    if (found_handle == INVALID_HANDLE_VALUE || file_id == -1) {
-        SetLastError(ERROR_INVALID_HANDLE);
+int lab2_load_cache_state(const char* path) {
+    if (!path) {
+        SetLastError(ERROR_INVALID_PARAMETER);
         return -1;
     }
-
-    if (whence != FILE_BEGIN) {
-        SetLastError(ERROR_INVALID_PARAMETER); // Поддерживается только абсолютное позиционирование
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        SetLastError(ERROR_FILE_NOT_FOUND);
         return -1;
     }
-
-    if (offset < 0) {
+    // Длины из файла сверяются с его размером до выделения памяти под них
+    const std::streamoff state_size = in.tellg();
+    in.seekg(0);
+    const auto bytes_left = [&in, state_size] { return static_cast<uint64_t>(state_size - in.tellg()); };
+    char magic[sizeof(CACHE_STATE_MAGIC)];
+    uint32_t version = 0;
+    uint32_t saved_block_size = 0;
+    uint32_t file_count = 0;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, CACHE_STATE_MAGIC, sizeof(magic)) != 0 ||
+        !read_value(in, version) || version != CACHE_STATE_VERSION || !read_value(in, saved_block_size) ||
+        !read_value(in, file_count)) {
+        std::cerr << "Bad cache state " << path << std::endl;
         SetLastError(ERROR_INVALID_PARAMETER);
         return -1;
     }
-
-    file_offset.QuadPart = offset;
-    return file_offset.QuadPart;
-}
-
-int lab2_fsync(const HANDLE file_handle) {
-    const HANDLE found_handle = get_file_descriptor(file_handle).file_handle;
-    if (found_handle == INVALID_HANDLE_VALUE) {
-        SetLastError(ERROR_INVALID_HANDLE);
+    if (saved_block_size != block_size) {
+        std::cerr << "Cache state block size " << saved_block_size << " differs from " << block_size << std::endl;
+        SetLastError(ERROR_INVALID_PARAMETER);
         return -1;
     }
 
-    for (auto& [key, block] : cache_table) {
-        if (key.first == get_file_descriptor(file_handle).file_id && block.is_dirty) {
-            LARGE_INTEGER write_offset;
-            write_offset.QuadPart = key.second * BLOCK_SIZE;
+    std::vector<WarmupFile> files;
+    for (uint32_t i = 0; i < file_count; ++i) {
+        PlatformFileInfo saved_info;
+        uint32_t path_length = 0;
+        uint32_t block_count = 0;
+        std::string file_path;
+        if (!read_value(in, saved_info.file_id) || !read_value(in, saved_info.modified) || !read_value(in, saved_info.size) ||
+            !read_value(in, path_length)) {
+            break;
+        }
+        if (path_length > bytes_left()) {
+            std::cerr << "Bad cache state " << path << ": path length " << path_length << std::endl;
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return -1;
+        }
+        file_path.resize(path_length);
+        std::vector<uint64_t> blocks;
+        if (!in.read(&file_path[0], path_length) || !read_value(in, block_count)) {
+            break;
+        }
+        if (block_count * sizeof(uint64_t) > bytes_left()) {
+            std::cerr << "Bad cache state " << path << ": block count " << block_count << std::endl;
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return -1;
+        }
+        blocks.resize(block_count);
+        if (!in.read(reinterpret_cast<char*>(blocks.data()), static_cast<std::streamsize>(block_count * sizeof(uint64_t)))) {
+            break;
+        }
+
+        // Файл тот же и не менялся с сохранения: иначе его блоки читать незачем
+        PlatformFileInfo info;
+        const HANDLE file_handle = platform_open_direct(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            continue;
+        }
+        const bool unchanged = platform_get_file_info(file_handle, &info) == 0 && info.file_id == saved_info.file_id &&
+                               info.modified == saved_info.modified && info.size == saved_info.size;
+        platform_close(file_handle);
+        if (!unchanged) {
+            continue;
+        }
 
-            DWORD bytes_written;
-            if (!SetFilePointerEx(found_handle, write_offset, nullptr, FILE_BEGIN) ||
-                !WriteFile(found_handle, block.data, BLOCK_SIZE, &bytes_written, nullptr)) {
-                std::cerr << "WriteFile failed: " << GetLastError() << std::endl;
-                return -1;
+        WarmupFile file = { file_path, info.file_id, {}, {} };
+        const LONGLONG end_block = (info.size + static_cast<LONGLONG>(block_size) - 1) >> block_shift;
+        for (const uint64_t entry : blocks) {
+            const LONGLONG block_id = static_cast<LONGLONG>(entry >> 1);
+            if (block_id < end_block) {
+                ((entry & 1) ? file.hot_blocks : file.cold_blocks).push_back(block_id);
             }
-            block.is_dirty = false;
         }
+        files.push_back(std::move(file));
     }
 
-    if (!FlushFileBuffers(found_handle)) {
-        //std::cerr << "FlushFileBuffers failed: " << GetLastError() << std::endl;
-        return -1;
+    // Состояние могло сохранить кэш большей ёмкости: читается не больше блоков, чем вмещает
+    // текущий, и сначала горячие блоки всех файлов, затем холодные
+    size_t warmup_budget = cache_capacity;
+    for (const bool hot : { true, false }) {
+        for (WarmupFile& file : files) {
+            std::vector<LONGLONG>& blocks = hot ? file.hot_blocks : file.cold_blocks;
+            blocks.resize(std::min(blocks.size(), warmup_budget));
+            warmup_budget -= blocks.size();
+        }
     }
 
+    std::unique_lock<std::shared_mutex> table_lock(fd_table_lock);
+    if (!init_cache()) {
+        return -1;
+    }
+    start_background_threads();
+    for (const WarmupFile& file : files) {
+        file_paths.emplace(file.file_id, file.path);
+    }
+    table_lock.unlock();
+    // Блоки читаются в фоне: вызывающий не ждет прогрева, а промахи до него идут как обычно
+    start_warmup_loader(std::move(files));
     return 0;
-}
\ No newline at end of file
+}
@@ -5,9 +5,7 @@
 #include <sys/types.h>
 #include <fcntl.h>
 
-#define NOMINMAX
-#include <windows.h>
-#include <BaseTsd.h>
+#include "platform.hpp"
 #include <map>
 #include <list>
 #include <vector>
@@ -17,18 +15,240 @@
 #include <iostream>
 #include <algorithm>
 
-#define BLOCK_SIZE 4096 // Max bytes in block
-#define MAX_CACHE_SIZE 512 // Max blocks in cache (128KB)
+#define DEFAULT_BLOCK_SIZE 4096 // Bytes in block
+#define DEFAULT_CACHE_CAPACITY (512 * DEFAULT_BLOCK_SIZE) // Bytes in cache (2MB)
+#define DEFAULT_SHARD_COUNT 16 // Independently locked cache shards
+#define DEFAULT_READAHEAD_MAX_BLOCKS 32 // Max read-ahead window in blocks
+#define DEFAULT_DIRTY_RATIO 10 // Percent of dirty blocks that triggers background write-back
+#define DEFAULT_DIRTY_EXPIRE_MS 1000 // Age after which a dirty block is written back
+#define DEFAULT_ASYNC_QUEUE_DEPTH 128 // Max disk reads in flight from the async API
+#define DEFAULT_SHARED_CACHE_CAPACITY (16 * DEFAULT_CACHE_CAPACITY) // Bytes in shared memory segment (32MB)
+
+enum Lab2EvictionPolicy {
+    LAB2_POLICY_CLOCK = 0,
+    LAB2_POLICY_2Q,
+    LAB2_POLICY_ARC,
+};
+
+// Где при разделении кэша по узлам NUMA живет блок, а значит, куда ставится прочитанный промах
+enum Lab2NumaPolicy {
+    LAB2_NUMA_INTERLEAVE = 0, // Узел выбирается по хэшу блока: память и попадания поровну на всех узлах
+    LAB2_NUMA_FILE_HOME, // Все блоки файла на узле потока, первым открывшего файл
+};
+
+// Нулевые поля означают значения по умолчанию
+struct Lab2Config {
+    size_t cache_capacity; // Ёмкость кэша в байтах
+    size_t block_size; // Степень двойки, кратная логическому сектору устройства
+    Lab2EvictionPolicy eviction_policy;
+    size_t shard_count; // Число независимо блокируемых сегментов кэша
+    size_t readahead_max_blocks; // Максимальное окно упреждающего чтения в блоках
+    bool readahead_disabled;
+    unsigned int dirty_ratio; // Процент грязных блоков, после которого фоновый поток пишет все
+    unsigned int dirty_expire_ms; // Возраст грязного блока, после которого он пишется в фоне
+    bool writeback_disabled; // Без фонового потока грязные блоки пишутся только при вытеснении и fsync
+    bool huge_pages; // Область буферов на больших страницах (если система их выделит)
+    bool lock_memory; // Закрепить область буферов в памяти (mlock / VirtualLock)
+    // Запросы не меньше порога (с выровненным по блоку смещением) идут мимо кэша прямо на диск;
+    // 0 — не обходить. Грязные блоки кэша при этом остаются источником истины
+    size_t bypass_threshold;
+    unsigned int async_queue_depth; // Сколько чтений асинхронного API может одновременно идти на диск
+    // Байты второго уровня со сжатыми копиями вытесненных чистых блоков; 0 — уровня нет.
+    // Промах, найденный там, распаковывается вместо чтения с диска
+    size_t compressed_capacity;
+    // Имя сегмента разделяемой памяти с общим для процессов уровнем чистых блоков; nullptr — уровня нет.
+    // Процессы с одинаковым именем, размером блока и ёмкостью сегмента делят прочитанные с диска блоки.
+    // Запись на диск через кэш любого из них удаляет устаревшую копию из сегмента, но не из частных
+    // кэшей других процессов
+    const char* shared_cache_name;
+    size_t shared_cache_capacity; // Байты сегмента; 0 — DEFAULT_SHARED_CACHE_CAPACITY
+    // lab2_close не пишет грязные блоки и не сбрасывает файл на устройство: блоки остаются в кэше
+    // и уходят фоновой записью (повторное открытие и запись сливаются с ними), а ОС-дескриптор
+    // закрывается, когда у файла не останется грязных блоков. Без фоновой записи — при lab2_init
+    // или выходе из программы. Долговечность после такого закрытия не гарантируется
+    bool deferred_close;
+    // Разделы кэша по узлам NUMA: у каждого своя область буферов и свои сегменты с индексами, размеченные
+    // на памяти узла. 0 — по числу узлов системы, 1 — без разделения. Блок всегда живет в одном разделе,
+    // который выбирает numa_policy, поэтому поиск не обходит чужие разделы
+    size_t numa_nodes;
+    Lab2NumaPolicy numa_policy;
+};
+
+// Буфер для lab2_readv / lab2_writev
+struct Lab2IoVec {
+    void* base;
+    size_t length;
+};
+
+// Переконфигурация кэша; допустима только когда нет открытых файлов.
+// Остальные lab2_* можно вызывать из нескольких потоков одновременно
+// (один хэндл не должен закрываться, пока им пользуется другой поток)
+int lab2_init(const Lab2Config* config);
+size_t lab2_get_block_size();
+// Удаляет имя сегмента разделяемой памяти (Lab2Config::shared_cache_name): следующий процесс создаст
+// пустой сегмент, уже подключенные работают со старым. 0 — удалено или не существовало
+int lab2_shared_cache_unlink(const char* name);
+
+// Флаг access_mode для lab2_open (только вместе с GENERIC_READ, без GENERIC_WRITE): файл отображается
+// в память, чтения идут из отображения мимо кэша и O_DIRECT. Виден размер файла на момент открытия;
+// попадания/промахи считаются выборочно по резидентности страниц. Закрепление и запись недоступны
+#define LAB2_OPEN_MAPPED 0x08000000u
 
 HANDLE lab2_open(const char* path, DWORD access_mode, DWORD creation_disposition);
 int lab2_close(const HANDLE file_handle);
 SSIZE_T lab2_read(const HANDLE file_handle, void* buf, const size_t count);
 SSIZE_T lab2_write(const HANDLE file_handle, const void* buf, const size_t count);
+// Чтение/запись по явному смещению: позиция дескриптора не читается и не сдвигается,
+// поэтому потоки могут работать с одним хэндлом без общей блокировки
+SSIZE_T lab2_pread(const HANDLE file_handle, void* buf, const size_t count, const LONGLONG offset);
+SSIZE_T lab2_pwrite(const HANDLE file_handle, const void* buf, const size_t count, const LONGLONG offset);
+// Векторные варианты с текущей позиции; короткое чтение останавливает обход векторов
+SSIZE_T lab2_readv(const HANDLE file_handle, const Lab2IoVec* vectors, const int count);
+SSIZE_T lab2_writev(const HANDLE file_handle, const Lab2IoVec* vectors, const int count);
+// Ссылка на данные блока в кэше без копирования; блок закреплен и не вытесняется до lab2_release
+struct Lab2PinnedView {
+    const char* data;
+    size_t length;
+    void* block; // Служебное поле
+};
+
+// Резерв места в блоке для записи на месте; действует до lab2_commit_write
+struct Lab2WriteReservation {
+    char* data;
+    size_t length;
+    void* block; // Служебное поле
+};
+
+// Чтение без копирования: view указывает в кэш и покрывает не больше одного блока (length <= count).
+// Смещение сдвигается на length; 0 — конец файла. Закрепления нужно снять до lab2_close,
+// и их не должно быть больше, чем блоков в кэше, иначе промахи будут ждать освобождения
+SSIZE_T lab2_read_pinned(const HANDLE file_handle, const size_t count, Lab2PinnedView* view);
+int lab2_release(Lab2PinnedView* view);
+// Запись на месте: вызывающий заполняет reservation->data (не больше одного блока), затем
+// lab2_commit_write помечает блок грязным. До фиксации другие читатели могут видеть неполные данные
+SSIZE_T lab2_write_reserve(const HANDLE file_handle, const size_t count, Lab2WriteReservation* reservation);
+int lab2_commit_write(Lab2WriteReservation* reservation);
+// Асинхронный API с явным смещением. Попадания и записи (их поглощает кэш) завершаются сразу,
+// промахи читаются через io_uring, одновременные промахи по одному блоку ждут одного чтения.
+// Завершения забираются из очереди вызывающего; буфер нельзя трогать до завершения своего
+// запроса, а хэндл — закрывать, пока по нему есть незавершенные запросы
+struct Lab2AsyncQueue;
+
+struct Lab2AsyncCompletion {
+    void* user_data;
+    SSIZE_T result; // Как у lab2_pread / lab2_pwrite
+};
+
+Lab2AsyncQueue* lab2_async_queue_create();
+// Дожидается всех запросов очереди; незабранные завершения теряются
+void lab2_async_queue_destroy(Lab2AsyncQueue* queue);
+int lab2_read_async(Lab2AsyncQueue* queue, const HANDLE file_handle, void* buf, const size_t count,
+                    const LONGLONG offset, void* user_data);
+int lab2_write_async(Lab2AsyncQueue* queue, const HANDLE file_handle, const void* buf, const size_t count,
+                     const LONGLONG offset, void* user_data);
+// Готовые завершения: poll не ждет, wait ждет хотя бы min_completions (или все незавершенные, если их меньше)
+int lab2_async_poll(Lab2AsyncQueue* queue, Lab2AsyncCompletion* completions, const int max);
+int lab2_async_wait(Lab2AsyncQueue* queue, Lab2AsyncCompletion* completions, const int min_completions, const int max);
 LONGLONG lab2_lseek(const HANDLE file_handle, const LONGLONG offset, const int whence);
+// Одновременные вызовы для одного файла фиксируются группой: пришедшие во время чужой фиксации
+// ждут ее конца, и затем их общие грязные блоки пишутся одним проходом и одним сбросом на устройство
 int lab2_fsync(const HANDLE file_handle);
+// Как lab2_fsync, но без метаданных файла (fdatasync; на Windows — полный сброс)
+int lab2_fdatasync(const HANDLE file_handle);
+
+// Счетчики кэша. Каждый поток пишет свои без атомарных операций, снимок складывает их
+enum Lab2Counter {
+    LAB2_STAT_HITS = 0,
+    LAB2_STAT_MISSES,
+    LAB2_STAT_COALESCED_MISSES, // Промахи, дождавшиеся уже идущего чтения того же блока
+    LAB2_STAT_EVICTIONS,
+    LAB2_STAT_DIRTY_EVICTIONS, // Вытеснения, которые сами писали грязный блок на диск
+    LAB2_STAT_EVICTION_SCAN_STEPS, // Кандидаты, просмотренные политикой (шаги стрелки clock)
+    LAB2_STAT_WRITEBACK_BLOCKS, // Грязные блоки, записанные фоновым потоком, вытеснением или fsync
+    LAB2_STAT_DISK_READS,
+    LAB2_STAT_DISK_READ_BYTES,
+    LAB2_STAT_DISK_WRITES,
+    LAB2_STAT_DISK_WRITE_BYTES,
+    LAB2_STAT_READAHEAD_BLOCKS, // Блоки, прочитанные упреждением
+    LAB2_STAT_READAHEAD_HITS,
+    LAB2_STAT_READAHEAD_WASTED,
+    LAB2_STAT_FSYNC_WRITES, // Вызовы записи из lab2_fsync
+    LAB2_STAT_FSYNC_WRITE_BYTES,
+    LAB2_STAT_WARMUP_BLOCKS, // Блоки, прочитанные загрузкой сохраненного состояния (lab2_load_cache_state)
+    LAB2_STAT_COMPRESSED_HITS, // Промахи, закрытые распаковкой из сжатого уровня без чтения диска
+    LAB2_STAT_COMPRESSED_STORES, // Вытесненные блоки, сохраненные в сжатом уровне
+    LAB2_STAT_COMPRESSED_REJECTS, // Вытесненные блоки, которые сжались хуже 7/8 и не сохранены
+    LAB2_STAT_COMPRESSED_INPUT_BYTES, // Байты сохраненных блоков до сжатия и после: их отношение — степень сжатия
+    LAB2_STAT_COMPRESSED_OUTPUT_BYTES,
+    LAB2_STAT_SHARED_HITS, // Промахи, закрытые копией из сегмента разделяемой памяти без чтения диска
+    LAB2_STAT_SHARED_INSERTS, // Прочитанные с диска блоки, опубликованные в сегменте для других процессов
+    LAB2_STAT_SYNC_CALLS, // Фиксации файла: lab2_fsync, lab2_fdatasync и закрытия, которые пишут файл
+    LAB2_STAT_SYNC_FLUSHES, // Сбросы на устройство: каждый фиксирует группу одновременных вызовов
+    LAB2_STAT_NUMA_LOCAL_HITS, // Попадания в раздел узла NUMA, на котором выполнялся поток (при numa_nodes > 1)
+    LAB2_STAT_NUMA_REMOTE_HITS, // Попадания в раздел чужого узла: копирование идет через межпроцессорную шину
+    LAB2_STAT_COUNT
+};
+
+// Гистограммы задержек: вызовы чтения/записи без промахов, с промахом (или чтением диска), запись грязных блоков
+// и распаковка из сжатого уровня
+enum Lab2LatencyKind {
+    LAB2_LATENCY_HIT = 0,
+    LAB2_LATENCY_MISS,
+    LAB2_LATENCY_FLUSH,
+    LAB2_LATENCY_DECOMPRESS, // Распаковка блока из сжатого уровня
+    LAB2_LATENCY_COUNT
+};
+
+// Корзины в наносекундах: 0..7 точно, дальше по 8 на каждую степень двойки до 2^40 (ошибка до 12.5%)
+#define LAB2_HISTOGRAM_BUCKETS 304
+
+struct Lab2Histogram {
+    unsigned long long count;
+    unsigned long long total_ns;
+    unsigned long long buckets[LAB2_HISTOGRAM_BUCKETS];
+};
+
+struct Lab2Stats {
+    unsigned long long counters[LAB2_STAT_COUNT];
+    Lab2Histogram latency[LAB2_LATENCY_COUNT];
+};
+
+// Итог с запуска программы. lab2_reset_cache_counters сбрасывает только счетчики lab2_get_* ниже,
+// поэтому значения снимка монотонны и годятся для периодического экспорта
+int lab2_get_stats(Lab2Stats* stats);
+// Счетчики открытого файла: работа вызовов через его хэндлы, включая вытеснения, которые они вызвали.
+// Фоновые потоки (упреждение, запись, io_uring) учитываются только в общих счетчиках
+int lab2_get_file_stats(const HANDLE file_handle, unsigned long long counters[LAB2_STAT_COUNT]);
+const char* lab2_counter_name(const Lab2Counter counter);
+const char* lab2_latency_name(const Lab2LatencyKind kind);
+// Верхняя граница корзины, в которую попадает доля fraction замеров; 0 у пустой гистограммы
+unsigned long long lab2_histogram_percentile(const Lab2Histogram* histogram, const double fraction);
+
+// Запись трассы вызовов lab2_open/close/read/pread/write/pwrite/lseek/fsync в текстовый файл
+// (формат — в src/trace.hpp); cache_benchmark_trace ее воспроизводит. Вызовы через хэндлы,
+// открытые до начала записи, не пишутся. Трасса закрывается lab2_trace_stop или при выходе
+int lab2_trace_start(const char* path);
+int lab2_trace_stop();
+
+// Теплый старт: сохранение набора блоков кэша (ключи и признак горячего блока, без данных) и
+// загрузка его после перезапуска. Загрузка сверяет файлы по file_id, размеру и времени изменения,
+// пропускает изменившиеся и читает блоки в фоне отсортированными сериями, горячие первыми.
+// Путь файла сохраняется в том виде, в котором его передали lab2_open
+int lab2_save_cache_state(const char* path);
+int lab2_load_cache_state(const char* path);
 
 unsigned long lab2_get_cache_hits();
 unsigned long lab2_get_cache_misses();
+unsigned long lab2_get_readahead_hits();
+unsigned long lab2_get_readahead_wasted();
+// Чтения с диска, выданные кэшем: пачки подряд идущих промахов, окна упреждения, дочитывание
+// частичных блоков, чтения в обход кэша
+unsigned long lab2_get_disk_reads();
+// Объем и число вызовов записи, выданных lab2_fsync (подряд идущие блоки пишутся одним вызовом)
+unsigned long lab2_get_fsync_write_bytes();
+unsigned long lab2_get_fsync_write_ios();
+// Промахи, которые не читали диск, а дождались уже идущего чтения того же блока
+unsigned long lab2_get_coalesced_misses();
 void lab2_reset_cache_counters();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,408 @@
+#include "compression.hpp"
+#include <algorithm>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 65535;
+// Последние байты входа всегда идут литералами: совпадение не ищется ближе MATCH_LIMIT к концу
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_LIMIT = 12;
+constexpr int HASH_BITS = 12;
+// Пропуск ускоряется на несжимаемых данных: каждые 2^SKIP_SHIFT байт без совпадения — шаг больше на 1
+constexpr int SKIP_SHIFT = 6;
+constexpr size_t COPY_CHUNK = 16;
+
+inline uint32_t read32(const unsigned char* source) {
+    uint32_t value;
+    std::memcpy(&value, source, sizeof(value));
+    return value;
+}
+
+inline uint64_t read64(const unsigned char* source) {
+    uint64_t value;
+    std::memcpy(&value, source, sizeof(value));
+    return value;
+}
+
+// Номер младшего взведенного бита; word != 0
+inline size_t lowest_set_bit(const uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long position;
+    _BitScanForward64(&position, word);
+    return position;
+#else
+    return static_cast<size_t>(__builtin_ctzll(word));
+#endif
+}
+
+inline uint32_t hash_sequence(const uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Копирование кусками по COPY_CHUNK байт без вызова memcpy переменной длины: может прочитать и записать
+// до COPY_CHUNK - 1 байт сверх length, запас на обоих концах проверяет вызывающий
+inline void wild_copy(unsigned char* destination, const unsigned char* source, const size_t length) {
+    unsigned char* const end = destination + length;
+    do {
+        std::memcpy(destination, source, COPY_CHUNK);
+        destination += COPY_CHUNK;
+        source += COPY_CHUNK;
+    } while (destination < end);
+}
+
+// Длина сверх 15 кодируется байтами 255 и остатком
+inline bool put_length(unsigned char*& output, const unsigned char* output_end, size_t length) {
+    while (length >= 255) {
+        if (output == output_end) {
+            return false;
+        }
+        *output++ = 255;
+        length -= 255;
+    }
+    if (output == output_end) {
+        return false;
+    }
+    *output++ = static_cast<unsigned char>(length);
+    return true;
+}
+
+inline bool get_length(const unsigned char*& input, const unsigned char* input_end, size_t& length) {
+    unsigned char byte;
+    do {
+        if (input == input_end) {
+            return false;
+        }
+        byte = *input++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Последовательность: литералы [literals, literals + literal_length) и совпадение длиной match_length
+// (0 — последняя последовательность без совпадения)
+bool put_sequence(unsigned char*& output, const unsigned char* output_end, const unsigned char* literals,
+                  const unsigned char* input_end, const size_t literal_length, const size_t offset,
+                  const size_t match_length) {
+    if (output == output_end) {
+        return false;
+    }
+    unsigned char& token = *output++;
+    token = static_cast<unsigned char>(std::min<size_t>(literal_length, 15) << 4);
+    if (literal_length >= 15 && !put_length(output, output_end, literal_length - 15)) {
+        return false;
+    }
+    const size_t output_room = static_cast<size_t>(output_end - output);
+    if (output_room < literal_length) {
+        return false;
+    }
+    if (output_room >= literal_length + COPY_CHUNK && static_cast<size_t>(input_end - literals) >= literal_length + COPY_CHUNK) {
+        wild_copy(output, literals, literal_length);
+    } else {
+        std::memcpy(output, literals, literal_length);
+    }
+    output += literal_length;
+    if (match_length == 0) {
+        return true;
+    }
+
+    if (output_end - output < 2) {
+        return false;
+    }
+    *output++ = static_cast<unsigned char>(offset);
+    *output++ = static_cast<unsigned char>(offset >> 8);
+    const size_t extra = match_length - MIN_MATCH;
+    token |= static_cast<unsigned char>(std::min<size_t>(extra, 15));
+    return extra < 15 || put_length(output, output_end, extra - 15);
+}
+
+} // namespace
+
+size_t lz_compress(const char* source, const size_t size, char* destination, const size_t capacity) {
+    // Таблицу не обнуляем между вызовами: кандидат все равно сверяется по байтам,
+    // а устаревшая позиция в худшем случае просто не даст совпадения
+    thread_local uint32_t table[1u << HASH_BITS] = {};
+
+    const unsigned char* input = reinterpret_cast<const unsigned char*>(source);
+    const unsigned char* input_end = input + size;
+    unsigned char* output = reinterpret_cast<unsigned char*>(destination);
+    const unsigned char* output_end = output + capacity;
+
+    size_t anchor = 0;
+    size_t position = 0;
+    const size_t limit = size > MATCH_LIMIT ? size - MATCH_LIMIT : 0;
+    while (position < limit) {
+        const uint32_t sequence = read32(input + position);
+        uint32_t& slot = table[hash_sequence(sequence)];
+        const size_t candidate = slot;
+        slot = static_cast<uint32_t>(position);
+        if (candidate >= position || position - candidate > MAX_OFFSET || read32(input + candidate) != sequence) {
+            position += 1 + ((position - anchor) >> SKIP_SHIFT);
+            continue;
+        }
+
+        const size_t match_end = size - LAST_LITERALS;
+        size_t match_length = MIN_MATCH;
+        // Сравнение по 8 байт: первый отличающийся байт — младший взведенный бит разности (little-endian)
+        while (position + match_length + sizeof(uint64_t) <= match_end) {
+            const uint64_t difference = read64(input + candidate + match_length) ^ read64(input + position + match_length);
+            if (difference != 0) {
+                match_length += lowest_set_bit(difference) / 8;
+                break;
+            }
+            match_length += sizeof(uint64_t);
+        }
+        if (position + match_length + sizeof(uint64_t) > match_end) {
+            while (position + match_length < match_end &&
+                   input[candidate + match_length] == input[position + match_length]) {
+                ++match_length;
+            }
+        }
+        if (!put_sequence(output, output_end, input + anchor, input_end, position - anchor, position - candidate,
+                          match_length)) {
+            return 0;
+        }
+        position += match_length;
+        anchor = position;
+    }
+
+    if (!put_sequence(output, output_end, input + anchor, input_end, size - anchor, 0, 0)) {
+        return 0;
+    }
+    return static_cast<size_t>(output - reinterpret_cast<unsigned char*>(destination));
+}
+
+bool lz_decompress(const char* source, const size_t compressed_size, char* destination, const size_t size) {
+    const unsigned char* input = reinterpret_cast<const unsigned char*>(source);
+    const unsigned char* input_end = input + compressed_size;
+    unsigned char* output = reinterpret_cast<unsigned char*>(destination);
+    unsigned char* output_begin = output;
+    unsigned char* output_end = output + size;
+
+    while (input < input_end) {
+        const unsigned char token = *input++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !get_length(input, input_end, literal_length)) {
+            return false;
+        }
+        if (static_cast<size_t>(input_end - input) < literal_length ||
+            static_cast<size_t>(output_end - output) < literal_length) {
+            return false;
+        }
+        if (static_cast<size_t>(input_end - input) >= literal_length + COPY_CHUNK &&
+            static_cast<size_t>(output_end - output) >= literal_length + COPY_CHUNK) {
+            wild_copy(output, input, literal_length);
+        } else {
+            std::memcpy(output, input, literal_length);
+        }
+        input += literal_length;
+        output += literal_length;
+        if (input == input_end) {
+            break;
+        }
+
+        if (input_end - input < 2) {
+            return false;
+        }
+        const size_t offset = input[0] | (static_cast<size_t>(input[1]) << 8);
+        input += 2;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !get_length(input, input_end, match_length)) {
+            return false;
+        }
+        match_length += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(output - output_begin) ||
+            static_cast<size_t>(output_end - output) < match_length) {
+            return false;
+        }
+        const unsigned char* match = output - offset;
+        if (offset >= COPY_CHUNK && static_cast<size_t>(output_end - output) >= match_length + COPY_CHUNK) {
+            // Каждый кусок читает уже записанные байты: источник отстает не меньше чем на кусок
+            wild_copy(output, match, match_length);
+            output += match_length;
+        } else if (offset >= sizeof(uint64_t) && static_cast<size_t>(output_end - output) >= match_length + sizeof(uint64_t)) {
+            for (size_t i = 0; i < match_length; i += sizeof(uint64_t)) {
+                std::memcpy(output + i, match + i, sizeof(uint64_t));
+            }
+            output += match_length;
+        } else if (offset >= match_length) {
+            std::memcpy(output, match, match_length);
+            output += match_length;
+        } else {
+            // Перекрытие: совпадение повторяет последние offset байт. Расстояние, кратное периоду, дает тот же
+            // результат, поэтому после каждого куска его можно удвоить — кусков всего log2(match_length / offset)
+            size_t distance = offset;
+            size_t remaining = match_length;
+            while (remaining > 0) {
+                const size_t chunk = std::min(distance, remaining);
+                std::memcpy(output, output - distance, chunk);
+                output += chunk;
+                remaining -= chunk;
+                distance += chunk;
+            }
+        }
+    }
+    return output == output_end;
+}
+
+namespace {
+
+// Минимальный средний размер сжатой копии, на который рассчитано кольцо записей
+constexpr size_t MIN_ENTRY_BYTES = 32;
+
+size_t tier_hash(const LONGLONG file_id, const LONGLONG block_id) {
+    uint64_t x = static_cast<uint64_t>(file_id) * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(block_id);
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return static_cast<size_t>(x);
+}
+
+} // namespace
+
+CompressedTier::CompressedTier(const size_t capacity, const size_t block_size)
+    : block_size(block_size), buffer(capacity), scratch(block_size * 7 / 8),
+      entries(std::max<size_t>(capacity / MIN_ENTRY_BYTES, 1)) {
+    size_t index_size = 1;
+    while (index_size < entries.size() * 2) {
+        index_size <<= 1;
+    }
+    index.assign(index_size, NO_ENTRY);
+    index_mask = index_size - 1;
+}
+
+size_t CompressedTier::entry_end(const Entry& entry) const {
+    return entry.offset + entry.length;
+}
+
+uint32_t CompressedTier::find(const LONGLONG file_id, const LONGLONG block_id) const {
+    size_t position = tier_hash(file_id, block_id) & index_mask;
+    while (index[position] != NO_ENTRY) {
+        const Entry& entry = entries[index[position]];
+        if (entry.file_id == file_id && entry.block_id == block_id) {
+            return index[position];
+        }
+        position = (position + 1) & index_mask;
+    }
+    return NO_ENTRY;
+}
+
+// Удаление из индекса со сдвигом назад, как в индексе слотов сегмента
+void CompressedTier::unindex(const uint32_t entry) {
+    size_t position = tier_hash(entries[entry].file_id, entries[entry].block_id) & index_mask;
+    while (index[position] != entry) {
+        position = (position + 1) & index_mask;
+    }
+
+    size_t next = position;
+    while (true) {
+        next = (next + 1) & index_mask;
+        if (index[next] == NO_ENTRY) {
+            break;
+        }
+        const Entry& moved = entries[index[next]];
+        const size_t home = tier_hash(moved.file_id, moved.block_id) & index_mask;
+        if (((next - home) & index_mask) >= ((next - position) & index_mask)) {
+            index[position] = index[next];
+            position = next;
+        }
+    }
+    index[position] = NO_ENTRY;
+}
+
+void CompressedTier::kill(const uint32_t entry) {
+    unindex(entry);
+    entries[entry].live = false;
+}
+
+void CompressedTier::drop_oldest() {
+    if (entries[first].live) {
+        kill(static_cast<uint32_t>(first));
+    }
+    first = (first + 1) % entries.size();
+    --count;
+}
+
+// Непрерывный участок length байт после самой новой записи; старые записи вытесняются, пока он не освободится
+bool CompressedTier::reserve(const size_t length, size_t& offset) {
+    if (length > buffer.size()) {
+        return false;
+    }
+    while (count > 0) {
+        if (count < entries.size()) {
+            const size_t head = entry_end(entries[(first + count - 1) % entries.size()]);
+            const size_t oldest = entries[first].offset;
+            if (head > oldest) {
+                // Занято [oldest, head): свободны хвост буфера и его начало до oldest
+                if (buffer.size() - head >= length) {
+                    offset = head;
+                    return true;
+                }
+                if (oldest >= length) {
+                    offset = 0;
+                    return true;
+                }
+            } else if (oldest - head >= length) {
+                offset = head;
+                return true;
+            }
+        }
+        drop_oldest();
+    }
+    offset = 0;
+    return true;
+}
+
+bool CompressedTier::store(const LONGLONG file_id, const LONGLONG block_id, const char* data,
+                           size_t& compressed_size) {
+    erase(file_id, block_id);
+    compressed_size = lz_compress(data, block_size, scratch.data(), scratch.size());
+    size_t offset;
+    if (compressed_size == 0 || !reserve(compressed_size, offset)) {
+        return false;
+    }
+    std::memcpy(buffer.data() + offset, scratch.data(), compressed_size);
+
+    const uint32_t entry = static_cast<uint32_t>((first + count) % entries.size());
+    ++count;
+    entries[entry] = Entry{file_id, block_id, offset, static_cast<uint32_t>(compressed_size), true};
+    size_t position = tier_hash(file_id, block_id) & index_mask;
+    while (index[position] != NO_ENTRY) {
+        position = (position + 1) & index_mask;
+    }
+    index[position] = entry;
+    return true;
+}
+
+bool CompressedTier::take(const LONGLONG file_id, const LONGLONG block_id, char* data) {
+    const uint32_t entry = find(file_id, block_id);
+    if (entry == NO_ENTRY) {
+        return false;
+    }
+    const Entry& found = entries[entry];
+    const bool unpacked = lz_decompress(buffer.data() + found.offset, found.length, data, block_size);
+    kill(entry);
+    return unpacked;
+}
+
+void CompressedTier::erase(const LONGLONG file_id, const LONGLONG block_id) {
+    const uint32_t entry = find(file_id, block_id);
+    if (entry != NO_ENTRY) {
+        kill(entry);
+    }
+}
+
+void CompressedTier::erase_file(const LONGLONG file_id) {
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t entry = static_cast<uint32_t>((first + i) % entries.size());
+        if (entries[entry].live && entries[entry].file_id == file_id) {
+            kill(entry);
+        }
+    }
+}
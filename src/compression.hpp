@@ -0,0 +1,61 @@
+#ifndef LAB2_COMPRESSION_H
+#define LAB2_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "cache.hpp"
+
+// Быстрый LZ77-кодек в формате последовательностей LZ4: токен (длина литералов и совпадения по 4 бита,
+// 15 — продолжение байтами до не-255), литералы, смещение 2 байта, хвост длины совпадения.
+// Сжатие — один проход с хэш-таблицей на 4-байтовые последовательности, без поиска лучшего совпадения.
+// 0 — результат не поместился в capacity
+size_t lz_compress(const char* source, size_t size, char* destination, size_t capacity);
+// false — данные повреждены или распаковываются не ровно в size байт
+bool lz_decompress(const char* source, size_t compressed_size, char* destination, size_t size);
+
+// Второй уровень кэша сегмента: сжатые копии вытесненных чистых блоков в кольцевом буфере
+// фиксированного размера. Место освобождается в порядке записи (FIFO): новая копия вытесняет
+// самые старые. Копия эксклюзивна — забирается обратно в кэш при промахе и удаляется при любой
+// установке блока в кэш. Вызовы идут под блокировкой сегмента; память выделяется один раз
+class CompressedTier {
+public:
+    CompressedTier(size_t capacity, size_t block_size);
+
+    // false — блок плохо сжимается (сжатая копия больше 7/8 блока) и не сохранен;
+    // compressed_size — размер сжатой копии (0, если сжать не удалось)
+    bool store(LONGLONG file_id, LONGLONG block_id, const char* data, size_t& compressed_size);
+    // Распаковывает копию блока в data и удаляет ее; false — копии нет
+    bool take(LONGLONG file_id, LONGLONG block_id, char* data);
+    void erase(LONGLONG file_id, LONGLONG block_id);
+    void erase_file(LONGLONG file_id);
+
+private:
+    struct Entry {
+        LONGLONG file_id;
+        LONGLONG block_id;
+        size_t offset; // Начало сжатых данных в buffer
+        uint32_t length;
+        bool live; // false — копию забрали или удалили, место вернется, когда до него дойдет очередь
+    };
+
+    static constexpr uint32_t NO_ENTRY = UINT32_MAX;
+
+    size_t entry_end(const Entry& entry) const;
+    uint32_t find(LONGLONG file_id, LONGLONG block_id) const;
+    void unindex(uint32_t entry);
+    void kill(uint32_t entry);
+    void drop_oldest();
+    bool reserve(size_t length, size_t& offset);
+
+    const size_t block_size;
+    std::vector<char> buffer;
+    std::vector<char> scratch; // Сжатие идет сюда: размер результата заранее неизвестен
+    std::vector<Entry> entries; // Кольцо записей в порядке добавления
+    size_t first = 0; // Самая старая запись
+    size_t count = 0;
+    std::vector<uint32_t> index; // Открытая адресация: (file_id, block_id) -> номер записи
+    size_t index_mask = 0;
+};
+
+#endif
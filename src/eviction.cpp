@@ -0,0 +1,409 @@
+#include "eviction.hpp"
+#include <algorithm>
+#include <array>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+constexpr uint32_t NIL = UINT32_MAX;
+constexpr int32_t NO_CANDIDATE = -1;
+
+// Номер младшего взведенного бита; word != 0
+inline size_t lowest_set_bit(const uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long position;
+    _BitScanForward64(&position, word);
+    return position;
+#else
+    return static_cast<size_t>(__builtin_ctzll(word));
+#endif
+}
+
+// Clock: один бит обращения на слот, стрелка дает блоку второй шанс. Биты обращения и занятости
+// упакованы по 64 слота в слово: стрелка проходит слово за раз — кандидат находится через ctz по
+// маске "занят и без обращения", а биты обращения пройденных слотов снимаются одной операцией
+class ClockPolicy : public EvictionPolicy {
+public:
+    explicit ClockPolicy(const size_t capacity)
+        : capacity(capacity), referenced((capacity + 63) / 64, 0), resident((capacity + 63) / 64, 0) {}
+
+    void on_insert(const uint32_t slot, uint64_t, const bool prefetched) override {
+        resident[slot / 64] |= bit(slot);
+        if (prefetched) { // Упрежденный блок без обращения вытесняется первым
+            referenced[slot / 64] &= ~bit(slot);
+        } else {
+            referenced[slot / 64] |= bit(slot);
+        }
+    }
+
+    void on_hit(const uint32_t slot, bool) override {
+        referenced[slot / 64] |= bit(slot);
+    }
+
+    void on_evict(const uint32_t slot) override {
+        resident[slot / 64] &= ~bit(slot);
+        referenced[slot / 64] &= ~bit(slot);
+    }
+
+    void begin_scan() override {
+        steps = 0;
+    }
+
+    int32_t next_candidate() override {
+        // Два оборота: за первый снимаются биты обращения, за второй находится жертва
+        while (steps < 2 * capacity) {
+            const size_t word = hand / 64;
+            // Слоты от стрелки до конца слова (или до конца кольца, или до исчерпания двух оборотов)
+            const size_t span = std::min({ 64 - hand % 64, capacity - hand, 2 * capacity - steps });
+            const uint64_t window = (span == 64 ? ~0ull : (1ull << span) - 1) << (hand % 64);
+            const uint64_t candidates = resident[word] & ~referenced[word] & window;
+            if (candidates != 0) {
+                const size_t slot = word * 64 + lowest_set_bit(candidates);
+                referenced[word] &= ~(window & (bit(slot) - 1)); // Сброс флагов доступа пройденных слотов
+                steps += slot - hand + 1;
+                hand = slot + 1 == capacity ? 0 : slot + 1; // Перемещение стрелки
+                return static_cast<int32_t>(slot);
+            }
+            referenced[word] &= ~window;
+            steps += span;
+            hand = hand + span == capacity ? 0 : hand + span;
+        }
+        return NO_CANDIDATE;
+    }
+
+    bool is_hot(const uint32_t slot) const override {
+        return (referenced[slot / 64] & bit(slot)) != 0;
+    }
+
+private:
+    static uint64_t bit(const size_t slot) {
+        return 1ull << (slot % 64);
+    }
+
+    const size_t capacity;
+    std::vector<uint64_t> referenced;
+    std::vector<uint64_t> resident;
+    size_t hand = 0;
+    size_t steps = 0;
+};
+
+// Несколько двусвязных списков над общими массивами связей: слот состоит не больше чем в одном.
+// Голова — самый недавний (MRU), хвост — самый давний (LRU)
+class SlotLists {
+public:
+    static constexpr uint8_t NO_LIST = UINT8_MAX;
+
+    SlotLists(const size_t capacity, const size_t list_count)
+        : prev(capacity, NIL), next(capacity, NIL), owner(capacity, NO_LIST), lists(list_count) {}
+
+    void push_mru(const uint8_t list, const uint32_t slot) {
+        List& target = lists[list];
+        owner[slot] = list;
+        prev[slot] = NIL;
+        next[slot] = target.head;
+        if (target.head != NIL) {
+            prev[target.head] = slot;
+        } else {
+            target.tail = slot;
+        }
+        target.head = slot;
+        target.size++;
+    }
+
+    void unlink(const uint32_t slot) {
+        List& source = lists[owner[slot]];
+        if (prev[slot] != NIL) {
+            next[prev[slot]] = next[slot];
+        } else {
+            source.head = next[slot];
+        }
+        if (next[slot] != NIL) {
+            prev[next[slot]] = prev[slot];
+        } else {
+            source.tail = prev[slot];
+        }
+        source.size--;
+        owner[slot] = NO_LIST;
+    }
+
+    void move_to_mru(const uint8_t list, const uint32_t slot) {
+        unlink(slot);
+        push_mru(list, slot);
+    }
+
+    uint8_t list_of(const uint32_t slot) const { return owner[slot]; }
+    size_t size(const uint8_t list) const { return lists[list].size; }
+    uint32_t lru(const uint8_t list) const { return lists[list].tail; }
+    uint32_t toward_mru(const uint32_t slot) const { return prev[slot]; }
+
+private:
+    struct List {
+        uint32_t head = NIL;
+        uint32_t tail = NIL;
+        size_t size = 0;
+    };
+
+    std::vector<uint32_t> prev;
+    std::vector<uint32_t> next;
+    std::vector<uint8_t> owner;
+    std::vector<List> lists;
+};
+
+// Список "призраков": отпечатки недавно вытесненных блоков без данных. Фиксированный пул узлов
+// и индекс с открытой адресацией, как у индекса сегмента
+class GhostList {
+public:
+    explicit GhostList(const size_t capacity) : nodes(std::max<size_t>(capacity, 1)) {
+        free_nodes.reserve(nodes.size());
+        for (size_t node = nodes.size(); node > 0; --node) {
+            free_nodes.push_back(static_cast<uint32_t>(node - 1));
+        }
+        size_t index_size = 1;
+        while (index_size < nodes.size() * 2) {
+            index_size <<= 1;
+        }
+        index.assign(index_size, NIL);
+        mask = index_size - 1;
+    }
+
+    size_t size() const { return count; }
+
+    // true, если отпечаток был в списке
+    bool erase(const uint64_t fingerprint) {
+        size_t position = fingerprint & mask;
+        while (index[position] != NIL) {
+            if (nodes[index[position]].fingerprint == fingerprint) {
+                const uint32_t node = index[position];
+                erase_index(position);
+                unlink(node);
+                return true;
+            }
+            position = (position + 1) & mask;
+        }
+        return false;
+    }
+
+    void push_mru(const uint64_t fingerprint) {
+        if (free_nodes.empty()) {
+            pop_lru();
+        }
+        const uint32_t node = free_nodes.back();
+        free_nodes.pop_back();
+        nodes[node] = { fingerprint, NIL, head };
+        if (head != NIL) {
+            nodes[head].prev = node;
+        } else {
+            tail = node;
+        }
+        head = node;
+        count++;
+
+        size_t position = fingerprint & mask;
+        while (index[position] != NIL) {
+            position = (position + 1) & mask;
+        }
+        index[position] = node;
+    }
+
+    void pop_lru() {
+        if (tail != NIL) {
+            erase(nodes[tail].fingerprint);
+        }
+    }
+
+private:
+    struct Node {
+        uint64_t fingerprint;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    void unlink(const uint32_t node) {
+        if (nodes[node].prev != NIL) {
+            nodes[nodes[node].prev].next = nodes[node].next;
+        } else {
+            head = nodes[node].next;
+        }
+        if (nodes[node].next != NIL) {
+            nodes[nodes[node].next].prev = nodes[node].prev;
+        } else {
+            tail = nodes[node].prev;
+        }
+        free_nodes.push_back(node);
+        count--;
+    }
+
+    // Удаление с обратным сдвигом, без надгробий
+    void erase_index(size_t position) {
+        size_t next = position;
+        while (true) {
+            next = (next + 1) & mask;
+            if (index[next] == NIL) {
+                break;
+            }
+            const size_t home = nodes[index[next]].fingerprint & mask;
+            if (((next - home) & mask) >= ((next - position) & mask)) {
+                index[position] = index[next];
+                position = next;
+            }
+        }
+        index[position] = NIL;
+    }
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> free_nodes;
+    std::vector<uint32_t> index;
+    size_t mask = 0;
+    uint32_t head = NIL;
+    uint32_t tail = NIL;
+    size_t count = 0;
+};
+
+// Основа политик на двух резидентных списках: обход идет от LRU-конца одного списка, затем другого
+class TwoListPolicy : public EvictionPolicy {
+public:
+    int32_t next_candidate() override {
+        while (true) {
+            if (cursor != NIL) {
+                const uint32_t slot = cursor;
+                cursor = lists.toward_mru(cursor);
+                return static_cast<int32_t>(slot);
+            }
+            if (++scan_position >= scan_order.size()) {
+                return NO_CANDIDATE;
+            }
+            cursor = lists.lru(scan_order[scan_position]);
+        }
+    }
+
+    // Второй список у обеих политик — частые блоки
+    bool is_hot(const uint32_t slot) const override {
+        return lists.list_of(slot) == 1;
+    }
+
+protected:
+    explicit TwoListPolicy(const size_t capacity) : lists(capacity, 2), fingerprints(capacity, 0) {}
+
+    void scan_from(const uint8_t first) {
+        scan_order = { first, static_cast<uint8_t>(1 - first) };
+        scan_position = 0;
+        cursor = lists.lru(first);
+    }
+
+    SlotLists lists;
+    std::vector<uint64_t> fingerprints;
+
+private:
+    std::array<uint8_t, 2> scan_order = { 0, 1 };
+    size_t scan_position = 0;
+    uint32_t cursor = NIL;
+};
+
+// 2Q (Johnson, Shasha): новые блоки попадают в FIFO A1in и переходят в LRU Am, только если
+// их снова запросили вскоре после вытеснения (отпечаток еще в A1out). Однократный проход
+// по файлу проходит через A1in и не вымывает Am
+class TwoQueuePolicy : public TwoListPolicy {
+public:
+    explicit TwoQueuePolicy(const size_t capacity)
+        : TwoListPolicy(capacity), in_limit(std::max<size_t>(capacity / 4, 1)), a1_out(std::max<size_t>(capacity / 2, 1)) {}
+
+    void on_insert(const uint32_t slot, const uint64_t fingerprint, bool) override {
+        fingerprints[slot] = fingerprint;
+        lists.push_mru(a1_out.erase(fingerprint) ? AM : A1_IN, slot);
+    }
+
+    void on_hit(const uint32_t slot, bool) override {
+        // Повторное обращение внутри A1in считается коррелированным и блок не продвигает
+        if (lists.list_of(slot) == AM) {
+            lists.move_to_mru(AM, slot);
+        }
+    }
+
+    void on_evict(const uint32_t slot) override {
+        if (lists.list_of(slot) == A1_IN) {
+            a1_out.push_mru(fingerprints[slot]);
+        }
+        lists.unlink(slot);
+    }
+
+    void begin_scan() override {
+        scan_from(lists.size(A1_IN) > in_limit || lists.size(AM) == 0 ? A1_IN : AM);
+    }
+
+private:
+    static constexpr uint8_t A1_IN = 0;
+    static constexpr uint8_t AM = 1;
+
+    size_t in_limit; // Kin: целевой размер A1in
+    GhostList a1_out;
+};
+
+// ARC (Megiddo, Modha): T1 — блоки, запрошенные один раз, T2 — повторно; B1/B2 — их призраки.
+// Попадание в призрака сдвигает целевой размер T1, так что баланс recency/frequency подстраивается
+class ArcPolicy : public TwoListPolicy {
+public:
+    explicit ArcPolicy(const size_t capacity)
+        : TwoListPolicy(capacity), capacity(capacity), b1(capacity), b2(capacity) {}
+
+    void on_insert(const uint32_t slot, const uint64_t fingerprint, bool) override {
+        fingerprints[slot] = fingerprint;
+        if (b1.erase(fingerprint)) {
+            const size_t delta = std::max<size_t>(b2.size() / std::max<size_t>(b1.size(), 1), 1);
+            target_t1 = std::min(capacity, target_t1 + delta);
+            lists.push_mru(T2, slot);
+        } else if (b2.erase(fingerprint)) {
+            const size_t delta = std::max<size_t>(b1.size() / std::max<size_t>(b2.size(), 1), 1);
+            target_t1 = target_t1 > delta ? target_t1 - delta : 0;
+            lists.push_mru(T2, slot);
+        } else {
+            lists.push_mru(T1, slot);
+            // L1 = T1 + B1 не больше емкости, весь каталог — не больше двух емкостей
+            if (lists.size(T1) + b1.size() > capacity && b1.size() > 0) {
+                b1.pop_lru();
+            }
+            if (lists.size(T1) + lists.size(T2) + b1.size() + b2.size() > 2 * capacity) {
+                b2.pop_lru();
+            }
+        }
+    }
+
+    void on_hit(const uint32_t slot, const bool prefetched) override {
+        // Первое чтение упрежденного блока — это первое обращение к нему, а не повторное
+        lists.move_to_mru(prefetched ? lists.list_of(slot) : T2, slot);
+    }
+
+    void on_evict(const uint32_t slot) override {
+        (lists.list_of(slot) == T1 ? b1 : b2).push_mru(fingerprints[slot]);
+        lists.unlink(slot);
+    }
+
+    void begin_scan() override {
+        scan_from(lists.size(T1) > 0 && (lists.size(T1) > target_t1 || lists.size(T2) == 0) ? T1 : T2);
+    }
+
+private:
+    static constexpr uint8_t T1 = 0;
+    static constexpr uint8_t T2 = 1;
+
+    size_t capacity;
+    size_t target_t1 = 0; // p: адаптивный целевой размер T1
+    GhostList b1;
+    GhostList b2;
+};
+
+} // namespace
+
+std::unique_ptr<EvictionPolicy> make_eviction_policy(const Lab2EvictionPolicy policy, const size_t capacity) {
+    switch (policy) {
+        case LAB2_POLICY_2Q:
+            return std::make_unique<TwoQueuePolicy>(capacity);
+        case LAB2_POLICY_ARC:
+            return std::make_unique<ArcPolicy>(capacity);
+        case LAB2_POLICY_CLOCK:
+        default:
+            return std::make_unique<ClockPolicy>(capacity);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef LAB2_EVICTION_H
+#define LAB2_EVICTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "cache.hpp"
+
+// Политика вытеснения одного сегмента кэша. Работает с номерами слотов сегмента; все вызовы
+// идут под блокировкой сегмента и не выделяют память. fingerprint — хэш ключа блока: по нему
+// политики с "призраками" узнают недавно вытесненные блоки
+class EvictionPolicy {
+public:
+    virtual ~EvictionPolicy() = default;
+
+    // prefetched — блок загружен упреждающим чтением и еще не запрашивался
+    virtual void on_insert(uint32_t slot, uint64_t fingerprint, bool prefetched) = 0;
+    virtual void on_hit(uint32_t slot, bool prefetched) = 0;
+    virtual void on_evict(uint32_t slot) = 0;
+
+    // Обход кандидатов на вытеснение в порядке предпочтения. Вызывающий пропускает блоки,
+    // которые сейчас вытеснить нельзя; -1 — кандидаты кончились
+    virtual void begin_scan() = 0;
+    virtual int32_t next_candidate() = 0;
+
+    // Горячий блок: у clock взведен бит обращения, у 2Q и ARC он в списке частых (Am / T2)
+    virtual bool is_hot(uint32_t slot) const = 0;
+};
+
+std::unique_ptr<EvictionPolicy> make_eviction_policy(Lab2EvictionPolicy policy, size_t capacity);
+
+#endif
@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <string>
+#include <atomic>
+#include <new>
+#include <random>
+#include <cstdlib>
+#include "cache.hpp"
+#include "bench-config.hpp"
+#include "bench-stats.hpp"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// Счетчик выделений кучи во всем процессе: в установившемся режиме кэш не должен их делать
+static std::atomic<unsigned long> heap_allocations{0};
+
+void* operator new(const size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+// Промахи dTLB через perf_event_open; -1, если счетчик недоступен (нет прав, виртуальная машина, не Linux)
+class TlbMissCounter {
+public:
+    TlbMissCounter() {
+#ifdef __linux__
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        descriptor = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~TlbMissCounter() {
+#ifdef __linux__
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        if (descriptor >= 0) {
+            ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+            ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    long long stop() {
+#ifdef __linux__
+        long long misses = 0;
+        if (descriptor >= 0) {
+            ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(descriptor, &misses, sizeof(misses)) == sizeof(misses)) {
+                return misses;
+            }
+        }
+#endif
+        return -1;
+    }
+
+private:
+    int descriptor = -1;
+};
+
+static std::string per_operation(const long long count, const size_t operations) {
+    return count < 0 ? "n/a" : std::to_string(static_cast<double>(count) / operations);
+}
+
+// Разреженный файл: чтение дыр не упирается в диск, поэтому замер показывает
+// стоимость самой логики промаха (поиск, вытеснение, вставка)
+static bool create_sparse_file(const std::string& file_path, const size_t file_size) {
+    std::ofstream file(file_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    file.seekp(static_cast<std::streamoff>(file_size - 1));
+    file.put('\0');
+    return static_cast<bool>(file);
+}
+
+bool run_benchmark(const std::string& file_path, Lab2Config config, const size_t cache_blocks, const size_t measured_misses) {
+    const size_t block_size = config.block_size ? config.block_size : DEFAULT_BLOCK_SIZE;
+    config.cache_capacity = cache_blocks * block_size;
+    if (lab2_init(&config) != 0) {
+        std::cerr << "Invalid cache configuration!" << std::endl;
+        return false;
+    }
+    if (!create_sparse_file(file_path, (cache_blocks + measured_misses) * block_size)) {
+        std::cerr << "Error creating file for IO benchmark!" << std::endl;
+        return false;
+    }
+
+    const HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+    if (fd == INVALID_HANDLE_VALUE) {
+        std::cerr << "Error opening file for IO benchmark!" << std::endl;
+        return false;
+    }
+
+    std::vector<char> buffer(block_size);
+    const SSIZE_T expected = static_cast<SSIZE_T>(block_size);
+
+    // Прогрев: заполняем кэш целиком
+    for (size_t block = 0; block < cache_blocks; ++block) {
+        if (lab2_read(fd, buffer.data(), block_size) != expected) {
+            std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+            lab2_close(fd);
+            return false;
+        }
+    }
+    lab2_reset_cache_counters();
+
+    TlbMissCounter tlb_misses;
+
+    // Каждое следующее чтение — промах с вытеснением
+    unsigned long allocations_before = heap_allocations.load(std::memory_order_relaxed);
+    tlb_misses.start();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t block = 0; block < measured_misses; ++block) {
+        if (lab2_read(fd, buffer.data(), block_size) != expected) {
+            std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+            lab2_close(fd);
+            return false;
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const long long miss_tlb_misses = tlb_misses.stop();
+    const unsigned long miss_allocations = heap_allocations.load(std::memory_order_relaxed) - allocations_before;
+    std::chrono::duration<double, std::nano> duration = end - start;
+    const unsigned long misses = lab2_get_cache_misses();
+
+    // Случайные попадания по всему кэшу: здесь видна цена промахов TLB по области буферов
+    std::mt19937_64 random(42);
+    const size_t first_cached = measured_misses;
+    allocations_before = heap_allocations.load(std::memory_order_relaxed);
+    tlb_misses.start();
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < measured_misses; ++i) {
+        const LONGLONG block = static_cast<LONGLONG>(first_cached + random() % cache_blocks);
+        if (lab2_lseek(fd, block * static_cast<LONGLONG>(block_size), FILE_BEGIN) < 0 ||
+            lab2_read(fd, buffer.data(), block_size) != expected) {
+            std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+            lab2_close(fd);
+            return false;
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    const long long hit_tlb_misses = tlb_misses.stop();
+    const unsigned long hit_allocations = heap_allocations.load(std::memory_order_relaxed) - allocations_before;
+    std::chrono::duration<double, std::nano> hit_duration = end - start;
+
+    std::cout << "Cache blocks: " << cache_blocks
+              << "\tmiss cost: " << duration.count() / measured_misses << " ns"
+              << "\tallocs/miss: " << per_operation(miss_allocations, measured_misses)
+              << "\tdTLB misses/miss: " << per_operation(miss_tlb_misses, measured_misses)
+              << "\tmisses: " << misses << std::endl;
+    std::cout << "Cache blocks: " << cache_blocks
+              << "\thit cost: " << hit_duration.count() / measured_misses << " ns"
+              << "\tallocs/hit: " << per_operation(hit_allocations, measured_misses)
+              << "\tdTLB misses/hit: " << per_operation(hit_tlb_misses, measured_misses)
+              << "\thits: " << lab2_get_cache_hits() << std::endl;
+
+    lab2_close(fd);
+    lab2_reset_cache_counters();
+    return true;
+}
+
+// Трасса "горячий набор + сканирование": горячие блоки (половина кэша) читаются случайно,
+// вперемешку с последовательным проходом по холодной области в несколько раз больше кэша
+static std::vector<LONGLONG> make_hot_scan_trace(const size_t cache_blocks, const size_t length) {
+    const size_t hot_blocks = std::max<size_t>(cache_blocks / 2, 1);
+    const size_t scan_blocks = cache_blocks * 4;
+    std::mt19937_64 random(7);
+    std::vector<LONGLONG> trace;
+    trace.reserve(length);
+    size_t scan_position = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (i % 2 == 0) {
+            trace.push_back(static_cast<LONGLONG>(random() % hot_blocks));
+        } else {
+            trace.push_back(static_cast<LONGLONG>(hot_blocks + scan_position));
+            scan_position = (scan_position + 1) % scan_blocks;
+        }
+    }
+    return trace;
+}
+
+// Проигрывает одну трассу под каждой политикой и печатает долю попаданий
+bool run_trace_benchmark(const std::string& file_path, Lab2Config config, const size_t cache_blocks) {
+    const size_t block_size = config.block_size ? config.block_size : DEFAULT_BLOCK_SIZE;
+    const size_t hot_blocks = std::max<size_t>(cache_blocks / 2, 1);
+    const std::vector<LONGLONG> trace = make_hot_scan_trace(cache_blocks, cache_blocks * 40);
+    if (!create_sparse_file(file_path, (hot_blocks + cache_blocks * 4) * block_size)) {
+        std::cerr << "Error creating file for IO benchmark!" << std::endl;
+        return false;
+    }
+
+    const std::pair<const char*, Lab2EvictionPolicy> policies[] = {
+        { "clock", LAB2_POLICY_CLOCK }, { "2q", LAB2_POLICY_2Q }, { "arc", LAB2_POLICY_ARC },
+    };
+    std::vector<char> buffer(block_size);
+    std::cout << "Hot set + scan trace: " << trace.size() << " reads, cache " << cache_blocks
+              << " blocks, hot set " << hot_blocks << " blocks\n";
+    std::cout << "Policy\tHit ratio\tHot-set hit ratio\n";
+
+    for (const auto& [name, policy] : policies) {
+        config.eviction_policy = policy;
+        config.cache_capacity = cache_blocks * block_size;
+        if (lab2_init(&config) != 0) {
+            std::cerr << "Invalid cache configuration!" << std::endl;
+            return false;
+        }
+        const HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+        if (fd == INVALID_HANDLE_VALUE) {
+            std::cerr << "Error opening file for IO benchmark!" << std::endl;
+            return false;
+        }
+
+        lab2_reset_cache_counters();
+        size_t hot_reads = 0;
+        size_t hot_hits = 0;
+        for (const LONGLONG block : trace) {
+            const unsigned long hits_before = lab2_get_cache_hits();
+            if (lab2_lseek(fd, block * static_cast<LONGLONG>(block_size), FILE_BEGIN) < 0 ||
+                lab2_read(fd, buffer.data(), block_size) != static_cast<SSIZE_T>(block_size)) {
+                std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+                lab2_close(fd);
+                return false;
+            }
+            if (static_cast<size_t>(block) < hot_blocks) {
+                hot_reads++;
+                hot_hits += lab2_get_cache_hits() - hits_before;
+            }
+        }
+
+        const double hits = static_cast<double>(lab2_get_cache_hits());
+        std::cout << name << "\t" << hits / (hits + lab2_get_cache_misses()) << "\t\t"
+                  << static_cast<double>(hot_hits) / hot_reads << std::endl;
+        lab2_close(fd);
+    }
+
+    lab2_reset_cache_counters();
+    return true;
+}
+
+// Файл из строк журнала: сжимается примерно как настоящие логи и индексы, в отличие от разреженного
+static bool create_log_file(const std::string& file_path, const size_t file_size) {
+    std::ofstream file(file_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    static const char* const levels[] = { "INFO", "INFO", "INFO", "WARN", "DEBUG" };
+    static const char* const paths[] = { "/api/v1/users", "/api/v1/orders", "/static/app.js", "/health", "/api/v1/search" };
+    std::mt19937 random(11);
+    std::string line;
+    size_t written = 0;
+    while (written < file_size) {
+        line = "2026-03-14T12:" + std::to_string(10 + random() % 50) + ":" + std::to_string(10 + random() % 50) + " " +
+               levels[random() % 5] + " request id=" + std::to_string(random() % 1000000) + " path=" + paths[random() % 5] +
+               " status=" + (random() % 10 ? "200" : "404") + " latency_ms=" + std::to_string(random() % 300) + "\n";
+        file.write(line.data(), static_cast<std::streamsize>(std::min(line.size(), file_size - written)));
+        written += line.size();
+    }
+    return static_cast<bool>(file);
+}
+
+// Случайные чтения по набору втрое больше кэша без сжатого уровня и с ним: попадания в сжатый уровень
+// заменяют чтения диска распаковкой. Размер уровня — --compressed-size, по умолчанию равен кэшу
+bool run_compressed_benchmark(const std::string& file_path, Lab2Config config, const size_t cache_blocks) {
+    const size_t block_size = config.block_size ? config.block_size : DEFAULT_BLOCK_SIZE;
+    const size_t file_blocks = cache_blocks * 3;
+    const size_t reads = file_blocks * 10;
+    const size_t compressed_capacity = config.compressed_capacity ? config.compressed_capacity : cache_blocks * block_size;
+    if (!create_log_file(file_path, file_blocks * block_size)) {
+        std::cerr << "Error creating file for IO benchmark!" << std::endl;
+        return false;
+    }
+
+    std::cout << "Compressed tier: " << reads << " random reads over " << file_blocks << " blocks, cache "
+              << cache_blocks << " blocks\n";
+    std::cout << "Tier (bytes)\tThroughput (MB/s)\tHit ratio\tTier hits\tDisk reads\tRatio\tDecompress p50 (ns)\n";
+    std::vector<char> buffer(block_size);
+    for (const size_t tier_bytes : { static_cast<size_t>(0), compressed_capacity }) {
+        config.cache_capacity = cache_blocks * block_size;
+        config.compressed_capacity = tier_bytes;
+        if (lab2_init(&config) != 0) {
+            std::cerr << "Invalid cache configuration!" << std::endl;
+            return false;
+        }
+        const HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+        if (fd == INVALID_HANDLE_VALUE) {
+            std::cerr << "Error opening file for IO benchmark!" << std::endl;
+            return false;
+        }
+
+        // Первый проход наполняет кэш и сжатый уровень
+        std::mt19937_64 random(5);
+        for (size_t block = 0; block < file_blocks; ++block) {
+            lab2_pread(fd, buffer.data(), block_size, static_cast<LONGLONG>(block * block_size));
+        }
+        Lab2Stats before;
+        lab2_get_stats(&before);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < reads; ++i) {
+            const LONGLONG block = static_cast<LONGLONG>(random() % file_blocks);
+            if (lab2_pread(fd, buffer.data(), block_size, block * static_cast<LONGLONG>(block_size)) !=
+                static_cast<SSIZE_T>(block_size)) {
+                std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+                lab2_close(fd);
+                return false;
+            }
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        lab2_close(fd);
+
+        // lab2_get_stats накапливает с запуска: замер — разность снимков
+        Lab2Stats stats;
+        lab2_get_stats(&stats);
+        for (size_t counter = 0; counter < LAB2_STAT_COUNT; ++counter) {
+            stats.counters[counter] -= before.counters[counter];
+        }
+        Lab2Histogram& decompress = stats.latency[LAB2_LATENCY_DECOMPRESS];
+        decompress.count -= before.latency[LAB2_LATENCY_DECOMPRESS].count;
+        for (size_t bucket = 0; bucket < LAB2_HISTOGRAM_BUCKETS; ++bucket) {
+            decompress.buckets[bucket] -= before.latency[LAB2_LATENCY_DECOMPRESS].buckets[bucket];
+        }
+        const double hits = static_cast<double>(stats.counters[LAB2_STAT_HITS]);
+        const unsigned long long output_bytes = stats.counters[LAB2_STAT_COMPRESSED_OUTPUT_BYTES];
+        std::cout << tier_bytes << "\t\t" << static_cast<double>(reads * block_size) / seconds / (1024 * 1024) << "\t\t\t"
+                  << hits / (hits + stats.counters[LAB2_STAT_MISSES]) << "\t\t" << stats.counters[LAB2_STAT_COMPRESSED_HITS]
+                  << "\t\t" << stats.counters[LAB2_STAT_DISK_READS] << "\t\t"
+                  << (output_bytes ? static_cast<double>(stats.counters[LAB2_STAT_COMPRESSED_INPUT_BYTES]) / output_bytes : 0.0)
+                  << "\t" << lab2_histogram_percentile(&decompress, 0.5) << std::endl;
+    }
+
+    lab2_reset_cache_counters();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args;
+    Lab2Config config = {};
+    BenchmarkFlags flags;
+    if (!parse_benchmark_args(argc, argv, args, config, &flags, { "hot-scan", "compressed" }) || args.empty()) {
+        std::cerr << "Usage: " << argv[0] << " <file_path> [max_cache_blocks] [measured_misses] [--hot-scan[=CACHE_BLOCKS]] [--compressed[=CACHE_BLOCKS]] "
+                  CACHE_FLAGS_USAGE " " STATS_FLAGS_USAGE << std::endl;
+        return 1;
+    }
+
+    // Последовательные промахи иначе превращаются в попадания по упрежденным блокам
+    if (config.readahead_max_blocks == 0) {
+        config.readahead_disabled = true;
+    }
+
+    const StatsDumper stats_dumper(flags);
+    std::string file_path = args[0];
+    size_t max_cache_blocks = args.size() > 1 ? std::stoul(args[1]) : 1024 * 1024;
+    size_t measured_misses = args.size() > 2 ? std::stoul(args[2]) : 65536;
+
+    if (flags.count("hot-scan")) {
+        const size_t cache_blocks = flags["hot-scan"] == "1" ? 4096 : std::stoul(flags["hot-scan"]);
+        const bool passed = run_trace_benchmark(file_path, config, cache_blocks);
+        std::remove(file_path.c_str());
+        return passed ? 0 : 1;
+    }
+
+    if (flags.count("compressed")) {
+        const size_t cache_blocks = flags["compressed"] == "1" ? 4096 : std::stoul(flags["compressed"]);
+        const bool passed = run_compressed_benchmark(file_path, config, cache_blocks);
+        std::remove(file_path.c_str());
+        return passed ? 0 : 1;
+    }
+
+    // Ёмкость задается сеткой размеров, флаг --cache-size здесь игнорируется.
+    // Последняя точка сетки — всегда max_cache_blocks, даже если шаг через нее перескакивает
+    for (size_t cache_blocks = 512; cache_blocks <= max_cache_blocks;
+         cache_blocks = cache_blocks == max_cache_blocks ? max_cache_blocks + 1 : std::min(cache_blocks * 8, max_cache_blocks)) {
+        if (!run_benchmark(file_path, config, cache_blocks, measured_misses)) {
+            return 1;
+        }
+    }
+
+    std::remove(file_path.c_str());
+    return 0;
+}
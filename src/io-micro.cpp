@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <random>
+#include <string>
+#include <benchmark/benchmark.h>
+#include "cache.hpp"
+#include "eviction.hpp"
+#include "bench-config.hpp"
+
+// Микробенчмарки отдельных путей кэша на Google Benchmark. Каждый бенчмарк сам переконфигурирует
+// кэш (lab2_init) поверх общих флагов командной строки и работает с одним файлом данных
+static Lab2Config base_config = {};
+static std::string data_path = "micro-bench.dat";
+static size_t data_size = 64 << 20;
+
+static const size_t IO_BLOCK = 4096;
+
+static bool prepare_data_file() {
+    std::ifstream existing(data_path, std::ios::binary | std::ios::ate);
+    if (existing && static_cast<size_t>(existing.tellg()) >= data_size) {
+        return true;
+    }
+    std::ofstream data(data_path, std::ios::binary | std::ios::trunc);
+    const std::vector<char> chunk(1 << 20, 'M');
+    for (size_t written = 0; written < data_size && data; written += chunk.size()) {
+        data.write(chunk.data(), static_cast<std::streamsize>(std::min(chunk.size(), data_size - written)));
+    }
+    if (!data) {
+        std::cerr << "Cannot create data file " << data_path << std::endl;
+    }
+    return static_cast<bool>(data);
+}
+
+// Кэш нужной емкости без упреждения; writeback=false — грязные блоки пишут только вытеснение и fsync
+static HANDLE open_with_cache(benchmark::State& state, const size_t capacity, const bool writeback = true) {
+    Lab2Config config = base_config;
+    config.cache_capacity = capacity;
+    config.readahead_disabled = true;
+    config.writeback_disabled = config.writeback_disabled || !writeback;
+    if (lab2_init(&config) != 0) {
+        state.SkipWithError("lab2_init failed");
+        return INVALID_HANDLE_VALUE;
+    }
+    const HANDLE file_handle = lab2_open(data_path.c_str(), GENERIC_READ | GENERIC_WRITE, OPEN_EXISTING);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        state.SkipWithError("lab2_open failed");
+    }
+    return file_handle;
+}
+
+// Прирост счетчиков lab2_get_stats за время бенчмарка, в среднем на итерацию
+class CounterDelta {
+public:
+    CounterDelta() { lab2_get_stats(&before); }
+
+    void report(benchmark::State& state, const std::vector<std::pair<const char*, Lab2Counter>>& counters) const {
+        Lab2Stats after;
+        lab2_get_stats(&after);
+        for (const auto& [name, counter] : counters) {
+            state.counters[name] = benchmark::Counter(static_cast<double>(after.counters[counter] - before.counters[counter]),
+                                                      benchmark::Counter::kAvgIterations);
+        }
+    }
+
+private:
+    Lab2Stats before;
+};
+
+// Попадание: повторное чтение заранее загруженных 8 МиБ запросами разного размера
+static void BM_ReadHit(benchmark::State& state) {
+    const size_t request = static_cast<size_t>(state.range(0));
+    const size_t window = 8 << 20;
+    const HANDLE file_handle = open_with_cache(state, 32 << 20);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    std::vector<char> buffer(std::max(request, window));
+    lab2_pread(file_handle, buffer.data(), window, 0);
+
+    LONGLONG offset = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lab2_pread(file_handle, buffer.data(), request, offset));
+        offset = (offset + static_cast<LONGLONG>(request)) % static_cast<LONGLONG>(window - request + 1);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * request));
+    lab2_close(file_handle);
+}
+BENCHMARK(BM_ReadHit)->Arg(64)->Arg(512)->Arg(4096)->Arg(65536)->Arg(1 << 20);
+
+// Промах: случайные блоки файла, в 16 раз большего кэша; чистое вытеснение + чтение O_DIRECT
+static void BM_ReadMiss(benchmark::State& state) {
+    const HANDLE file_handle = open_with_cache(state, data_size / 16);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    std::vector<char> buffer(IO_BLOCK);
+    std::mt19937_64 random(1);
+    std::uniform_int_distribution<size_t> block(0, data_size / IO_BLOCK - 1);
+
+    const CounterDelta delta;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lab2_pread(file_handle, buffer.data(), IO_BLOCK, static_cast<LONGLONG>(block(random) * IO_BLOCK)));
+    }
+    delta.report(state, { { "misses", LAB2_STAT_MISSES }, { "disk_reads", LAB2_STAT_DISK_READS } });
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * IO_BLOCK));
+    lab2_close(file_handle);
+}
+BENCHMARK(BM_ReadMiss)->UseRealTime();
+
+// Вытеснение (free_cache_block) при заданной доле грязных блоков: последовательный проход по файлу
+// больше кэша, каждый запрос — промах; доля range(0) запросов пишет блок целиком, остальные читают
+static void BM_EvictionMix(benchmark::State& state) {
+    const int64_t dirty_percent = state.range(0);
+    const HANDLE file_handle = open_with_cache(state, 4 << 20, false);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    std::vector<char> buffer(IO_BLOCK, 'E');
+    const size_t blocks = data_size / IO_BLOCK;
+    size_t next = 0;
+    int64_t phase = 0;
+    const auto access = [&] {
+        const LONGLONG offset = static_cast<LONGLONG>(next * IO_BLOCK);
+        if (phase < dirty_percent) {
+            benchmark::DoNotOptimize(lab2_pwrite(file_handle, buffer.data(), IO_BLOCK, offset));
+        } else {
+            benchmark::DoNotOptimize(lab2_pread(file_handle, buffer.data(), IO_BLOCK, offset));
+        }
+        next = (next + 1) % blocks;
+        phase = (phase + 1) % 100;
+    };
+    // Прогрев: кэш заполняется блоками с нужной долей грязных, чтобы каждое вытеснение шло в установившемся режиме
+    for (size_t i = 0; i < (4 << 20) / IO_BLOCK; ++i) {
+        access();
+    }
+
+    const CounterDelta delta;
+    for (auto _ : state) {
+        access();
+    }
+    delta.report(state, { { "evictions", LAB2_STAT_EVICTIONS }, { "dirty_evictions", LAB2_STAT_DIRTY_EVICTIONS },
+                          { "scan_steps", LAB2_STAT_EVICTION_SCAN_STEPS } });
+    lab2_close(file_handle);
+}
+BENCHMARK(BM_EvictionMix)->Arg(0)->Arg(25)->Arg(50)->Arg(100)->UseRealTime();
+
+// lab2_fsync с range(0) грязными блоками, которые пачкаются вне замера: половина идет подряд
+// и пишется длинными вызовами, половина — через один, по вызову на блок
+static void BM_FsyncDirty(benchmark::State& state) {
+    const size_t dirty = static_cast<size_t>(state.range(0));
+    const HANDLE file_handle = open_with_cache(state, 64 << 20, false);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    std::vector<char> buffer(IO_BLOCK, 'F');
+    const CounterDelta delta;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (size_t i = 0; i < dirty; ++i) {
+            const size_t block = i < dirty / 2 ? i : dirty + 2 * i;
+            lab2_pwrite(file_handle, buffer.data(), IO_BLOCK, static_cast<LONGLONG>(block % (data_size / IO_BLOCK) * IO_BLOCK));
+        }
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(lab2_fsync(file_handle));
+    }
+    delta.report(state, { { "fsync_writes", LAB2_STAT_FSYNC_WRITES } });
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * dirty * IO_BLOCK));
+    lab2_close(file_handle);
+}
+BENCHMARK(BM_FsyncDirty)->Arg(16)->Arg(256)->Arg(4096)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// Стоимость поиска блока от размера кэша: попадания в случайные блоки рабочего набора в 3/4 кэша
+// (запас на неравномерное заполнение сегментов)
+static void BM_LookupVsCacheSize(benchmark::State& state) {
+    const size_t capacity = std::min(static_cast<size_t>(state.range(0)), data_size);
+    const HANDLE file_handle = open_with_cache(state, capacity);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    const size_t blocks = capacity / IO_BLOCK * 3 / 4;
+    std::vector<char> buffer(IO_BLOCK);
+    for (size_t block = 0; block < blocks; ++block) {
+        lab2_pread(file_handle, buffer.data(), IO_BLOCK, static_cast<LONGLONG>(block * IO_BLOCK));
+    }
+    std::vector<LONGLONG> offsets(1 << 16);
+    std::mt19937_64 random(1);
+    for (LONGLONG& offset : offsets) {
+        offset = static_cast<LONGLONG>(random() % blocks * IO_BLOCK);
+    }
+
+    size_t i = 0;
+    const CounterDelta delta;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lab2_pread(file_handle, buffer.data(), 64, offsets[i++ & (offsets.size() - 1)]));
+    }
+    delta.report(state, { { "misses", LAB2_STAT_MISSES } });
+    lab2_close(file_handle);
+}
+BENCHMARK(BM_LookupVsCacheSize)->RangeMultiplier(4)->Range(1 << 20, 64 << 20);
+
+// Выбор жертвы политикой без ввода-вывода: вставка нового блока на место вытесненного в полном кэше
+// из range(1) слотов; range(2) попаданий в случайные слоты на каждое вытеснение задают долю
+// слотов со взведенным битом обращения, которые стрелке clock приходится пропускать
+static void BM_PolicyEvict(benchmark::State& state) {
+    const auto policy_kind = static_cast<Lab2EvictionPolicy>(state.range(0));
+    const size_t capacity = static_cast<size_t>(state.range(1));
+    const int64_t hits = state.range(2);
+    const std::unique_ptr<EvictionPolicy> policy = make_eviction_policy(policy_kind, capacity);
+    std::mt19937_64 random(1);
+    for (uint32_t slot = 0; slot < capacity; ++slot) {
+        policy->on_insert(slot, random(), false);
+    }
+    for (auto _ : state) {
+        policy->begin_scan();
+        const int32_t victim = policy->next_candidate();
+        policy->on_evict(static_cast<uint32_t>(victim));
+        policy->on_insert(static_cast<uint32_t>(victim), random(), false);
+        for (int64_t i = 0; i < hits; ++i) {
+            policy->on_hit(static_cast<uint32_t>(random() % capacity), false);
+        }
+    }
+    state.SetLabel(policy_kind == LAB2_POLICY_CLOCK ? "clock" : policy_kind == LAB2_POLICY_2Q ? "2q" : "arc");
+}
+BENCHMARK(BM_PolicyEvict)->ArgsProduct({ { LAB2_POLICY_CLOCK, LAB2_POLICY_2Q, LAB2_POLICY_ARC }, { 16384, 1 << 20 }, { 1, 16 } });
+
+// Худший случай clock: у всех range(0) слотов взведен бит обращения, и стрелка проходит полный
+// оборот, снимая их, прежде чем найти жертву. Биты взводятся вне замера
+static void BM_ClockFullSweep(benchmark::State& state) {
+    const size_t capacity = static_cast<size_t>(state.range(0));
+    const std::unique_ptr<EvictionPolicy> policy = make_eviction_policy(LAB2_POLICY_CLOCK, capacity);
+    for (uint32_t slot = 0; slot < capacity; ++slot) {
+        policy->on_insert(slot, slot, false);
+    }
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (uint32_t slot = 0; slot < capacity; ++slot) {
+            policy->on_hit(slot, false);
+        }
+        state.ResumeTiming();
+        policy->begin_scan();
+        benchmark::DoNotOptimize(policy->next_candidate());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * capacity));
+}
+BENCHMARK(BM_ClockFullSweep)->Arg(16384)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+
+// Сохраненный результат: имя прогона -> время итерации в нс
+typedef std::map<std::string, double> BaselineTimes;
+
+static double to_nanoseconds(const double time, const std::string& unit) {
+    if (unit == "us") {
+        return time * 1e3;
+    }
+    if (unit == "ms") {
+        return time * 1e6;
+    }
+    if (unit == "s") {
+        return time * 1e9;
+    }
+    return time;
+}
+
+// Результат прошлого запуска с --benchmark_out=FILE (формат json). Google Benchmark пишет
+// каждое поле объекта отдельной строкой, поэтому хватает построчного разбора
+static bool load_baseline(const std::string& path, BaselineTimes& baseline) {
+    std::ifstream input(path);
+    if (!input) {
+        std::cerr << "Cannot open baseline " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    std::string name;
+    std::string unit = "ns";
+    double time = -1.0;
+    const auto field = [&line](const char* key) -> std::string {
+        const std::string quoted = std::string("\"") + key + "\": ";
+        const size_t position = line.find(quoted);
+        if (position == std::string::npos) {
+            return std::string();
+        }
+        std::string value = line.substr(position + quoted.size());
+        value.erase(std::remove(value.begin(), value.end(), ','), value.end());
+        value.erase(std::remove(value.begin(), value.end(), '"'), value.end());
+        return value;
+    };
+    while (std::getline(input, line)) {
+        if (const std::string value = field("name"); !value.empty()) {
+            name = value;
+            unit = "ns";
+            time = -1.0;
+        } else if (const std::string value = field("real_time"); !value.empty()) {
+            time = std::stod(value);
+        } else if (const std::string value = field("time_unit"); !value.empty()) {
+            unit = value;
+        } else if (line.find('}') != std::string::npos && !name.empty() && time >= 0) {
+            baseline[name] = to_nanoseconds(time, unit);
+            name.clear();
+        }
+    }
+    return !baseline.empty();
+}
+
+// Консольный вывод как обычно, плюс запоминание времени прогонов для сравнения с базой.
+// Сравниваются медианы повторов (или единичные прогоны без повторов)
+class CollectingReporter : public benchmark::ConsoleReporter {
+public:
+    void ReportRuns(const std::vector<Run>& runs) override {
+        ConsoleReporter::ReportRuns(runs);
+        for (const Run& run : runs) {
+            if (run.error_occurred || (run.run_type == Run::RT_Aggregate && run.aggregate_name != "median")) {
+                continue;
+            }
+            if (run.run_type == Run::RT_Iteration && run.repetitions > 1) {
+                continue;
+            }
+            times[run.benchmark_name()] = run.GetAdjustedRealTime() * benchmark::GetTimeUnitMultiplier(benchmark::kNanosecond) /
+                                          benchmark::GetTimeUnitMultiplier(run.time_unit);
+        }
+    }
+
+    BaselineTimes times;
+};
+
+// Таблица изменений относительно базы; false, если какой-то прогон медленнее порога
+static bool compare_with_baseline(const BaselineTimes& baseline, const BaselineTimes& current, const double threshold_percent) {
+    bool ok = true;
+    std::cout << "\nComparison with baseline (threshold " << threshold_percent << "%):\n";
+    for (const auto& [name, time] : current) {
+        const auto reference = baseline.find(name);
+        if (reference == baseline.end()) {
+            std::cout << "  " << name << ": not in baseline\n";
+            continue;
+        }
+        const double change = (time / reference->second - 1.0) * 100.0;
+        const bool regression = change > threshold_percent;
+        ok = ok && !regression;
+        std::ostringstream line;
+        line.setf(std::ios::fixed);
+        line.precision(1);
+        line << "  " << name << ": " << reference->second << " ns -> " << time << " ns (" << (change >= 0 ? "+" : "")
+             << change << "%)" << (regression ? "  REGRESSION" : "");
+        std::cout << line.str() << "\n";
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    // Повторы с прогревом по умолчанию; флаги --benchmark_* из командной строки идут позже и их переопределяют
+    std::vector<char*> arguments = { argv[0] };
+    std::string defaults[] = { "--benchmark_repetitions=5", "--benchmark_min_warmup_time=0.1",
+                               "--benchmark_report_aggregates_only=true" };
+    for (std::string& value : defaults) {
+        arguments.push_back(value.data());
+    }
+    arguments.insert(arguments.end(), argv + 1, argv + argc);
+    int argument_count = static_cast<int>(arguments.size());
+    benchmark::Initialize(&argument_count, arguments.data());
+
+    std::vector<std::string> args;
+    BenchmarkFlags flags;
+    if (!parse_benchmark_args(argument_count, arguments.data(), args, base_config, &flags,
+                              { "file-size", "baseline", "threshold" }) || args.size() > 1) {
+        std::cerr << "Usage: " << argv[0] << " [data_file] [--file-size=BYTES] [--baseline=RESULT.json] [--threshold=PCT] "
+                  CACHE_FLAGS_USAGE " [--benchmark_filter=REGEX] [--benchmark_out=RESULT.json --benchmark_out_format=json] "
+                  "[--benchmark_repetitions=N] ..." << std::endl;
+        return 1;
+    }
+    if (!args.empty()) {
+        data_path = args[0];
+    }
+    if (flags.count("file-size")) {
+        data_size = std::max(parse_size(flags["file-size"]), static_cast<size_t>(8 << 20));
+    }
+    BaselineTimes baseline;
+    if (flags.count("baseline") && !load_baseline(flags["baseline"], baseline)) {
+        return 1;
+    }
+    if (!prepare_data_file()) {
+        return 1;
+    }
+
+    if (baseline.empty()) {
+        benchmark::RunSpecifiedBenchmarks();
+        benchmark::Shutdown();
+        return 0;
+    }
+    CollectingReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    const double threshold = flags.count("threshold") ? std::stod(flags["threshold"]) : 10.0;
+    return compare_with_baseline(baseline, reporter.times, threshold) ? 0 : 2;
+}
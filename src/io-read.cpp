@@ -3,78 +3,321 @@
 #include <chrono>
 #include <vector>
 #include <numeric>
-#include <windows.h>
-#include <BaseTsd.h>
 #include <cstring>
 #include "cache.hpp"
+#include "bench-config.hpp"
+#include "bench-stats.hpp"
 #include <iostream>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <cstdio>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
-void run_benchmark(const std::string& file_path, int iterations, bool use_cache) {
-    std::vector<char> buffer(BLOCK_SIZE);
+// Чтение файла целиком через кэш; возвращает число прочитанных байт или -1
+static SSIZE_T read_whole_file(const std::string& file_path, char* buffer, const size_t request_size) {
+    const HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+    if (fd == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+
+    SSIZE_T total = 0;
+    SSIZE_T bytes_read = 0;
+    do {
+        bytes_read = lab2_read(fd, buffer, request_size);
+        if (bytes_read < 0) {
+            lab2_close(fd);
+            return -1;
+        }
+        total += bytes_read;
+    } while (bytes_read > 0);
+
+    lab2_close(fd);
+    return total;
+}
+
+// Масштабирование пропускной способности: каждый поток читает файл через свой хэндл
+void run_threaded_benchmark(const std::string& file_path, int iterations, int max_threads) {
+    std::vector<char> warmup_buffer(lab2_get_block_size());
+    if (read_whole_file(file_path, warmup_buffer.data(), warmup_buffer.size()) < 0) {
+        std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+        return;
+    }
+    lab2_reset_cache_counters();
+
+    std::cout << "\nThreads\tThroughput (MB/s)\tHits\tMisses\n";
+    // Потоки удваиваются, но последняя точка — всегда max_threads, даже если оно не степень двойки
+    for (int threads = 1; threads <= max_threads;
+         threads = threads == max_threads ? max_threads + 1 : std::min(threads * 2, max_threads)) {
+        std::atomic<long long> total_bytes{0};
+        std::atomic<bool> failed{false};
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&]() {
+                std::vector<char> buffer(lab2_get_block_size());
+                for (int i = 0; i < iterations; ++i) {
+                    const SSIZE_T bytes = read_whole_file(file_path, buffer.data(), buffer.size());
+                    if (bytes < 0) {
+                        failed = true;
+                        return;
+                    }
+                    total_bytes += bytes;
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        if (failed) {
+            std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+            return;
+        }
+
+        std::chrono::duration<double> duration = end - start;
+        std::cout << threads << "\t" << total_bytes / duration.count() / (1024 * 1024) << "\t\t\t"
+                  << lab2_get_cache_hits() << "\t" << lab2_get_cache_misses() << std::endl;
+        lab2_reset_cache_counters();
+    }
+    std::cout << std::endl;
+}
+
+// Размер запроса от 4 КБ до 4 МБ: первый проход по холодному кэшу показывает, сколько чтений
+// с диска уходит на промахи, остальные — стоимость попаданий (или обхода кэша с --bypass)
+void run_request_size_sweep(const std::string& file_path, int iterations, const Lab2Config& config) {
+    constexpr size_t MIN_REQUEST = 4 * 1024;
+    constexpr size_t MAX_REQUEST = 4 * 1024 * 1024;
+    char* buffer = static_cast<char*>(platform_aligned_alloc(MAX_REQUEST, lab2_get_block_size()));
+    if (!buffer) {
+        std::cerr << "Error allocating aligned buffer!" << std::endl;
+        return;
+    }
+
+    std::cout << "\nRequest (KB)\tCold (MB/s)\tWarm (MB/s)\tDisk reads (cold)\tMisses (cold)\n";
+    for (size_t request = MIN_REQUEST; request <= MAX_REQUEST; request *= 2) {
+        lab2_init(&config); // Новая область буферов: каждый размер начинает с пустого кэша
+        lab2_reset_cache_counters();
+
+        double cold_seconds = 0.0;
+        double warm_seconds = 0.0;
+        long long file_bytes = 0;
+        unsigned long cold_disk_reads = 0;
+        unsigned long cold_misses = 0;
+        for (int i = 0; i < iterations; ++i) {
+            const auto start = std::chrono::high_resolution_clock::now();
+            const SSIZE_T bytes = read_whole_file(file_path, buffer, request);
+            const std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+            if (bytes < 0) {
+                std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+                platform_aligned_free(buffer);
+                return;
+            }
+            file_bytes = bytes;
+            if (i == 0) {
+                cold_seconds = duration.count();
+                cold_disk_reads = lab2_get_disk_reads();
+                cold_misses = lab2_get_cache_misses();
+            } else {
+                warm_seconds += duration.count();
+            }
+        }
+
+        const double megabytes = static_cast<double>(file_bytes) / (1024 * 1024);
+        std::cout << request / 1024 << "\t\t" << megabytes / cold_seconds << "\t\t"
+                  << (iterations > 1 ? megabytes * (iterations - 1) / warm_seconds : 0.0) << "\t\t"
+                  << cold_disk_reads << "\t\t\t" << cold_misses << std::endl;
+    }
+    std::cout << std::endl;
+    platform_aligned_free(buffer);
+}
+
+// Случайные чтения блоков через асинхронный API: в полете держится qd запросов. Каждая глубина
+// начинает с пустого кэша, так что IOPS отражают промахи, которые идут на диск одновременно
+void run_queue_depth_benchmark(const std::string& file_path, int iterations, const Lab2Config& config,
+                               const std::vector<int>& depths) {
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    const LONGLONG file_size = file ? static_cast<LONGLONG>(file.tellg()) : 0;
+    if (file_size <= 0) {
+        std::cerr << "Error opening file for IO benchmark!" << std::endl;
+        return;
+    }
+
+    std::cout << "\nQD\tIOPS\tHits\tMisses\tCoalesced\n";
+    for (const int depth : depths) {
+        lab2_init(&config);
+        lab2_reset_cache_counters();
+        const size_t block_size = lab2_get_block_size();
+        const LONGLONG block_count = std::max<LONGLONG>(file_size / static_cast<LONGLONG>(block_size), 1);
+        const long long operations = block_count * iterations;
+
+        const HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+        char* buffers = static_cast<char*>(platform_aligned_alloc(block_size * depth, block_size));
+        Lab2AsyncQueue* queue = lab2_async_queue_create();
+        if (fd == INVALID_HANDLE_VALUE || !buffers || !queue) {
+            std::cerr << "Error preparing async IO benchmark!" << std::endl;
+            return;
+        }
+
+        std::mt19937_64 random(42); // Одна и та же последовательность для всех глубин
+        std::uniform_int_distribution<LONGLONG> pick_block(0, block_count - 1);
+        std::vector<Lab2AsyncCompletion> completions(depth);
+        long long submitted = 0;
+        long long completed = 0;
+        bool failed = false;
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        const auto submit = [&](const int slot) {
+            const LONGLONG offset = pick_block(random) * static_cast<LONGLONG>(block_size);
+            if (lab2_read_async(queue, fd, buffers + slot * block_size, block_size, offset,
+                                reinterpret_cast<void*>(static_cast<intptr_t>(slot))) != 0) {
+                failed = true;
+            }
+            submitted++;
+        };
+        for (int slot = 0; slot < depth && submitted < operations; ++slot) {
+            submit(slot);
+        }
+        while (completed < submitted && !failed) {
+            const int count = lab2_async_wait(queue, completions.data(), 1, depth);
+            for (int i = 0; i < count; ++i) {
+                failed = failed || completions[i].result < 0;
+                completed++;
+                if (submitted < operations) {
+                    submit(static_cast<int>(reinterpret_cast<intptr_t>(completions[i].user_data)));
+                }
+            }
+        }
+        const std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+
+        lab2_async_queue_destroy(queue);
+        platform_aligned_free(buffers);
+        lab2_close(fd);
+        if (failed) {
+            std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+            return;
+        }
+        std::cout << depth << "\t" << completed / duration.count() << "\t" << lab2_get_cache_hits() << "\t"
+                  << lab2_get_cache_misses() << "\t" << lab2_get_coalesced_misses() << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+// Потребитель данных для сравнения копирующего чтения и чтения без копирования
+static uint64_t checksum_bytes(const char* data, const size_t length) {
+    uint64_t checksum = 0;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        checksum ^= word;
+    }
+    for (; i < length; ++i) {
+        checksum ^= static_cast<unsigned char>(data[i]);
+    }
+    return checksum;
+}
+
+enum ReadMode {
+    READ_DIRECT = 0, // O_DIRECT без кэша
+    READ_CACHED = 1,
+    READ_MAPPED = 2, // lab2_open с LAB2_OPEN_MAPPED
+};
+
+struct ReadResult {
+    double throughput; // MB/s
+    unsigned long hits;
+    unsigned long misses;
+};
+
+ReadResult run_benchmark(const std::string& file_path, int iterations, const ReadMode mode, bool zero_copy) {
+    const bool use_cache = mode != READ_DIRECT;
+    zero_copy = zero_copy && mode == READ_CACHED; // Из отображения данные всегда копируются
+    const size_t block_size = lab2_get_block_size();
+    std::vector<char> buffer(block_size);
     std::vector<double> durations;
     durations.reserve(iterations);
+    long long total_bytes = 0;
+    uint64_t checksum = 0;
 
     for (int i = 0; i < iterations; ++i) {
         auto start = std::chrono::high_resolution_clock::now();
 
         if (use_cache) {
         
-            const HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+            const HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ | (mode == READ_MAPPED ? LAB2_OPEN_MAPPED : 0), OPEN_EXISTING);
 
             if (fd == INVALID_HANDLE_VALUE) {
                 std::cerr << "Error opening file for IO benchmark!" << std::endl;
-                return;
+                return {};
             }
 
             SSIZE_T bytes_read = 0;
             do {
-                bytes_read = lab2_read(fd, buffer.data(), BLOCK_SIZE);
+                if (zero_copy) {
+                    // Данные читаются прямо из блока кэша, без копии в буфер
+                    Lab2PinnedView view;
+                    bytes_read = lab2_read_pinned(fd, block_size, &view);
+                    if (bytes_read > 0) {
+                        checksum += checksum_bytes(view.data, view.length);
+                        lab2_release(&view);
+                    }
+                } else {
+                    bytes_read = lab2_read(fd, buffer.data(), block_size);
+                    if (bytes_read > 0) {
+                        checksum += checksum_bytes(buffer.data(), bytes_read);
+                    }
+                }
                 if (bytes_read < 0) {
                     std::cerr << "Error reading from file during IO benchmark!" << std::endl;
                     lab2_close(fd);
-                    return;
+                    return {};
                 }
+                total_bytes += bytes_read;
             } while (bytes_read > 0);
 
             lab2_close(fd);
         } else {
             // Открытие файла с отключенным кэшированием ОС
-            HANDLE fd = CreateFileA(
-                file_path.c_str(),
-                GENERIC_READ,
-                FILE_SHARE_READ,
-                nullptr,
-                OPEN_EXISTING,
-                FILE_FLAG_NO_BUFFERING, // Отключение кэширования ОС
-                nullptr
-            );
+            HANDLE fd = platform_open_direct(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
 
             if (fd == INVALID_HANDLE_VALUE) {
                 std::cerr << "Error opening file for IO benchmark!" << std::endl;
-                return;
+                return {};
             }
 
             // Выделение выровненной памяти
-            void* aligned_buffer = _aligned_malloc(BLOCK_SIZE, BLOCK_SIZE);
+            void* aligned_buffer = platform_aligned_alloc(block_size, block_size);
             if (!aligned_buffer) {
                 std::cerr << "Error allocating aligned buffer!" << std::endl;
-                CloseHandle(fd);
-                return;
+                platform_close(fd);
+                return {};
             }
 
-            DWORD bytes_read = 0;
+            LONGLONG read_offset = 0;
+            SSIZE_T bytes_read = 0;
             do {
-                if (!ReadFile(fd, aligned_buffer, BLOCK_SIZE, &bytes_read, nullptr)) {
+                bytes_read = platform_pread(fd, aligned_buffer, block_size, read_offset);
+                if (bytes_read < 0) {
                     std::cerr << "Error reading from file during IO benchmark!" << std::endl;
-                    _aligned_free(aligned_buffer);
-                    CloseHandle(fd);
-                    return;
+                    platform_aligned_free(aligned_buffer);
+                    platform_close(fd);
+                    return {};
                 }
-            } while (bytes_read > 0);
+                checksum += checksum_bytes(static_cast<const char*>(aligned_buffer), bytes_read);
+                read_offset += bytes_read;
+                total_bytes += bytes_read;
+            } while (bytes_read == static_cast<SSIZE_T>(block_size)); // Короткое чтение означает конец файла
 
-            _aligned_free(aligned_buffer);
-            CloseHandle(fd);
+            platform_aligned_free(aligned_buffer);
+            platform_close(fd);
         }
 
         auto end = std::chrono::high_resolution_clock::now();
@@ -89,26 +332,444 @@ void run_benchmark(const std::string& file_path, int iterations, bool use_cache)
     std::cout << "\nOverall Stats:\n";
     std::cout << "Average read latency: " << avg_duration << " seconds\n";
     std::cout << "Minimum read latency: " << min_duration << " seconds\n";
-    std::cout << "Maximum read latency: " << max_duration << " seconds\n\n";
+    std::cout << "Maximum read latency: " << max_duration << " seconds\n";
+    const double throughput = total_bytes / std::accumulate(durations.begin(), durations.end(), 0.0) / (1024 * 1024);
+    std::cout << "Throughput (" << (!use_cache ? "direct" : mode == READ_MAPPED ? "mmap" : zero_copy ? "zero-copy" : "copy")
+              << "): " << throughput << " MB/s\n";
+    std::cout << "Checksum: " << std::hex << checksum << std::dec << "\n\n";
 
+    ReadResult result = { throughput, 0, 0 };
     if (use_cache) {
+        result.hits = lab2_get_cache_hits();
+        result.misses = lab2_get_cache_misses();
         std::cout << "Cache hits: " << lab2_get_cache_hits() << std::endl;
-        std::cout << "Cache misses: " << lab2_get_cache_misses() << std::endl << std::endl;
+        std::cout << "Cache misses: " << lab2_get_cache_misses() << std::endl;
+        std::cout << "Read-ahead hits: " << lab2_get_readahead_hits() << std::endl;
+        std::cout << "Read-ahead wasted: " << lab2_get_readahead_wasted() << std::endl << std::endl;
+        lab2_reset_cache_counters();
+    }
+    return result;
+}
+
+// Один и тот же файл через O_DIRECT, кэш и отображение; у отображения попадания — оценка по mincore
+void run_mode_comparison(const std::string& file_path, int iterations, bool zero_copy) {
+    const std::pair<ReadMode, const char*> modes[] = {
+        { READ_DIRECT, "direct" }, { READ_CACHED, "cache" }, { READ_MAPPED, "mmap" },
+    };
+    std::vector<ReadResult> results;
+    for (const auto& [mode, name] : modes) {
+        results.push_back(run_benchmark(file_path, iterations, mode, zero_copy));
+    }
+
+    std::cout << "Mode\tThroughput (MB/s)\tHits\tMisses\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::cout << modes[i].second << "\t" << results[i].throughput << "\t\t\t" << results[i].hits << "\t"
+                  << results[i].misses << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+// Много маленьких файлов с размером не кратным блоку: каждый читается целиком через свой хэндл.
+// Конец файла известен по логическому размеру, поэтому последний lab2_read диск не трогает
+void run_small_files_benchmark(const std::string& file_path, int iterations, const int file_count) {
+    const size_t block_size = lab2_get_block_size();
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<size_t> size_distribution(1, 4 * block_size);
+    std::vector<std::string> paths;
+    for (int i = 0; i < file_count; ++i) {
+        paths.push_back(file_path + ".small." + std::to_string(i));
+        std::ofstream file(paths.back(), std::ios::binary | std::ios::trunc);
+        const std::string contents(size_distribution(generator), 'S');
+        file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    }
+
+    std::vector<char> buffer(block_size);
+    std::vector<double> durations;
+    lab2_reset_cache_counters();
+    for (int i = 0; i < iterations; ++i) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (const std::string& path : paths) {
+            if (read_whole_file(path, buffer.data(), block_size) < 0) {
+                std::cerr << "Error reading " << path << " during IO benchmark!" << std::endl;
+                break;
+            }
+        }
+        durations.push_back(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+    }
+
+    const double total_time = std::accumulate(durations.begin(), durations.end(), 0.0);
+    const double files_read = static_cast<double>(file_count) * iterations;
+    std::cout << "\nSmall files: " << file_count << " x " << iterations << " passes\n";
+    std::cout << "Files per second: " << files_read / total_time << "\n";
+    std::cout << "Disk reads per file: " << lab2_get_disk_reads() / files_read << "\n";
+    std::cout << "Cache hits: " << lab2_get_cache_hits() << std::endl;
+    std::cout << "Cache misses: " << lab2_get_cache_misses() << std::endl << std::endl;
+    lab2_reset_cache_counters();
+
+    for (const std::string& path : paths) {
+        std::remove(path.c_str());
+    }
+}
+
+// Первый проход случайных чтений по горячему набору после перезапуска (lab2_init очищает кэш):
+// с холодным кэшем и после lab2_load_cache_state. Прогрев идет в фоне одновременно с проходом
+void run_warm_start_benchmark(const std::string& file_path, const Lab2Config& config, const std::string& state_path) {
+    const size_t block_size = lab2_get_block_size();
+    const HANDLE probe = lab2_open(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+    if (probe == INVALID_HANDLE_VALUE) {
+        std::cerr << "Error opening " << file_path << std::endl;
+        return;
+    }
+    const size_t file_blocks = static_cast<size_t>(lab2_lseek(probe, 0, FILE_END)) / block_size;
+    lab2_close(probe);
+
+    // Горячий набор — половина кэша из случайных блоков файла
+    const size_t capacity = config.cache_capacity ? config.cache_capacity : DEFAULT_CACHE_CAPACITY;
+    std::vector<size_t> blocks(file_blocks);
+    std::iota(blocks.begin(), blocks.end(), 0);
+    std::shuffle(blocks.begin(), blocks.end(), std::mt19937(42));
+    blocks.resize(std::min(file_blocks, capacity / block_size / 2));
+    if (blocks.empty()) {
+        std::cerr << "File is smaller than one block" << std::endl;
+        return;
+    }
+
+    std::vector<char> buffer(block_size);
+    const auto first_pass = [&](const char* name, const double load_seconds) {
+        const HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+        if (fd == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        lab2_reset_cache_counters();
+        std::vector<double> latencies;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (const size_t block : blocks) {
+            const auto read_start = std::chrono::high_resolution_clock::now();
+            lab2_pread(fd, buffer.data(), block_size, static_cast<LONGLONG>(block * block_size));
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - read_start).count());
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        lab2_close(fd);
+
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << name << "\t" << load_seconds * 1000 << "\t\t" << seconds * 1000 << "\t\t"
+                  << std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size() << "\t\t"
+                  << latencies[latencies.size() * 99 / 100] << "\t\t" << lab2_get_cache_hits() << "\t"
+                  << lab2_get_cache_misses() << std::endl;
         lab2_reset_cache_counters();
+    };
+
+    std::cout << "\nWarm start: " << blocks.size() << " random blocks\n";
+    std::cout << "Start\tLoad (ms)\tPass (ms)\tMean (us)\tp99 (us)\tHits\tMisses\n";
+    lab2_init(&config);
+    first_pass("cold", 0.0);
+    if (lab2_save_cache_state(state_path.c_str()) != 0) {
+        std::cerr << "Error saving cache state" << std::endl;
+        return;
+    }
+
+    lab2_init(&config);
+    const auto load_start = std::chrono::high_resolution_clock::now();
+    if (lab2_load_cache_state(state_path.c_str()) != 0) {
+        std::cerr << "Error loading cache state" << std::endl;
+        return;
+    }
+    first_pass("warm", std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - load_start).count());
+    std::remove(state_path.c_str());
+}
+
+// Итог одного процесса --processes: счетчики за проход случайных чтений
+struct ProcessResult {
+    unsigned long long reads;
+    unsigned long long hits;
+    unsigned long long shared_hits;
+    unsigned long long disk_reads;
+};
+
+// Процесс читает iterations * (блоков в файле) случайных блоков файла через свой кэш
+static bool run_random_reads(const std::string& file_path, const size_t file_blocks, const int iterations,
+                             const unsigned int seed, ProcessResult& result) {
+    const size_t block_size = lab2_get_block_size();
+    const HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+    if (fd == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    Lab2Stats before;
+    lab2_get_stats(&before);
+    std::vector<char> buffer(block_size);
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<size_t> block(0, file_blocks - 1);
+    for (size_t i = 0; i < file_blocks * iterations; ++i) {
+        if (lab2_pread(fd, buffer.data(), block_size, static_cast<LONGLONG>(block(generator) * block_size)) < 0) {
+            lab2_close(fd);
+            return false;
+        }
     }
+    Lab2Stats after;
+    lab2_get_stats(&after);
+    lab2_close(fd);
+
+    const auto delta = [&](const Lab2Counter counter) { return after.counters[counter] - before.counters[counter]; };
+    result.reads = file_blocks * iterations;
+    result.hits = delta(LAB2_STAT_HITS);
+    result.shared_hits = delta(LAB2_STAT_SHARED_HITS);
+    result.disk_reads = delta(LAB2_STAT_DISK_READS);
+    return true;
+}
+
+// Несколько процессов случайно читают один файл: у каждого свой кэш ёмкостью cache-size или
+// при той же общей памяти маленькие частные кэши (1/8) и общий сегмент разделяемой памяти
+// на остальное. Кэш процесса размечается уже после fork, поэтому родитель файлы не открывает
+void run_multi_process_benchmark(const std::string& file_path, int iterations, const Lab2Config& config,
+                                 const int processes) {
+#ifdef _WIN32
+    (void)file_path; (void)iterations; (void)config; (void)processes;
+    std::cerr << "--processes needs fork() and is not supported on Windows" << std::endl;
+#else
+    const size_t block_size = config.block_size ? config.block_size : DEFAULT_BLOCK_SIZE;
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    const size_t file_blocks = file ? static_cast<size_t>(file.tellg()) / block_size : 0;
+    if (file_blocks == 0 || processes <= 0) {
+        std::cerr << "File is smaller than one block or no processes requested" << std::endl;
+        return;
+    }
+
+    const size_t capacity = config.cache_capacity ? config.cache_capacity : DEFAULT_CACHE_CAPACITY;
+    const size_t total_memory = capacity * processes;
+    const size_t private_capacity = std::max(block_size, capacity / 8 / block_size * block_size);
+    const std::string segment_name = "lab2_bench_" + std::to_string(getpid());
+
+    const auto run_mode = [&](const char* mode, const Lab2Config& process_config, const size_t memory) {
+        std::cout.flush();
+        std::vector<pid_t> children;
+        std::vector<int> pipes;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (int p = 0; p < processes; ++p) {
+            int channel[2];
+            if (pipe(channel) != 0) {
+                std::cerr << "pipe failed" << std::endl;
+                break;
+            }
+            const pid_t child = fork();
+            if (child == 0) {
+                close(channel[0]);
+                ProcessResult result = {};
+                const bool ok = lab2_init(&process_config) == 0 &&
+                                run_random_reads(file_path, file_blocks, iterations, 42 + p, result);
+                if (ok) {
+                    const ssize_t written = write(channel[1], &result, sizeof(result));
+                    (void)written;
+                }
+                close(channel[1]);
+                _exit(ok ? 0 : 1);
+            }
+            close(channel[1]);
+            if (child < 0) {
+                close(channel[0]);
+                std::cerr << "fork failed" << std::endl;
+                break;
+            }
+            children.push_back(child);
+            pipes.push_back(channel[0]);
+        }
+
+        ProcessResult total = {};
+        bool failed = children.size() != static_cast<size_t>(processes);
+        for (size_t p = 0; p < children.size(); ++p) {
+            ProcessResult result = {};
+            failed = read(pipes[p], &result, sizeof(result)) != sizeof(result) || failed;
+            close(pipes[p]);
+            int status = 0;
+            waitpid(children[p], &status, 0);
+            total.reads += result.reads;
+            total.hits += result.hits;
+            total.shared_hits += result.shared_hits;
+            total.disk_reads += result.disk_reads;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        if (failed) {
+            std::cerr << "Error in " << mode << " run: a process failed" << std::endl;
+            return;
+        }
+        std::cout << mode << "\t" << processes << "\t\t" << memory / (1024 * 1024) << "\t\t"
+                  << static_cast<double>(total.hits + total.shared_hits) / total.reads << "\t\t"
+                  << total.shared_hits << "\t\t" << total.disk_reads << "\t\t"
+                  << static_cast<double>(total.reads * block_size) / seconds / (1024 * 1024) << std::endl;
+    };
+
+    std::cout << "\nProcesses: " << processes << " x " << file_blocks * iterations << " random "
+              << block_size << "-byte reads of " << file_blocks << " blocks\n";
+    std::cout << "Mode\tProcesses\tMemory (MB)\tHit ratio\tShared hits\tDisk reads\tThroughput (MB/s)\n";
+
+    Lab2Config private_config = config;
+    private_config.cache_capacity = capacity;
+    private_config.shared_cache_name = nullptr;
+    run_mode("private", private_config, total_memory);
+
+    Lab2Config shared_config = config;
+    shared_config.cache_capacity = private_capacity;
+    shared_config.shared_cache_name = segment_name.c_str();
+    if (!config.shared_cache_capacity) {
+        shared_config.shared_cache_capacity = total_memory - private_capacity * processes;
+    }
+    lab2_shared_cache_unlink(segment_name.c_str());
+    run_mode("shared", shared_config, private_capacity * processes + shared_config.shared_cache_capacity);
+    lab2_shared_cache_unlink(segment_name.c_str());
+    std::cout << std::endl;
+#endif
+}
+
+// Попадания с разных узлов NUMA: поток на узле 0 читает файл в кэш, затем читатели, закрепленные
+// по очереди за каждым узлом, случайно читают его из кэша. С --numa-policy=file весь файл в разделе
+// узла 0 и попадания остальных узлов удаленные; при чередовании по хэшу у каждого узла 1/N местных
+void run_numa_benchmark(const std::string& file_path, int iterations, const Lab2Config& config,
+                        const int threads_per_node) {
+    constexpr size_t REQUEST_SIZE = 64 * 1024;
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    const size_t requests = file ? static_cast<size_t>(file.tellg()) / REQUEST_SIZE : 0;
+    if (requests == 0 || threads_per_node <= 0) {
+        std::cerr << "File is smaller than one request or no readers requested" << std::endl;
+        return;
+    }
+    const size_t capacity = config.cache_capacity ? config.cache_capacity : DEFAULT_CACHE_CAPACITY;
+    if (requests * REQUEST_SIZE > capacity) {
+        std::cerr << "File does not fit in the cache: misses will dominate hit bandwidth" << std::endl;
+    }
+
+    const std::vector<unsigned int> nodes = platform_numa_nodes();
+    std::cout << "\nNUMA nodes: " << nodes.size() << ", " << threads_per_node << " reader(s) per node x " << requests * iterations
+              << " random " << REQUEST_SIZE / 1024 << "K reads\n";
+    std::cout << "Policy\t\tNode\tThroughput (MB/s)\tLocal hits\tRemote hits\tMisses\n";
+    for (const Lab2NumaPolicy policy : { LAB2_NUMA_INTERLEAVE, LAB2_NUMA_FILE_HOME }) {
+        const char* policy_name = policy == LAB2_NUMA_INTERLEAVE ? "interleave" : "file";
+        Lab2Config numa_config = config;
+        numa_config.numa_policy = policy;
+        if (lab2_init(&numa_config) != 0) {
+            std::cerr << "Invalid cache configuration!" << std::endl;
+            return;
+        }
+
+        // Файл открывается впервые на первом узле: с --numa-policy=file его блоки живут там
+        bool warmed = false;
+        std::thread warmer([&]() {
+            platform_pin_thread_to_node(nodes.front());
+            std::vector<char> buffer(REQUEST_SIZE);
+            warmed = read_whole_file(file_path, buffer.data(), buffer.size()) >= 0;
+        });
+        warmer.join();
+        if (!warmed) {
+            std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+            return;
+        }
+
+        for (const unsigned int node : nodes) {
+            Lab2Stats before;
+            lab2_get_stats(&before);
+            std::atomic<bool> failed{false};
+            const auto start = std::chrono::high_resolution_clock::now();
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads_per_node; ++t) {
+                workers.emplace_back([&, t]() {
+                    platform_pin_thread_to_node(node);
+                    const HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ, OPEN_EXISTING);
+                    if (fd == INVALID_HANDLE_VALUE) {
+                        failed = true;
+                        return;
+                    }
+                    std::vector<char> buffer(REQUEST_SIZE);
+                    std::mt19937 generator(static_cast<unsigned int>(node * threads_per_node + t));
+                    std::uniform_int_distribution<size_t> request(0, requests - 1);
+                    for (size_t i = 0; i < requests * iterations && !failed; ++i) {
+                        const LONGLONG offset = static_cast<LONGLONG>(request(generator) * REQUEST_SIZE);
+                        if (lab2_pread(fd, buffer.data(), REQUEST_SIZE, offset) != static_cast<SSIZE_T>(REQUEST_SIZE)) {
+                            failed = true;
+                        }
+                    }
+                    lab2_close(fd);
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            if (failed) {
+                std::cerr << "Error reading from file during IO benchmark!" << std::endl;
+                return;
+            }
+
+            Lab2Stats after;
+            lab2_get_stats(&after);
+            const auto delta = [&](const Lab2Counter counter) { return after.counters[counter] - before.counters[counter]; };
+            const double bytes = static_cast<double>(requests * iterations * threads_per_node * REQUEST_SIZE);
+            std::cout << policy_name << "\t" << (policy == LAB2_NUMA_INTERLEAVE ? "" : "\t") << node << "\t"
+                      << bytes / seconds / (1024 * 1024) << "\t\t\t" << delta(LAB2_STAT_NUMA_LOCAL_HITS) << "\t\t"
+                      << delta(LAB2_STAT_NUMA_REMOTE_HITS) << "\t\t" << delta(LAB2_STAT_MISSES) << std::endl;
+        }
+    }
+    std::cout << std::endl;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " <file_path> <iterations> <use_cache>" << std::endl;
+    std::vector<std::string> args;
+    Lab2Config config = {};
+    BenchmarkFlags flags;
+    if (!parse_benchmark_args(argc, argv, args, config, &flags, { "threads", "zero-copy", "sweep", "async", "qd", "compare", "small-files", "warm-start", "processes", "numa" }) || args.size() < 3) {
+        std::cerr << "Usage: " << argv[0] << " <file_path> <iterations> <mode: 0 direct, 1 cache, 2 mmap> [--threads=N] [--zero-copy] [--sweep] [--async] [--qd=N] [--compare] [--small-files=N] [--warm-start[=STATE_FILE]] [--processes=N] [--numa[=THREADS_PER_NODE]] " CACHE_FLAGS_USAGE " " STATS_FLAGS_USAGE << std::endl;
         return 1;
     }
 
-    std::string file_path = argv[1];
-    int iterations = std::stoi(argv[2]);
-    bool use_cache = std::stoi(argv[3]) != 0;
+    if (lab2_init(&config) != 0) {
+        std::cerr << "Invalid cache configuration!" << std::endl;
+        return 1;
+    }
+
+    const StatsDumper stats_dumper(flags);
+    std::string file_path = args[0];
+    int iterations = std::stoi(args[1]);
+    const ReadMode mode = static_cast<ReadMode>(std::stoi(args[2]));
+
+    if (flags.count("threads")) {
+        run_threaded_benchmark(file_path, iterations, std::stoi(flags["threads"]));
+        return 0;
+    }
+
+    if (flags.count("sweep")) {
+        run_request_size_sweep(file_path, iterations, config);
+        return 0;
+    }
+
+    if (flags.count("async") || flags.count("qd")) {
+        const std::vector<int> depths = flags.count("qd") ? std::vector<int>{ std::stoi(flags["qd"]) } : std::vector<int>{ 1, 8, 32, 128 };
+        run_queue_depth_benchmark(file_path, iterations, config, depths);
+        return 0;
+    }
+
+    if (flags.count("small-files")) {
+        run_small_files_benchmark(file_path, iterations, std::stoi(flags["small-files"]));
+        return 0;
+    }
+
+    if (flags.count("processes")) {
+        run_multi_process_benchmark(file_path, iterations, config, std::stoi(flags["processes"]));
+        return 0;
+    }
+
+    if (flags.count("numa")) {
+        run_numa_benchmark(file_path, iterations, config, std::stoi(flags["numa"]));
+        return 0;
+    }
+
+    if (flags.count("warm-start")) {
+        run_warm_start_benchmark(file_path, config, flags["warm-start"] == "1" ? file_path + ".state" : flags["warm-start"]);
+        return 0;
+    }
+
+    if (flags.count("compare")) {
+        run_mode_comparison(file_path, iterations, flags.count("zero-copy") != 0);
+        return 0;
+    }
 
-    run_benchmark(file_path, iterations, use_cache);
+    run_benchmark(file_path, iterations, mode, flags.count("zero-copy") != 0);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,514 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <numeric>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include "cache.hpp"
+#include "bench-config.hpp"
+#include "bench-stats.hpp"
+
+// Трасса в формате src/trace.hpp: ее пишет lab2_trace_start (флаг --record у любого бенчмарка)
+// или генератор ниже
+enum TraceOperation { OP_OPEN, OP_CLOSE, OP_READ, OP_PREAD, OP_WRITE, OP_PWRITE, OP_LSEEK, OP_FSYNC, OP_FDATASYNC };
+
+struct TraceRecord {
+    LONGLONG time_us;
+    TraceOperation operation;
+    unsigned long file;
+    LONGLONG first; // count у read/write, offset у pread/pwrite/lseek; access_mode у open
+    LONGLONG second; // count у pread/pwrite, whence у lseek; creation_disposition у open
+    std::string path;
+};
+
+static bool parse_operation(const std::string& name, TraceOperation& operation) {
+    static const std::unordered_map<std::string, TraceOperation> operations = {
+        { "open", OP_OPEN }, { "close", OP_CLOSE }, { "read", OP_READ }, { "pread", OP_PREAD },
+        { "write", OP_WRITE }, { "pwrite", OP_PWRITE }, { "lseek", OP_LSEEK }, { "fsync", OP_FSYNC },
+        { "fdatasync", OP_FDATASYNC },
+    };
+    const auto iterator = operations.find(name);
+    if (iterator == operations.end()) {
+        return false;
+    }
+    operation = iterator->second;
+    return true;
+}
+
+static bool load_trace(const std::string& trace_path, std::vector<TraceRecord>& trace) {
+    std::ifstream input(trace_path);
+    if (!input) {
+        std::cerr << "Cannot open trace " << trace_path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(input, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        TraceRecord record = {};
+        std::string name;
+        fields >> record.time_us >> name >> record.file;
+        bool parsed = fields && parse_operation(name, record.operation);
+        if (parsed) {
+            switch (record.operation) {
+                case OP_OPEN:
+                    fields >> record.first >> record.second;
+                    std::getline(fields >> std::ws, record.path);
+                    parsed = fields && !record.path.empty();
+                    break;
+                case OP_READ:
+                case OP_WRITE:
+                    parsed = static_cast<bool>(fields >> record.first);
+                    break;
+                case OP_PREAD:
+                case OP_PWRITE:
+                case OP_LSEEK:
+                    parsed = static_cast<bool>(fields >> record.first >> record.second);
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (!parsed) {
+            std::cerr << "Bad trace line " << line_number << ": " << line << std::endl;
+            return false;
+        }
+        trace.push_back(std::move(record));
+    }
+    return true;
+}
+
+// Куда воспроизводится трасса: кэш или O_DIRECT без кэша
+class ReplayTarget {
+public:
+    virtual ~ReplayTarget() = default;
+    virtual HANDLE open(const char* path, DWORD access_mode, DWORD creation_disposition) = 0;
+    virtual void close(HANDLE file_handle) = 0;
+    virtual SSIZE_T pread(HANDLE file_handle, char* buffer, size_t count, LONGLONG offset) = 0;
+    virtual SSIZE_T pwrite(HANDLE file_handle, const char* buffer, size_t count, LONGLONG offset) = 0;
+    virtual LONGLONG file_size(HANDLE file_handle) = 0;
+    virtual int fsync(HANDLE file_handle) = 0;
+    virtual int fdatasync(HANDLE file_handle) = 0;
+};
+
+class CacheTarget : public ReplayTarget {
+public:
+    HANDLE open(const char* path, const DWORD access_mode, const DWORD creation_disposition) override {
+        return lab2_open(path, access_mode, creation_disposition);
+    }
+    void close(const HANDLE file_handle) override { lab2_close(file_handle); }
+    SSIZE_T pread(const HANDLE file_handle, char* buffer, const size_t count, const LONGLONG offset) override {
+        return lab2_pread(file_handle, buffer, count, offset);
+    }
+    SSIZE_T pwrite(const HANDLE file_handle, const char* buffer, const size_t count, const LONGLONG offset) override {
+        return lab2_pwrite(file_handle, buffer, count, offset);
+    }
+    LONGLONG file_size(const HANDLE file_handle) override { return lab2_lseek(file_handle, 0, FILE_END); }
+    int fsync(const HANDLE file_handle) override { return lab2_fsync(file_handle); }
+    int fdatasync(const HANDLE file_handle) override { return lab2_fdatasync(file_handle); }
+};
+
+// O_DIRECT требует выравнивания, поэтому запрос расширяется до границ блока: чтение через
+// выровненный буфер, частичная запись — чтение-изменение-запись. Так платит приложение без кэша
+class DirectTarget : public ReplayTarget {
+public:
+    explicit DirectTarget(const size_t alignment) : alignment(alignment) {}
+
+    ~DirectTarget() override {
+        platform_aligned_free(buffer);
+    }
+
+    HANDLE open(const char* path, const DWORD access_mode, const DWORD creation_disposition) override {
+        return platform_open_direct(path, access_mode & ~LAB2_OPEN_MAPPED, creation_disposition);
+    }
+    void close(const HANDLE file_handle) override {
+        platform_flush(file_handle);
+        platform_close(file_handle);
+    }
+
+    SSIZE_T pread(const HANDLE file_handle, char* target, const size_t count, const LONGLONG offset) override {
+        const LONGLONG begin = offset / alignment * alignment;
+        const size_t length = align_up(static_cast<size_t>(offset - begin) + count);
+        if (!reserve(length)) {
+            return -1;
+        }
+        const SSIZE_T bytes_read = platform_pread(file_handle, buffer, length, begin);
+        if (bytes_read < 0) {
+            return -1;
+        }
+        const size_t skip = static_cast<size_t>(offset - begin);
+        const size_t copied = static_cast<size_t>(bytes_read) > skip ? std::min(count, static_cast<size_t>(bytes_read) - skip) : 0;
+        std::memcpy(target, buffer + skip, copied);
+        return static_cast<SSIZE_T>(copied);
+    }
+
+    SSIZE_T pwrite(const HANDLE file_handle, const char* source, const size_t count, const LONGLONG offset) override {
+        const LONGLONG begin = offset / alignment * alignment;
+        const size_t skip = static_cast<size_t>(offset - begin);
+        const size_t length = align_up(skip + count);
+        if (!reserve(length)) {
+            return -1;
+        }
+        if (skip != 0 || length != count) {
+            const SSIZE_T bytes_read = platform_pread(file_handle, buffer, length, begin);
+            if (bytes_read < 0) {
+                return -1;
+            }
+            std::memset(buffer + bytes_read, 0, length - static_cast<size_t>(bytes_read));
+        }
+        std::memcpy(buffer + skip, source, count);
+        return platform_pwrite(file_handle, buffer, length, begin) < 0 ? -1 : static_cast<SSIZE_T>(count);
+    }
+
+    LONGLONG file_size(const HANDLE file_handle) override { return platform_get_file_size(file_handle); }
+    int fsync(const HANDLE file_handle) override { return platform_flush(file_handle); }
+    int fdatasync(const HANDLE file_handle) override { return platform_flush_data(file_handle); }
+
+private:
+    size_t align_up(const size_t size) const {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    bool reserve(const size_t size) {
+        if (size <= capacity) {
+            return true;
+        }
+        platform_aligned_free(buffer);
+        buffer = static_cast<char*>(platform_aligned_alloc(size, alignment));
+        capacity = buffer ? size : 0;
+        if (!buffer) {
+            std::cerr << "Error allocating aligned buffer!" << std::endl;
+        }
+        return buffer != nullptr;
+    }
+
+    const size_t alignment;
+    char* buffer = nullptr;
+    size_t capacity = 0;
+};
+
+// Перцентиль по отсортированной копии выборки
+static double percentile(std::vector<double> samples, const double fraction) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    const size_t position = static_cast<size_t>(fraction * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + position, samples.end());
+    return samples[position];
+}
+
+static void print_latency_json(const char* name, const std::vector<double>& samples) {
+    std::cout << ",\"" << name << "\":{\"count\":" << samples.size();
+    for (const auto& [label, fraction] : { std::make_pair("p50", 0.5), std::make_pair("p90", 0.9),
+                                           std::make_pair("p99", 0.99), std::make_pair("p999", 0.999) }) {
+        std::cout << ",\"" << label << "\":" << percentile(samples, fraction);
+    }
+    std::cout << "}";
+}
+
+struct FileState {
+    HANDLE handle;
+    LONGLONG offset; // Позиция для read/write/lseek без явного смещения
+};
+
+// Проигрывает трассу по порядку в одном потоке. С timed каждая операция ждет своего времени
+// из трассы, иначе операции идут без пауз
+static bool replay_trace(const std::vector<TraceRecord>& trace, ReplayTarget& target, const char* target_name,
+                         const bool timed) {
+    size_t max_request = 1;
+    for (const TraceRecord& record : trace) {
+        if (record.operation == OP_READ || record.operation == OP_WRITE) {
+            max_request = std::max(max_request, static_cast<size_t>(record.first));
+        } else if (record.operation == OP_PREAD || record.operation == OP_PWRITE) {
+            max_request = std::max(max_request, static_cast<size_t>(record.second));
+        }
+    }
+    std::vector<char> buffer(max_request, 'T');
+    std::unordered_map<unsigned long, FileState> files;
+    std::vector<double> read_latencies;
+    std::vector<double> write_latencies;
+    size_t bytes_read = 0;
+    size_t bytes_written = 0;
+    size_t errors = 0;
+
+    lab2_reset_cache_counters();
+    const auto start = std::chrono::steady_clock::now();
+    for (const TraceRecord& record : trace) {
+        if (timed) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(record.time_us));
+        }
+        if (record.operation == OP_OPEN) {
+            const HANDLE handle = target.open(record.path.c_str(), static_cast<DWORD>(record.first), static_cast<DWORD>(record.second));
+            if (handle == INVALID_HANDLE_VALUE) {
+                std::cerr << "Cannot open " << record.path << " during replay" << std::endl;
+                return false;
+            }
+            files[record.file] = { handle, 0 };
+            continue;
+        }
+
+        const auto file = files.find(record.file);
+        if (file == files.end()) {
+            errors++; // Открытие не попало в трассу
+            continue;
+        }
+        FileState& state = file->second;
+        const auto call_start = std::chrono::steady_clock::now();
+        switch (record.operation) {
+            case OP_READ:
+            case OP_PREAD: {
+                const bool positional = record.operation == OP_PREAD;
+                const size_t count = static_cast<size_t>(positional ? record.second : record.first);
+                const SSIZE_T result = target.pread(state.handle, buffer.data(), count, positional ? record.first : state.offset);
+                read_latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - call_start).count());
+                if (result < 0) {
+                    errors++;
+                    break;
+                }
+                bytes_read += static_cast<size_t>(result);
+                if (!positional) {
+                    state.offset += result;
+                }
+                break;
+            }
+            case OP_WRITE:
+            case OP_PWRITE: {
+                const bool positional = record.operation == OP_PWRITE;
+                const size_t count = static_cast<size_t>(positional ? record.second : record.first);
+                const SSIZE_T result = target.pwrite(state.handle, buffer.data(), count, positional ? record.first : state.offset);
+                write_latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - call_start).count());
+                if (result < 0) {
+                    errors++;
+                    break;
+                }
+                bytes_written += static_cast<size_t>(result);
+                if (!positional) {
+                    state.offset += result;
+                }
+                break;
+            }
+            case OP_LSEEK: {
+                const LONGLONG base = record.second == FILE_CURRENT ? state.offset :
+                                      record.second == FILE_END ? target.file_size(state.handle) : 0;
+                state.offset = std::max<LONGLONG>(base + record.first, 0);
+                break;
+            }
+            case OP_FSYNC:
+                if (target.fsync(state.handle) != 0) {
+                    errors++;
+                }
+                break;
+            case OP_FDATASYNC:
+                if (target.fdatasync(state.handle) != 0) {
+                    errors++;
+                }
+                break;
+            case OP_CLOSE:
+                target.close(state.handle);
+                files.erase(file);
+                break;
+            default:
+                break;
+        }
+    }
+    for (const auto& [file, state] : files) {
+        target.close(state.handle); // Трасса записана до закрытия всех файлов
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const size_t operations = read_latencies.size() + write_latencies.size();
+    const double hits = static_cast<double>(lab2_get_cache_hits());
+    const double misses = static_cast<double>(lab2_get_cache_misses());
+    std::cout << "{\"target\":\"" << target_name << "\",\"timed\":" << (timed ? "true" : "false")
+              << ",\"operations\":" << operations << ",\"errors\":" << errors << ",\"seconds\":" << seconds
+              << ",\"ops_per_sec\":" << operations / seconds
+              << ",\"mb_per_sec\":" << (bytes_read + bytes_written) / seconds / (1024 * 1024)
+              << ",\"bytes_read\":" << bytes_read << ",\"bytes_written\":" << bytes_written
+              << ",\"hit_ratio\":";
+    if (hits + misses > 0) {
+        std::cout << hits / (hits + misses);
+    } else {
+        std::cout << "null";
+    }
+    print_latency_json("read_latency_us", read_latencies);
+    print_latency_json("write_latency_us", write_latencies);
+    std::cout << "}" << std::endl;
+    lab2_reset_cache_counters();
+    return true;
+}
+
+// Выбор номера запроса в файле по заданному распределению
+class AccessPattern {
+public:
+    AccessPattern(BenchmarkFlags& flags, const size_t items, const uint64_t seed) : items(items), random(seed) {
+        const std::string pattern = flags.count("pattern") ? flags["pattern"] : "uniform";
+        // Перестановка разносит горячие номера по файлу, чтобы горячий набор не был одним непрерывным участком
+        permutation.resize(items);
+        std::iota(permutation.begin(), permutation.end(), 0);
+        std::shuffle(permutation.begin(), permutation.end(), random);
+
+        if (pattern == "zipf") {
+            const double theta = flags.count("zipf-theta") ? std::stod(flags["zipf-theta"]) : 0.99;
+            cumulative.resize(items);
+            double sum = 0.0;
+            for (size_t rank = 0; rank < items; ++rank) {
+                sum += 1.0 / std::pow(static_cast<double>(rank + 1), theta);
+                cumulative[rank] = sum;
+            }
+            kind = ZIPF;
+        } else if (pattern == "hotcold") {
+            const double hot_fraction = (flags.count("hot-fraction") ? std::stod(flags["hot-fraction"]) : 20.0) / 100.0;
+            hot_items = std::min(std::max<size_t>(static_cast<size_t>(items * hot_fraction), 1), items);
+            hot_access = (flags.count("hot-access") ? std::stod(flags["hot-access"]) : 80.0) / 100.0;
+            kind = HOT_COLD;
+        } else if (pattern != "uniform") {
+            throw std::invalid_argument("unknown pattern: " + pattern);
+        }
+    }
+
+    size_t next() {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        switch (kind) {
+            case ZIPF: {
+                const double target = unit(random) * cumulative.back();
+                const size_t rank = static_cast<size_t>(std::lower_bound(cumulative.begin(), cumulative.end(), target) - cumulative.begin());
+                return permutation[std::min(rank, items - 1)];
+            }
+            case HOT_COLD:
+                if (hot_items == items || unit(random) < hot_access) {
+                    return permutation[std::uniform_int_distribution<size_t>(0, hot_items - 1)(random)];
+                }
+                return permutation[std::uniform_int_distribution<size_t>(hot_items, items - 1)(random)];
+            default:
+                return std::uniform_int_distribution<size_t>(0, items - 1)(random);
+        }
+    }
+
+    std::mt19937_64& generator() { return random; }
+
+private:
+    enum Kind { UNIFORM, ZIPF, HOT_COLD };
+
+    Kind kind = UNIFORM;
+    const size_t items;
+    std::mt19937_64 random;
+    std::vector<size_t> permutation;
+    std::vector<double> cumulative;
+    size_t hot_items = 0;
+    double hot_access = 0.0;
+};
+
+// Синтетическая трасса по одному файлу данных; файл создается нужного размера, если он меньше
+static bool generate_trace(const std::string& trace_path, const std::string& data_path, BenchmarkFlags& flags) {
+    const size_t file_size = flags.count("file-size") ? parse_size(flags["file-size"]) : 64 << 20;
+    const size_t request_size = flags.count("request-size") ? parse_size(flags["request-size"]) : lab2_get_block_size();
+    const size_t operations = flags.count("ops") ? std::stoull(flags["ops"]) : 100000;
+    const double read_ratio = (flags.count("read-ratio") ? std::stod(flags["read-ratio"]) : 70.0) / 100.0;
+    const double rate = flags.count("rate") ? std::stod(flags["rate"]) : 0.0; // Операций в секунду; 0 — без пауз
+    const size_t fsync_every = flags.count("fsync-every") ? std::stoull(flags["fsync-every"]) : 0; // Через сколько записей fsync
+    const uint64_t seed = flags.count("seed") ? std::stoull(flags["seed"]) : 1;
+    if (request_size == 0 || file_size < request_size) {
+        std::cerr << "File size must be at least one request" << std::endl;
+        return false;
+    }
+
+    {
+        std::ifstream existing(data_path, std::ios::binary | std::ios::ate);
+        if (!existing || static_cast<size_t>(existing.tellg()) < file_size) {
+            std::ofstream data(data_path, std::ios::binary | std::ios::trunc);
+            const std::vector<char> chunk(1 << 20, 'D');
+            for (size_t written = 0; written < file_size && data; written += chunk.size()) {
+                data.write(chunk.data(), static_cast<std::streamsize>(std::min(chunk.size(), file_size - written)));
+            }
+            if (!data) {
+                std::cerr << "Cannot create data file " << data_path << std::endl;
+                return false;
+            }
+        }
+    }
+
+    std::ofstream output(trace_path, std::ios::trunc);
+    if (!output) {
+        std::cerr << "Cannot create trace " << trace_path << std::endl;
+        return false;
+    }
+    AccessPattern pattern(flags, file_size / request_size, seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    output << "# lab2 trace v1, synthetic: " << (flags.count("pattern") ? flags["pattern"] : "uniform") << "\n";
+    output << "0 open 0 " << (GENERIC_READ | GENERIC_WRITE) << " " << OPEN_EXISTING << " " << data_path << "\n";
+    size_t writes = 0;
+    LONGLONG time_us = 0;
+    for (size_t i = 0; i < operations; ++i) {
+        time_us = rate > 0 ? static_cast<LONGLONG>(i * 1e6 / rate) : 0;
+        const LONGLONG offset = static_cast<LONGLONG>(pattern.next() * request_size);
+        const bool read = unit(pattern.generator()) < read_ratio;
+        output << time_us << (read ? " pread 0 " : " pwrite 0 ") << offset << " " << request_size << "\n";
+        if (!read && fsync_every > 0 && ++writes % fsync_every == 0) {
+            output << time_us << " fsync 0\n";
+        }
+    }
+    output << time_us << " close 0\n";
+    return static_cast<bool>(output);
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args;
+    Lab2Config config = {};
+    BenchmarkFlags flags;
+    const std::vector<std::string> own_flags = {
+        "target", "timed", "pattern", "ops", "file-size", "request-size", "read-ratio", "zipf-theta",
+        "hot-fraction", "hot-access", "rate", "fsync-every", "seed",
+    };
+    if (!parse_benchmark_args(argc, argv, args, config, &flags, own_flags) || args.size() < 2 ||
+        (args[0] == "generate" && args.size() < 3) || (args[0] != "generate" && args[0] != "replay")) {
+        std::cerr << "Usage: " << argv[0] << " generate <trace> <data_file> [--pattern=uniform|zipf|hotcold] [--ops=N] "
+                  "[--file-size=BYTES] [--request-size=BYTES] [--read-ratio=PCT] [--zipf-theta=X] [--hot-fraction=PCT] "
+                  "[--hot-access=PCT] [--rate=OPS_PER_SEC] [--fsync-every=WRITES] [--seed=N]\n"
+                  "       " << argv[0] << " replay <trace> [--target=cache|direct|both] [--timed] "
+                  CACHE_FLAGS_USAGE " " STATS_FLAGS_USAGE << std::endl;
+        return 1;
+    }
+
+    if (lab2_init(&config) != 0) {
+        std::cerr << "Invalid cache configuration!" << std::endl;
+        return 1;
+    }
+    const StatsDumper stats_dumper(flags);
+
+    if (args[0] == "generate") {
+        return generate_trace(args[1], args[2], flags) ? 0 : 1;
+    }
+
+    std::vector<TraceRecord> trace;
+    if (!load_trace(args[1], trace)) {
+        return 1;
+    }
+    const std::string target = flags.count("target") ? flags["target"] : "cache";
+    const bool timed = flags.count("timed") != 0;
+    if (target == "cache" || target == "both") {
+        CacheTarget cache;
+        if (!replay_trace(trace, cache, "cache", timed)) {
+            return 1;
+        }
+    }
+    if (target == "direct" || target == "both") {
+        DirectTarget direct(lab2_get_block_size());
+        if (!replay_trace(trace, direct, "direct", timed)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -3,33 +3,41 @@
 #include <chrono>
 #include <vector>
 #include <numeric>
-#include <windows.h>
-#include <BaseTsd.h> // Для SSIZE_T
 #include <cstring>
 #include <string>
+#include <thread>
+#include <atomic>
 #include "cache.hpp"
+#include "bench-config.hpp"
+#include "bench-stats.hpp"
 
-constexpr size_t FILE_SIZE = 1024 * 1024 * 1;
+constexpr size_t DEFAULT_FILE_SIZE = 1024 * 1024 * 1;
 
-void run_benchmark(const std::string& file_path, int iterations, bool use_cache) {
-    std::vector<char> buffer(BLOCK_SIZE, 'A');
+// Перцентиль по отсортированной копии выборки
+double percentile(std::vector<double> samples, const double fraction) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    const size_t position = static_cast<size_t>(fraction * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + position, samples.end());
+    return samples[position];
+}
+
+void run_benchmark(const std::string& file_path, int iterations, bool use_cache, const size_t file_size) {
+    const size_t block_size = lab2_get_block_size();
+    std::vector<char> buffer(block_size, 'A');
     std::vector<double> durations;
     durations.reserve(iterations);
+    // Время отдельных вызовов записи: хвост показывает, ждет ли запись диска при вытеснении
+    std::vector<double> call_durations;
+    call_durations.reserve(iterations * (file_size / block_size));
 
     // Создаем файл один раз перед началом теста
     HANDLE fd;
     if (use_cache) {
         fd = lab2_open(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, CREATE_ALWAYS);
     } else {
-        fd = CreateFileA(
-            file_path.c_str(),
-            GENERIC_READ | GENERIC_WRITE,
-            FILE_SHARE_READ | FILE_SHARE_WRITE,
-            nullptr,
-            CREATE_ALWAYS,
-            FILE_FLAG_NO_BUFFERING, // Отключение кэширования ОС
-            nullptr
-        );
+        fd = platform_open_direct(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, CREATE_ALWAYS);
     }
 
     if (fd == INVALID_HANDLE_VALUE) {
@@ -41,7 +49,7 @@ void run_benchmark(const std::string& file_path, int iterations, bool use_cache)
     if (use_cache) {
         lab2_close(fd);
     } else {
-        CloseHandle(fd);
+        platform_close(fd);
     }
 
     for (int i = 0; i < iterations; ++i) {
@@ -55,9 +63,11 @@ void run_benchmark(const std::string& file_path, int iterations, bool use_cache)
                 return;
             }
             
-            for (size_t written = 0; written < FILE_SIZE; written += BLOCK_SIZE) {
-                SSIZE_T ret = lab2_write(fd, buffer.data(), BLOCK_SIZE);
-                if (ret != static_cast<SSIZE_T>(BLOCK_SIZE)) {
+            for (size_t written = 0; written < file_size; written += block_size) {
+                const auto call_start = std::chrono::high_resolution_clock::now();
+                SSIZE_T ret = lab2_write(fd, buffer.data(), block_size);
+                call_durations.push_back(std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - call_start).count());
+                if (ret != static_cast<SSIZE_T>(block_size)) {
                     std::cerr << "Error writing to file during IO benchmark!" << std::endl;
                     lab2_close(fd);
                     return;
@@ -67,15 +77,7 @@ void run_benchmark(const std::string& file_path, int iterations, bool use_cache)
             lab2_close(fd);
         } else {
             // Открываем файл для записи
-            fd = CreateFileA(
-                file_path.c_str(),
-                GENERIC_READ | GENERIC_WRITE,
-                FILE_SHARE_READ | FILE_SHARE_WRITE,
-                nullptr,
-                OPEN_EXISTING,
-                FILE_FLAG_NO_BUFFERING, // Отключение кэширования ОС
-                nullptr
-            );
+            fd = platform_open_direct(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, OPEN_EXISTING);
 
             if (fd == INVALID_HANDLE_VALUE) {
                 std::cerr << "Error opening file for IO benchmark!" << std::endl;
@@ -83,27 +85,29 @@ void run_benchmark(const std::string& file_path, int iterations, bool use_cache)
             }
 
             // Выделение выровненной памяти
-            void* aligned_buffer = _aligned_malloc(BLOCK_SIZE, BLOCK_SIZE);
+            void* aligned_buffer = platform_aligned_alloc(block_size, block_size);
             if (!aligned_buffer) {
                 std::cerr << "Error allocating aligned buffer!" << std::endl;
-                CloseHandle(fd);
+                platform_close(fd);
                 return;
             }
-            std::memset(aligned_buffer, 'A', BLOCK_SIZE);
+            std::memset(aligned_buffer, 'A', block_size);
 
-            for (size_t written = 0; written < FILE_SIZE; written += BLOCK_SIZE) {
-                DWORD bytes_written;
-                if (!WriteFile(fd, aligned_buffer, BLOCK_SIZE, &bytes_written, nullptr)) {
+            for (size_t written = 0; written < file_size; written += block_size) {
+                const auto call_start = std::chrono::high_resolution_clock::now();
+                const SSIZE_T ret = platform_pwrite(fd, aligned_buffer, block_size, static_cast<LONGLONG>(written));
+                call_durations.push_back(std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - call_start).count());
+                if (ret < 0) {
                     std::cerr << "Error writing to file during IO benchmark!" << std::endl;
-                    _aligned_free(aligned_buffer);
-                    CloseHandle(fd);
+                    platform_aligned_free(aligned_buffer);
+                    platform_close(fd);
                     return;
                 }
             }
 
-            FlushFileBuffers(fd); // Синхронизация данных с диском
-            _aligned_free(aligned_buffer);
-            CloseHandle(fd);
+            platform_flush(fd); // Синхронизация данных с диском
+            platform_aligned_free(aligned_buffer);
+            platform_close(fd);
         }
 
         auto end = std::chrono::high_resolution_clock::now();
@@ -118,26 +122,190 @@ void run_benchmark(const std::string& file_path, int iterations, bool use_cache)
     std::cout << "\nOverall Stats:\n";
     std::cout << "Average write latency: " << avg_duration << " seconds\n";
     std::cout << "Minimum write latency: " << min_duration << " seconds\n";
-    std::cout << "Maximum write latency: " << max_duration << " seconds\n\n";
+    std::cout << "Maximum write latency: " << max_duration << " seconds\n";
+    std::cout << "p50 write call latency: " << percentile(call_durations, 0.50) << " us\n";
+    std::cout << "p99 write call latency: " << percentile(call_durations, 0.99) << " us\n\n";
 
     if (use_cache) {
+        Lab2Stats stats;
+        lab2_get_stats(&stats);
         std::cout << "Cache hits: " << lab2_get_cache_hits() << std::endl;
-        std::cout << "Cache misses: " << lab2_get_cache_misses() << std::endl << std::endl;
+        std::cout << "Cache misses: " << lab2_get_cache_misses() << std::endl;
+        std::cout << "Disk reads: " << lab2_get_disk_reads() << std::endl;
+        std::cout << "Fsync write calls: " << lab2_get_fsync_write_ios() << std::endl;
+        std::cout << "Fsync written bytes: " << lab2_get_fsync_write_bytes() << std::endl;
+        std::cout << "Device flushes: " << stats.counters[LAB2_STAT_SYNC_FLUSHES] << std::endl << std::endl;
         lab2_reset_cache_counters();
     }
 }
 
+// Групповая фиксация: N потоков пишут каждый свой блок одного файла через свой хэндл и после
+// каждой записи вызывают lab2_fsync (или lab2_fdatasync). Без кэша каждый поток делает pwrite
+// и свой fsync. Сбросов на устройство с кэшем меньше, чем вызовов: одновременные вызовы
+// фиксируются одним сбросом
+void run_group_commit_benchmark(const std::string& file_path, int iterations, bool use_cache, const int max_writers,
+                                const bool datasync) {
+    const size_t block_size = lab2_get_block_size();
+    HANDLE fd = use_cache ? lab2_open(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, CREATE_ALWAYS) :
+                            platform_open_direct(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, CREATE_ALWAYS);
+    if (fd == INVALID_HANDLE_VALUE) {
+        std::cerr << "Error opening file for IO benchmark!" << std::endl;
+        return;
+    }
+    if (use_cache) {
+        lab2_close(fd);
+    } else {
+        platform_close(fd);
+    }
+
+    std::cout << "\nGroup commit: " << iterations << " " << (datasync ? "fdatasync" : "fsync") << " calls per writer, "
+              << (use_cache ? "cache" : "direct") << "\n";
+    std::cout << "Writers\tSyncs/s\t\tDevice flushes\tSyncs per flush\tp50 (us)\tp99 (us)\n";
+    for (int writers = 1; writers <= max_writers; writers *= 2) {
+        std::vector<std::vector<double>> latencies(writers);
+        std::atomic<bool> failed{false};
+        Lab2Stats before;
+        lab2_get_stats(&before);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (int w = 0; w < writers; ++w) {
+            threads.emplace_back([&, w]() {
+                const HANDLE handle = use_cache ? lab2_open(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, OPEN_EXISTING) :
+                                                  platform_open_direct(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, OPEN_EXISTING);
+                char* buffer = static_cast<char*>(platform_aligned_alloc(block_size, block_size));
+                if (handle == INVALID_HANDLE_VALUE || !buffer) {
+                    failed = true;
+                    return;
+                }
+                const LONGLONG offset = static_cast<LONGLONG>(w * block_size);
+                for (int i = 0; i < iterations && !failed; ++i) {
+                    std::memset(buffer, 'a' + i % 26, block_size);
+                    const auto call_start = std::chrono::high_resolution_clock::now();
+                    const bool ok = use_cache ?
+                        lab2_pwrite(handle, buffer, block_size, offset) == static_cast<SSIZE_T>(block_size) &&
+                        (datasync ? lab2_fdatasync(handle) : lab2_fsync(handle)) == 0 :
+                        platform_pwrite(handle, buffer, block_size, offset) == static_cast<SSIZE_T>(block_size) &&
+                        (datasync ? platform_flush_data(handle) : platform_flush(handle)) == 0;
+                    latencies[w].push_back(std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - call_start).count());
+                    failed = failed || !ok;
+                }
+                platform_aligned_free(buffer);
+                if (use_cache) {
+                    lab2_close(handle);
+                } else {
+                    platform_close(handle);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        if (failed) {
+            std::cerr << "Error writing to file during IO benchmark!" << std::endl;
+            return;
+        }
+
+        Lab2Stats after;
+        lab2_get_stats(&after);
+        const double calls = static_cast<double>(writers) * iterations;
+        // Без кэша сброс на каждый вызов; с кэшем в счет входит и фиксация при закрытии последнего хэндла
+        const unsigned long long flushes = use_cache ?
+            after.counters[LAB2_STAT_SYNC_FLUSHES] - before.counters[LAB2_STAT_SYNC_FLUSHES] : static_cast<unsigned long long>(calls);
+        std::vector<double> all;
+        for (const auto& samples : latencies) {
+            all.insert(all.end(), samples.begin(), samples.end());
+        }
+        std::cout << writers << "\t" << calls / seconds << "\t\t" << flushes << "\t\t" << calls / flushes << "\t\t"
+                  << percentile(all, 0.50) << "\t\t" << percentile(all, 0.99) << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+// Сотни дескрипторов одного файла: каждый пишет свой блок. Закрытие пишет грязные блоки,
+// только если это последний записывающий дескриптор файла
+void run_shared_handles_benchmark(const std::string& file_path, int iterations, const size_t handle_count) {
+    const size_t block_size = lab2_get_block_size();
+    std::vector<char> buffer(block_size, 'H');
+    HANDLE fd = lab2_open(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, CREATE_ALWAYS);
+    if (fd == INVALID_HANDLE_VALUE) {
+        std::cerr << "Error opening file for IO benchmark!" << std::endl;
+        return;
+    }
+    lab2_close(fd);
+
+    std::vector<HANDLE> handles(handle_count);
+    std::vector<double> open_durations;
+    std::vector<double> close_durations;
+    lab2_reset_cache_counters();
+    for (int i = 0; i < iterations; ++i) {
+        for (size_t h = 0; h < handle_count; ++h) {
+            const auto call_start = std::chrono::high_resolution_clock::now();
+            handles[h] = lab2_open(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, OPEN_EXISTING);
+            open_durations.push_back(std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - call_start).count());
+            if (handles[h] == INVALID_HANDLE_VALUE) {
+                std::cerr << "Error opening file for IO benchmark!" << std::endl;
+                return;
+            }
+        }
+
+        for (size_t h = 0; h < handle_count; ++h) {
+            if (lab2_pwrite(handles[h], buffer.data(), block_size, static_cast<LONGLONG>(h * block_size)) != static_cast<SSIZE_T>(block_size)) {
+                std::cerr << "Error writing to file during IO benchmark!" << std::endl;
+                return;
+            }
+        }
+
+        for (size_t h = 0; h < handle_count; ++h) {
+            const auto call_start = std::chrono::high_resolution_clock::now();
+            lab2_close(handles[h]);
+            close_durations.push_back(std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - call_start).count());
+        }
+    }
+
+    std::cout << "\nShared file: " << handle_count << " handles x " << iterations << " iterations\n";
+    std::cout << "p50 open latency: " << percentile(open_durations, 0.50) << " us\n";
+    std::cout << "p50 close latency: " << percentile(close_durations, 0.50) << " us\n";
+    std::cout << "p99 close latency: " << percentile(close_durations, 0.99) << " us\n";
+    std::cout << "Total close time: " << std::accumulate(close_durations.begin(), close_durations.end(), 0.0) / iterations
+              << " us per iteration\n";
+    std::cout << "Fsync write calls: " << lab2_get_fsync_write_ios() << std::endl;
+    std::cout << "Fsync written bytes: " << lab2_get_fsync_write_bytes() << std::endl << std::endl;
+    lab2_reset_cache_counters();
+}
+
 int main(int argc, char* argv[]) {
-    if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " <file_path> <iterations> <use_cache>" << std::endl;
+    std::vector<std::string> args;
+    Lab2Config config = {};
+    BenchmarkFlags flags;
+    if (!parse_benchmark_args(argc, argv, args, config, &flags, { "file-size", "handles", "writers", "datasync" }) || args.size() < 3) {
+        std::cerr << "Usage: " << argv[0] << " <file_path> <iterations> <use_cache> [--file-size=BYTES] [--handles=N] [--writers=N] [--datasync] " CACHE_FLAGS_USAGE " " STATS_FLAGS_USAGE << std::endl;
         return 1;
     }
 
-    std::string file_path = argv[1];
-    int iterations = std::stoi(argv[2]);
-    bool use_cache = std::stoi(argv[3]) != 0;
+    if (lab2_init(&config) != 0) {
+        std::cerr << "Invalid cache configuration!" << std::endl;
+        return 1;
+    }
+
+    const StatsDumper stats_dumper(flags);
+    std::string file_path = args[0];
+    int iterations = std::stoi(args[1]);
+    bool use_cache = std::stoi(args[2]) != 0;
+    const size_t file_size = flags.count("file-size") ? parse_size(flags["file-size"]) : DEFAULT_FILE_SIZE;
+
+    if (flags.count("writers")) {
+        run_group_commit_benchmark(file_path, iterations, use_cache, std::stoi(flags["writers"]), flags.count("datasync") != 0);
+        return 0;
+    }
+
+    if (flags.count("handles")) {
+        run_shared_handles_benchmark(file_path, iterations, std::stoull(flags["handles"]));
+        return 0;
+    }
 
-    run_benchmark(file_path, iterations, use_cache);
+    run_benchmark(file_path, iterations, use_cache, file_size);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,163 @@
+#ifndef LAB2_PLATFORM_H
+#define LAB2_PLATFORM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <BaseTsd.h>
+#else
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+// Win32-совместимые типы и константы, чтобы API lab2_* был одинаковым на всех ОС
+typedef int HANDLE;
+typedef uint32_t DWORD;
+typedef int64_t LONGLONG;
+typedef ssize_t SSIZE_T;
+
+#define INVALID_HANDLE_VALUE (-1)
+
+#define GENERIC_READ  0x80000000u
+#define GENERIC_WRITE 0x40000000u
+
+#define CREATE_NEW        1
+#define CREATE_ALWAYS     2
+#define OPEN_EXISTING     3
+#define OPEN_ALWAYS       4
+#define TRUNCATE_EXISTING 5
+
+#define FILE_BEGIN   SEEK_SET
+#define FILE_CURRENT SEEK_CUR
+#define FILE_END     SEEK_END
+
+#define ERROR_INVALID_HANDLE    EBADF
+#define ERROR_INVALID_PARAMETER EINVAL
+#define ERROR_NOT_ENOUGH_MEMORY ENOMEM
+#define ERROR_FILE_NOT_FOUND    ENOENT
+#define ERROR_ACCESS_DENIED     EACCES
+#define ERROR_PRIVILEGE_NOT_HELD EPERM
+
+inline DWORD GetLastError() { return static_cast<DWORD>(errno); }
+inline void SetLastError(const DWORD error) { errno = static_cast<int>(error); }
+#endif
+
+// Платформенный слой: доступ к диску в обход page cache ОС
+// (FILE_FLAG_NO_BUFFERING на Windows, O_DIRECT на Linux). quiet — ошибку не печатать:
+// вызывающий разберет ее сам (например, повторит открытие с другими правами)
+HANDLE platform_open_direct(const char* path, DWORD access_mode, DWORD creation_disposition, bool quiet = false);
+int platform_close(HANDLE file_handle);
+
+struct PlatformIoVec {
+    void* base;
+    size_t length;
+};
+
+// Позиционные чтение/запись: один системный вызов вместо пары seek + read/write
+SSIZE_T platform_pread(HANDLE file_handle, void* buf, size_t count, LONGLONG offset);
+SSIZE_T platform_pwrite(HANDLE file_handle, const void* buf, size_t count, LONGLONG offset);
+// Чтение/запись нескольких буферов из/в непрерывный участок файла
+SSIZE_T platform_preadv(HANDLE file_handle, const PlatformIoVec* vectors, int count, LONGLONG offset);
+SSIZE_T platform_pwritev(HANDLE file_handle, const PlatformIoVec* vectors, int count, LONGLONG offset);
+int platform_flush(HANDLE file_handle);
+// Сброс только данных (fdatasync): метаданные вроде времени изменения не пишутся, размер — если нужен для чтения данных
+int platform_flush_data(HANDLE file_handle);
+
+// Асинхронный ввод-вывод: io_uring на Linux; на Windows чтение выполняется при постановке,
+// а завершение отдается через platform_async_wait. Постановкой занимается один поток за раз,
+// разбором завершений — другой (один на кольцо)
+struct PlatformAsyncRing;
+
+struct PlatformAsyncCompletion {
+    void* user_data;
+    SSIZE_T result; // Число байт или -код ошибки
+};
+
+// nullptr, если асинхронный ввод-вывод недоступен (старое ядро, запрет io_uring)
+PlatformAsyncRing* platform_async_create(unsigned int depth);
+void platform_async_destroy(PlatformAsyncRing* ring);
+// Ставит чтение в очередь и отправляет его ядру. vectors должны жить до завершения;
+// false — ошибка постановки (очередь отправки заполнена)
+bool platform_async_readv(PlatformAsyncRing* ring, HANDLE file_handle, const PlatformIoVec* vectors, int count,
+                          LONGLONG offset, void* user_data);
+// Пустая операция: будит поток, ждущий в platform_async_wait
+bool platform_async_nop(PlatformAsyncRing* ring, void* user_data);
+// Ждет хотя бы одно завершение и забирает не больше max; -1 при ошибке
+int platform_async_wait(PlatformAsyncRing* ring, PlatformAsyncCompletion* completions, int max);
+
+// Размер логического сектора устройства, на котором лежит файл
+size_t platform_get_sector_size(HANDLE file_handle);
+
+// Размер файла в байтах, -1 при ошибке
+LONGLONG platform_get_file_size(HANDLE file_handle);
+// Усечение или продление файла до size байт (ftruncate / FileEndOfFileInfo)
+int platform_set_file_size(HANDLE file_handle, LONGLONG size);
+
+// Отображение файла в память только для чтения (mmap / MapViewOfFile); nullptr при ошибке
+const char* platform_map_file(HANDLE file_handle, size_t size);
+void platform_unmap_file(const char* data, size_t size);
+
+enum PlatformAccessHint {
+    PLATFORM_ACCESS_NORMAL,
+    PLATFORM_ACCESS_SEQUENTIAL,
+    PLATFORM_ACCESS_RANDOM,
+    PLATFORM_ACCESS_WILLNEED, // Начать чтение участка заранее
+};
+
+// Подсказка ОС о доступе к участку отображения (madvise / PrefetchVirtualMemory)
+void platform_advise(const char* data, size_t length, PlatformAccessHint hint);
+// Сколько участков по unit байт из [data, data + length) целиком в памяти (mincore / QueryWorkingSetEx)
+size_t platform_count_resident(const char* data, size_t length, size_t unit);
+
+struct PlatformFileInfo {
+    LONGLONG file_id; // Уникальный идентификатор файла (индекс файла / пара st_dev + st_ino)
+    LONGLONG size;
+    LONGLONG modified; // Время последнего изменения (нс с эпохи / интервалы FILETIME)
+};
+
+// Идентификатор, размер и время изменения файла одним запросом (GetFileInformationByHandle / fstat); -1 при ошибке
+int platform_get_file_info(HANDLE file_handle, PlatformFileInfo* info);
+
+void* platform_aligned_alloc(size_t size, size_t alignment);
+void platform_aligned_free(void* ptr);
+
+// Одна большая область под буферы блоков, выровненная по странице. size округляется вверх
+// до размера страницы; с huge_pages сначала пробуются большие страницы (MAP_HUGETLB / MEM_LARGE_PAGES),
+// used_huge_pages сообщает, получилось ли. node >= 0 — страницы берутся с этого узла NUMA
+// (mbind / VirtualAllocExNuma), пока на нем есть память
+void* platform_alloc_arena(size_t& size, bool huge_pages, bool& used_huge_pages, int node = -1);
+void platform_free_arena(void* ptr, size_t size);
+// Закрепление области в физической памяти (mlock / VirtualLock)
+int platform_lock_memory(void* ptr, size_t size);
+
+// Топология NUMA (/sys/devices/system/node / GetNumaAvailableMemoryNodeEx): номера узлов с памятью
+// по возрастанию, номера могут идти с пропусками ("0,2"). Без сведений о топологии — один узел 0
+std::vector<unsigned int> platform_numa_nodes();
+// Номера процессоров меньше этого числа
+size_t platform_cpu_count();
+// Узел процессора; -1, если неизвестен
+int platform_numa_node_of_cpu(unsigned int cpu);
+// Процессор, на котором сейчас выполняется поток (sched_getcpu / GetCurrentProcessorNumberEx); -1 при ошибке
+int platform_current_cpu();
+// Привязка текущего потока к процессорам узла (sched_setaffinity / SetThreadGroupAffinity)
+int platform_pin_thread_to_node(unsigned int node);
+
+// Именованная разделяемая память (shm_open + mmap / именованный CreateFileMapping). Первый процесс
+// создает обнуленный сегмент (created = true), остальные подключаются к существующему; размер
+// существующего должен быть не меньше size. nullptr при ошибке
+void* platform_shm_open(const char* name, size_t size, bool& created);
+void platform_shm_close(void* data, size_t size);
+// Удаление имени: подключенные процессы продолжают работать с сегментом (на Windows сегмент
+// исчезает сам с последним процессом). 0 — удалено или не существовало
+int platform_shm_unlink(const char* name);
+
+uint32_t platform_process_id();
+// false — процесса с таким номером больше нет
+bool platform_process_alive(uint32_t process_id);
+
+#endif
@@ -0,0 +1,623 @@
+#include "platform.hpp"
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <climits>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <sched.h>
+#include <sys/syscall.h>
+#if __has_include(<linux/mempolicy.h>)
+#include <linux/mempolicy.h>
+#endif
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define LAB2_HAVE_IO_URING 1
+#endif
+
+HANDLE platform_open_direct(const char* path, const DWORD access_mode, const DWORD creation_disposition, const bool quiet) {
+    int flags = O_DIRECT; // Отключение кэширования ОС
+
+    if ((access_mode & GENERIC_READ) && (access_mode & GENERIC_WRITE)) {
+        flags |= O_RDWR;
+    } else if (access_mode & GENERIC_WRITE) {
+        flags |= O_WRONLY;
+    } else {
+        flags |= O_RDONLY;
+    }
+
+    switch (creation_disposition) {
+        case CREATE_NEW: flags |= O_CREAT | O_EXCL; break;
+        case CREATE_ALWAYS: flags |= O_CREAT | O_TRUNC; break;
+        case OPEN_ALWAYS: flags |= O_CREAT; break;
+        case TRUNCATE_EXISTING: flags |= O_TRUNC; break;
+        case OPEN_EXISTING: break;
+        default:
+            errno = EINVAL;
+            return INVALID_HANDLE_VALUE;
+    }
+
+    const int fd = open(path, flags, 0644);
+    if (fd < 0) {
+        if (!quiet) {
+            std::cerr << "open failed: " << std::strerror(errno) << std::endl;
+        }
+        return INVALID_HANDLE_VALUE;
+    }
+    return fd;
+}
+
+int platform_close(const HANDLE file_handle) {
+    return close(file_handle) == 0 ? 0 : -1;
+}
+
+SSIZE_T platform_pread(const HANDLE file_handle, void* buf, const size_t count, const LONGLONG offset) {
+    SSIZE_T result;
+    do {
+        result = pread(file_handle, buf, count, offset);
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+SSIZE_T platform_pwrite(const HANDLE file_handle, const void* buf, const size_t count, const LONGLONG offset) {
+    SSIZE_T result;
+    do {
+        result = pwrite(file_handle, buf, count, offset);
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+// Общий цикл preadv/pwritev: вызов берет не больше IOV_MAX векторов, короткая передача
+// останавливает цикл. Векторы лежат на стеке, чтобы промахи не обращались к аллокатору
+template <typename VectorCall>
+static SSIZE_T transfer_vectors(const PlatformIoVec* vectors, const int count, LONGLONG offset, VectorCall call) {
+    iovec iov[IOV_MAX];
+    SSIZE_T total = 0;
+    for (int first = 0; first < count; first += IOV_MAX) {
+        const int batch = std::min(count - first, IOV_MAX);
+        size_t expected = 0;
+        for (int i = 0; i < batch; ++i) {
+            iov[i].iov_base = vectors[first + i].base;
+            iov[i].iov_len = vectors[first + i].length;
+            expected += iov[i].iov_len;
+        }
+
+        SSIZE_T result;
+        do {
+            result = call(iov, batch, offset);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0) {
+            return -1;
+        }
+        total += result;
+        offset += result;
+        if (static_cast<size_t>(result) != expected) {
+            break; // Короткая передача: вызывающий сравнит total с ожидаемым объемом
+        }
+    }
+    return total;
+}
+
+SSIZE_T platform_preadv(const HANDLE file_handle, const PlatformIoVec* vectors, const int count, const LONGLONG offset) {
+    return transfer_vectors(vectors, count, offset, [file_handle](const iovec* iov, const int batch, const LONGLONG position) {
+        return preadv(file_handle, iov, batch, position);
+    });
+}
+
+SSIZE_T platform_pwritev(const HANDLE file_handle, const PlatformIoVec* vectors, const int count, const LONGLONG offset) {
+    return transfer_vectors(vectors, count, offset, [file_handle](const iovec* iov, const int batch, const LONGLONG position) {
+        return pwritev(file_handle, iov, batch, position);
+    });
+}
+
+int platform_flush(const HANDLE file_handle) {
+    return fsync(file_handle) == 0 ? 0 : -1;
+}
+
+int platform_flush_data(const HANDLE file_handle) {
+    return fdatasync(file_handle) == 0 ? 0 : -1;
+}
+
+#ifdef LAB2_HAVE_IO_URING
+// io_uring через системные вызовы, без liburing: кольца отправки и завершения отображаются
+// в память, отправку ведет один поток, разбор завершений — другой
+struct PlatformAsyncRing {
+    int fd = -1;
+    void* sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void* cq_ring = nullptr;
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned cq_mask = 0;
+};
+
+static_assert(sizeof(PlatformIoVec) == sizeof(iovec) && offsetof(PlatformIoVec, base) == offsetof(iovec, iov_base) &&
+              offsetof(PlatformIoVec, length) == offsetof(iovec, iov_len), "PlatformIoVec must match iovec");
+
+template <typename T>
+static T* ring_field(void* ring, const unsigned offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+static void* map_ring(const int fd, const size_t size, const off_t offset) {
+    void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ring == MAP_FAILED ? nullptr : ring;
+}
+
+PlatformAsyncRing* platform_async_create(const unsigned int depth) {
+    io_uring_params params = {};
+    const int fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    auto ring = new PlatformAsyncRing();
+    ring->fd = fd;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        ring->sq_ring_size = ring->cq_ring_size = std::max(ring->sq_ring_size, ring->cq_ring_size);
+    }
+
+    ring->sq_ring = map_ring(fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+    ring->cq_ring = single_mmap ? ring->sq_ring : map_ring(fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = static_cast<io_uring_sqe*>(map_ring(fd, ring->sqes_size, IORING_OFF_SQES));
+    if (!ring->sq_ring || !ring->cq_ring || !ring->sqes) {
+        platform_async_destroy(ring);
+        return nullptr;
+    }
+
+    ring->sq_head = ring_field<unsigned>(ring->sq_ring, params.sq_off.head);
+    ring->sq_tail = ring_field<unsigned>(ring->sq_ring, params.sq_off.tail);
+    ring->sq_array = ring_field<unsigned>(ring->sq_ring, params.sq_off.array);
+    ring->sq_mask = *ring_field<unsigned>(ring->sq_ring, params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = ring_field<unsigned>(ring->cq_ring, params.cq_off.head);
+    ring->cq_tail = ring_field<unsigned>(ring->cq_ring, params.cq_off.tail);
+    ring->cqes = ring_field<io_uring_cqe>(ring->cq_ring, params.cq_off.cqes);
+    ring->cq_mask = *ring_field<unsigned>(ring->cq_ring, params.cq_off.ring_mask);
+    return ring;
+}
+
+void platform_async_destroy(PlatformAsyncRing* ring) {
+    if (!ring) {
+        return;
+    }
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+    delete ring;
+}
+
+// Заполняет следующий SQE и сразу отправляет его ядру
+static bool submit_sqe(PlatformAsyncRing* ring, const io_uring_sqe& prepared) {
+    const unsigned tail = *ring->sq_tail;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        errno = EBUSY;
+        return false;
+    }
+    const unsigned index = tail & ring->sq_mask;
+    ring->sqes[index] = prepared;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    // SQE уже в кольце: временные ошибки повторяем, иначе он ушел бы с чужим вызовом
+    long submitted;
+    do {
+        submitted = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, nullptr, 0);
+        if (submitted < 0 && (errno == EAGAIN || errno == EBUSY)) {
+            sched_yield();
+        }
+    } while (submitted < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+    return submitted == 1;
+}
+
+bool platform_async_readv(PlatformAsyncRing* ring, const HANDLE file_handle, const PlatformIoVec* vectors, const int count,
+                          const LONGLONG offset, void* user_data) {
+    io_uring_sqe sqe = {};
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = file_handle;
+    sqe.addr = reinterpret_cast<uint64_t>(vectors);
+    sqe.len = static_cast<uint32_t>(count);
+    sqe.off = static_cast<uint64_t>(offset);
+    sqe.user_data = reinterpret_cast<uint64_t>(user_data);
+    return submit_sqe(ring, sqe);
+}
+
+bool platform_async_nop(PlatformAsyncRing* ring, void* user_data) {
+    io_uring_sqe sqe = {};
+    sqe.opcode = IORING_OP_NOP;
+    sqe.fd = -1;
+    sqe.user_data = reinterpret_cast<uint64_t>(user_data);
+    return submit_sqe(ring, sqe);
+}
+
+int platform_async_wait(PlatformAsyncRing* ring, PlatformAsyncCompletion* completions, const int max) {
+    while (true) {
+        unsigned head = *ring->cq_head;
+        const unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if (head != tail) {
+            int count = 0;
+            for (; head != tail && count < max; ++head, ++count) {
+                const io_uring_cqe& cqe = ring->cqes[head & ring->cq_mask];
+                completions[count] = { reinterpret_cast<void*>(cqe.user_data), cqe.res };
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+            return count;
+        }
+        if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+}
+#else
+PlatformAsyncRing* platform_async_create(unsigned int) {
+    return nullptr;
+}
+
+void platform_async_destroy(PlatformAsyncRing*) {}
+
+bool platform_async_readv(PlatformAsyncRing*, HANDLE, const PlatformIoVec*, int, LONGLONG, void*) {
+    return false;
+}
+
+bool platform_async_nop(PlatformAsyncRing*, void*) {
+    return false;
+}
+
+int platform_async_wait(PlatformAsyncRing*, PlatformAsyncCompletion*, int) {
+    return -1;
+}
+#endif
+
+size_t platform_get_sector_size(const HANDLE file_handle) {
+    constexpr size_t fallback_sector_size = 512;
+
+    struct stat file_info;
+    if (fstat(file_handle, &file_info) != 0) {
+        return fallback_sector_size;
+    }
+
+    // Для раздела очередь запросов описана у родительского устройства
+    const std::string device = "/sys/dev/block/" + std::to_string(major(file_info.st_dev)) + ":" +
+                               std::to_string(minor(file_info.st_dev));
+    for (const char* queue : { "/queue/logical_block_size", "/../queue/logical_block_size" }) {
+        std::ifstream sysfs_file(device + queue);
+        size_t sector_size = 0;
+        if (sysfs_file >> sector_size && sector_size > 0) {
+            return sector_size;
+        }
+    }
+    return fallback_sector_size;
+}
+
+int platform_get_file_info(const HANDLE file_handle, PlatformFileInfo* info) {
+    struct stat file_info;
+    if (fstat(file_handle, &file_info) != 0) {
+        std::cerr << "fstat failed: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    // Сочетание устройства и inode уникально; старший бит сброшен, чтобы id не был отрицательным
+    const uint64_t id = (static_cast<uint64_t>(file_info.st_dev) << 40) ^ static_cast<uint64_t>(file_info.st_ino);
+    info->file_id = static_cast<LONGLONG>(id & 0x7FFFFFFFFFFFFFFFull);
+    info->size = static_cast<LONGLONG>(file_info.st_size);
+    info->modified = static_cast<LONGLONG>(file_info.st_mtim.tv_sec) * 1000000000 + file_info.st_mtim.tv_nsec;
+    return 0;
+}
+
+LONGLONG platform_get_file_size(const HANDLE file_handle) {
+    struct stat file_info;
+    if (fstat(file_handle, &file_info) != 0) {
+        return -1;
+    }
+    return static_cast<LONGLONG>(file_info.st_size);
+}
+
+int platform_set_file_size(const HANDLE file_handle, const LONGLONG size) {
+    int result;
+    do {
+        result = ftruncate(file_handle, size);
+    } while (result != 0 && errno == EINTR);
+    return result == 0 ? 0 : -1;
+}
+
+const char* platform_map_file(const HANDLE file_handle, const size_t size) {
+    // O_DIRECT влияет только на read/write: страницы отображения идут через page cache
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, file_handle, 0);
+    if (data == MAP_FAILED) {
+        std::cerr << "mmap failed: " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    return static_cast<const char*>(data);
+}
+
+void platform_unmap_file(const char* data, const size_t size) {
+    if (data) {
+        munmap(const_cast<char*>(data), size);
+    }
+}
+
+// Начало участка, выровненное вниз по странице: madvise и mincore требуют выровненный адрес
+static const char* page_align_down(const char* data, size_t& length) {
+    const uintptr_t page_mask = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE)) - 1;
+    const uintptr_t address = reinterpret_cast<uintptr_t>(data);
+    length += address & page_mask;
+    return reinterpret_cast<const char*>(address & ~page_mask);
+}
+
+void platform_advise(const char* data, size_t length, const PlatformAccessHint hint) {
+    int advice = MADV_NORMAL;
+    switch (hint) {
+        case PLATFORM_ACCESS_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+        case PLATFORM_ACCESS_RANDOM: advice = MADV_RANDOM; break;
+        case PLATFORM_ACCESS_WILLNEED: advice = MADV_WILLNEED; break;
+        case PLATFORM_ACCESS_NORMAL: break;
+    }
+    const char* start = page_align_down(data, length);
+    madvise(const_cast<char*>(start), length, advice);
+}
+
+size_t platform_count_resident(const char* data, const size_t length, const size_t unit) {
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t mapped_length = length;
+    const char* start = page_align_down(data, mapped_length);
+    const size_t skew = static_cast<size_t>(data - start);
+    thread_local std::vector<unsigned char> pages;
+    pages.resize((mapped_length + page_size - 1) / page_size);
+    if (length == 0 || mincore(const_cast<char*>(start), mapped_length, pages.data()) != 0) {
+        return 0;
+    }
+
+    size_t resident = 0;
+    for (size_t unit_start = 0; unit_start < length; unit_start += unit) {
+        const size_t unit_end = std::min(unit_start + unit, length);
+        bool in_memory = true;
+        for (size_t page = (skew + unit_start) / page_size; page <= (skew + unit_end - 1) / page_size; ++page) {
+            in_memory = in_memory && (pages[page] & 1);
+        }
+        resident += in_memory;
+    }
+    return resident;
+}
+
+void* platform_aligned_alloc(const size_t size, const size_t alignment) {
+    void* buf = nullptr;
+    if (posix_memalign(&buf, alignment, size) != 0) {
+        return nullptr;
+    }
+    return buf;
+}
+
+void platform_aligned_free(void* ptr) {
+    std::free(ptr);
+}
+
+// Страницы еще не тронуты: политика mbind решает, с какого узла они выделятся при первом обращении.
+// MPOL_PREFERRED, а не MPOL_BIND: когда память узла кончится, страницы возьмутся с соседнего
+static void bind_arena_to_node(void* arena, const size_t size, const int node) {
+#if defined(SYS_mbind) && defined(MPOL_PREFERRED)
+    if (node < 0) {
+        return;
+    }
+    constexpr size_t MASK_BITS = sizeof(unsigned long) * CHAR_BIT;
+    std::vector<unsigned long> node_mask(static_cast<size_t>(node) / MASK_BITS + 1, 0);
+    node_mask[node / MASK_BITS] |= 1ul << (node % MASK_BITS);
+    // Ядро читает maxnode - 1 бит маски
+    if (syscall(SYS_mbind, arena, size, MPOL_PREFERRED, node_mask.data(), node_mask.size() * MASK_BITS + 1, 0) != 0) {
+        std::cerr << "mbind to node " << node << " failed: " << std::strerror(errno) << std::endl;
+    }
+#else
+    (void)arena; (void)size; (void)node;
+#endif
+}
+
+void* platform_alloc_arena(size_t& size, const bool huge_pages, bool& used_huge_pages, const int node) {
+    used_huge_pages = false;
+#ifdef MAP_HUGETLB
+    if (huge_pages) {
+        constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+        const size_t huge_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        void* arena = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (arena != MAP_FAILED) {
+            size = huge_size;
+            used_huge_pages = true;
+            bind_arena_to_node(arena, size, node);
+            return arena;
+        }
+    }
+#endif
+
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size = (size + page_size - 1) & ~(page_size - 1);
+    void* arena = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) {
+        // Пул явных больших страниц пуст: просим прозрачные (THP)
+        madvise(arena, size, MADV_HUGEPAGE);
+    }
+#endif
+    bind_arena_to_node(arena, size, node);
+    return arena;
+}
+
+void platform_free_arena(void* ptr, const size_t size) {
+    if (ptr) {
+        munmap(ptr, size);
+    }
+}
+
+int platform_lock_memory(void* ptr, const size_t size) {
+    return mlock(ptr, size);
+}
+
+// Список вида "0-3,8-11" из sysfs; пустой, если файла нет
+static std::vector<unsigned int> read_sysfs_list(const std::string& path) {
+    std::vector<unsigned int> values;
+    std::ifstream sysfs_file(path);
+    std::string range;
+    while (std::getline(sysfs_file, range, ',')) {
+        unsigned int first = 0;
+        unsigned int last = 0;
+        const int parsed = std::sscanf(range.c_str(), "%u-%u", &first, &last);
+        if (parsed < 1) {
+            continue;
+        }
+        for (unsigned int value = first; value <= (parsed == 2 ? last : first); ++value) {
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+static std::string node_cpu_list(const unsigned int node) {
+    return "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+}
+
+std::vector<unsigned int> platform_numa_nodes() {
+    std::vector<unsigned int> nodes = read_sysfs_list("/sys/devices/system/node/has_memory");
+    if (nodes.empty()) {
+        return { 0 };
+    }
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    return nodes;
+}
+
+size_t platform_cpu_count() {
+    const long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    return cpus > 0 ? static_cast<size_t>(cpus) : 1;
+}
+
+int platform_numa_node_of_cpu(const unsigned int cpu) {
+    // Топология не меняется: sysfs читается один раз
+    static const std::vector<int> cpu_nodes = [] {
+        std::vector<int> nodes(platform_cpu_count(), -1);
+        for (const unsigned int node : read_sysfs_list("/sys/devices/system/node/online")) {
+            for (const unsigned int node_cpu : read_sysfs_list(node_cpu_list(node))) {
+                if (node_cpu < nodes.size()) {
+                    nodes[node_cpu] = static_cast<int>(node);
+                }
+            }
+        }
+        return nodes;
+    }();
+    return cpu < cpu_nodes.size() ? cpu_nodes[cpu] : -1;
+}
+
+int platform_current_cpu() {
+    return sched_getcpu();
+}
+
+int platform_pin_thread_to_node(const unsigned int node) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    bool any = false;
+    for (const unsigned int cpu : read_sysfs_list(node_cpu_list(node))) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpus);
+            any = true;
+        }
+    }
+    if (!any) {
+        errno = EINVAL;
+        return -1;
+    }
+    return sched_setaffinity(0, sizeof(cpus), &cpus);
+}
+
+// Имя POSIX shm начинается с '/'
+static std::string shm_path(const char* name) {
+    return name[0] == '/' ? std::string(name) : "/" + std::string(name);
+}
+
+void* platform_shm_open(const char* name, const size_t size, bool& created) {
+    const std::string path = shm_path(name);
+    created = false;
+    int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        created = true;
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            std::cerr << "ftruncate failed: " << std::strerror(errno) << std::endl;
+            close(fd);
+            shm_unlink(path.c_str());
+            return nullptr;
+        }
+    } else if (errno == EEXIST) {
+        fd = shm_open(path.c_str(), O_RDWR, 0600);
+        // Создатель мог еще не успеть задать размер
+        struct stat info = {};
+        for (int attempt = 0; fd >= 0 && attempt < 1000; ++attempt) {
+            if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) >= size) {
+                break;
+            }
+            usleep(1000);
+        }
+        if (fd >= 0 && static_cast<size_t>(info.st_size) < size) {
+            std::cerr << "shared memory segment " << path << " is smaller than requested" << std::endl;
+            close(fd);
+            errno = EINVAL;
+            return nullptr;
+        }
+    }
+    if (fd < 0) {
+        std::cerr << "shm_open failed: " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // Отображение держит сегмент само
+    if (data == MAP_FAILED) {
+        std::cerr << "mmap failed: " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    return data;
+}
+
+void platform_shm_close(void* data, const size_t size) {
+    if (data) {
+        munmap(data, size);
+    }
+}
+
+int platform_shm_unlink(const char* name) {
+    return shm_unlink(shm_path(name).c_str()) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+uint32_t platform_process_id() {
+    return static_cast<uint32_t>(getpid());
+}
+
+bool platform_process_alive(const uint32_t process_id) {
+    return kill(static_cast<pid_t>(process_id), 0) == 0 || errno != ESRCH;
+}
@@ -0,0 +1,368 @@
+#include "platform.hpp"
+#include <malloc.h>
+#include <psapi.h>
+#include <algorithm>
+#include <iostream>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+HANDLE platform_open_direct(const char* path, const DWORD access_mode, const DWORD creation_disposition, const bool quiet) {
+    HANDLE file_handle = CreateFileA(
+        path,
+        access_mode,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr,
+        creation_disposition,
+        FILE_FLAG_NO_BUFFERING, // Отключение кэширования ОС
+        nullptr
+    );
+
+    if (file_handle == INVALID_HANDLE_VALUE && !quiet) {
+        std::cerr << "CreateFile failed: " << GetLastError() << std::endl;
+    }
+    return file_handle;
+}
+
+int platform_close(const HANDLE file_handle) {
+    return CloseHandle(file_handle) ? 0 : -1;
+}
+
+SSIZE_T platform_pread(const HANDLE file_handle, void* buf, const size_t count, const LONGLONG offset) {
+    // Смещение в OVERLAPPED для синхронного хэндла задает позицию чтения без SetFilePointerEx
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    DWORD bytes_read = 0;
+    if (!ReadFile(file_handle, buf, static_cast<DWORD>(count), &bytes_read, &overlapped)) {
+        if (GetLastError() == ERROR_HANDLE_EOF) {
+            return 0;
+        }
+        return -1;
+    }
+    return static_cast<SSIZE_T>(bytes_read);
+}
+
+SSIZE_T platform_pwrite(const HANDLE file_handle, const void* buf, const size_t count, const LONGLONG offset) {
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    DWORD bytes_written = 0;
+    if (!WriteFile(file_handle, buf, static_cast<DWORD>(count), &bytes_written, &overlapped)) {
+        return -1;
+    }
+    return static_cast<SSIZE_T>(bytes_written);
+}
+
+SSIZE_T platform_preadv(const HANDLE file_handle, const PlatformIoVec* vectors, const int count, LONGLONG offset) {
+    // ReadFileScatter требует страничных буферов и асинхронного хэндла, поэтому читаем по очереди
+    SSIZE_T total = 0;
+    for (int i = 0; i < count; ++i) {
+        const SSIZE_T result = platform_pread(file_handle, vectors[i].base, vectors[i].length, offset);
+        if (result < 0) {
+            return -1;
+        }
+        total += result;
+        offset += result;
+        if (static_cast<size_t>(result) != vectors[i].length) {
+            break; // Конец файла
+        }
+    }
+    return total;
+}
+
+SSIZE_T platform_pwritev(const HANDLE file_handle, const PlatformIoVec* vectors, const int count, LONGLONG offset) {
+    // WriteFileGather требует страничных буферов и асинхронного хэндла, поэтому пишем по очереди
+    SSIZE_T total = 0;
+    for (int i = 0; i < count; ++i) {
+        const SSIZE_T result = platform_pwrite(file_handle, vectors[i].base, vectors[i].length, offset);
+        if (result < 0) {
+            return -1;
+        }
+        total += result;
+        offset += result;
+        if (static_cast<size_t>(result) != vectors[i].length) {
+            break;
+        }
+    }
+    return total;
+}
+
+// Перекрывающийся ввод-вывод требует хэндла с FILE_FLAG_OVERLAPPED, а кэш открывает файлы синхронно:
+// чтение выполняется прямо при постановке, завершение отдается через очередь
+struct PlatformAsyncRing {
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<PlatformAsyncCompletion> completions;
+};
+
+PlatformAsyncRing* platform_async_create(unsigned int) {
+    return new PlatformAsyncRing();
+}
+
+void platform_async_destroy(PlatformAsyncRing* ring) {
+    delete ring;
+}
+
+static bool push_completion(PlatformAsyncRing* ring, const PlatformAsyncCompletion& completion) {
+    {
+        std::lock_guard<std::mutex> ring_lock(ring->lock);
+        ring->completions.push_back(completion);
+    }
+    ring->ready.notify_one();
+    return true;
+}
+
+bool platform_async_readv(PlatformAsyncRing* ring, const HANDLE file_handle, const PlatformIoVec* vectors, const int count,
+                          const LONGLONG offset, void* user_data) {
+    const SSIZE_T result = platform_preadv(file_handle, vectors, count, offset);
+    return push_completion(ring, { user_data, result < 0 ? -static_cast<SSIZE_T>(GetLastError()) : result });
+}
+
+bool platform_async_nop(PlatformAsyncRing* ring, void* user_data) {
+    return push_completion(ring, { user_data, 0 });
+}
+
+int platform_async_wait(PlatformAsyncRing* ring, PlatformAsyncCompletion* completions, const int max) {
+    std::unique_lock<std::mutex> ring_lock(ring->lock);
+    ring->ready.wait(ring_lock, [ring] { return !ring->completions.empty(); });
+    int count = 0;
+    while (!ring->completions.empty() && count < max) {
+        completions[count++] = ring->completions.front();
+        ring->completions.pop_front();
+    }
+    return count;
+}
+
+int platform_flush(const HANDLE file_handle) {
+    return FlushFileBuffers(file_handle) ? 0 : -1;
+}
+
+// Win32 не умеет сбрасывать одни данные: это полный сброс
+int platform_flush_data(const HANDLE file_handle) {
+    return platform_flush(file_handle);
+}
+
+size_t platform_get_sector_size(const HANDLE file_handle) {
+    FILE_STORAGE_INFO storage_info;
+    if (!GetFileInformationByHandleEx(file_handle, FileStorageInfo, &storage_info, sizeof(storage_info))) {
+        return 512;
+    }
+    return storage_info.LogicalBytesPerSector;
+}
+
+int platform_get_file_info(const HANDLE file_handle, PlatformFileInfo* info) {
+    BY_HANDLE_FILE_INFORMATION file_info;
+    if (!GetFileInformationByHandle(file_handle, &file_info)) {
+        std::cerr << "GetFileInformationByHandle failed: " << GetLastError() << std::endl;
+        return -1;
+    }
+    // Сочетание индекса тома и идентификатора файла уникально
+    info->file_id = (static_cast<LONGLONG>(file_info.nFileIndexHigh) << 32) | file_info.nFileIndexLow;
+    info->size = (static_cast<LONGLONG>(file_info.nFileSizeHigh) << 32) | file_info.nFileSizeLow;
+    info->modified = (static_cast<LONGLONG>(file_info.ftLastWriteTime.dwHighDateTime) << 32) | file_info.ftLastWriteTime.dwLowDateTime;
+    return 0;
+}
+
+LONGLONG platform_get_file_size(const HANDLE file_handle) {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_handle, &size)) {
+        return -1;
+    }
+    return size.QuadPart;
+}
+
+int platform_set_file_size(const HANDLE file_handle, const LONGLONG size) {
+    FILE_END_OF_FILE_INFO end_of_file;
+    end_of_file.EndOfFile.QuadPart = size;
+    return SetFileInformationByHandle(file_handle, FileEndOfFileInfo, &end_of_file, sizeof(end_of_file)) ? 0 : -1;
+}
+
+const char* platform_map_file(const HANDLE file_handle, const size_t size) {
+    const HANDLE mapping = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        std::cerr << "CreateFileMapping failed: " << GetLastError() << std::endl;
+        return nullptr;
+    }
+    // Представление держит объект отображения само, хэндл можно закрыть сразу
+    const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    CloseHandle(mapping);
+    if (!data) {
+        std::cerr << "MapViewOfFile failed: " << GetLastError() << std::endl;
+    }
+    return static_cast<const char*>(data);
+}
+
+void platform_unmap_file(const char* data, size_t) {
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+}
+
+// Для отображений Windows различает только предзагрузку; режимы доступа задаются при открытии
+void platform_advise(const char* data, const size_t length, const PlatformAccessHint hint) {
+    if (hint == PLATFORM_ACCESS_WILLNEED) {
+        WIN32_MEMORY_RANGE_ENTRY range = { const_cast<char*>(data), length };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+}
+
+size_t platform_count_resident(const char* data, const size_t length, const size_t unit) {
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    const uintptr_t page_mask = system_info.dwPageSize - 1;
+    size_t resident = 0;
+    for (size_t unit_start = 0; unit_start < length; unit_start += unit) {
+        const uintptr_t unit_end = reinterpret_cast<uintptr_t>(data) + std::min(unit_start + unit, length);
+        bool in_memory = true;
+        for (uintptr_t page = (reinterpret_cast<uintptr_t>(data) + unit_start) & ~page_mask; in_memory && page < unit_end;
+             page += page_mask + 1) {
+            PSAPI_WORKING_SET_EX_INFORMATION info = {};
+            info.VirtualAddress = reinterpret_cast<void*>(page);
+            in_memory = QueryWorkingSetEx(GetCurrentProcess(), &info, sizeof(info)) && info.VirtualAttributes.Valid;
+        }
+        resident += in_memory;
+    }
+    return resident;
+}
+
+void* platform_aligned_alloc(const size_t size, const size_t alignment) {
+    return _aligned_malloc(size, alignment);
+}
+
+void platform_aligned_free(void* ptr) {
+    _aligned_free(ptr);
+}
+
+// node < 0 — без предпочтения узла
+static void* virtual_alloc_on_node(const size_t size, const DWORD allocation_type, const int node) {
+    if (node < 0) {
+        return VirtualAlloc(nullptr, size, allocation_type, PAGE_READWRITE);
+    }
+    return VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, allocation_type, PAGE_READWRITE,
+                              static_cast<DWORD>(node));
+}
+
+void* platform_alloc_arena(size_t& size, const bool huge_pages, bool& used_huge_pages, const int node) {
+    used_huge_pages = false;
+    if (huge_pages) {
+        // Требует привилегии SeLockMemoryPrivilege; без нее откатываемся на обычные страницы
+        const size_t large_page_size = GetLargePageMinimum();
+        if (large_page_size != 0) {
+            const size_t large_size = (size + large_page_size - 1) & ~(large_page_size - 1);
+            void* arena = virtual_alloc_on_node(large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, node);
+            if (arena) {
+                size = large_size;
+                used_huge_pages = true;
+                return arena;
+            }
+        }
+    }
+
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    const size_t page_size = system_info.dwPageSize;
+    size = (size + page_size - 1) & ~(page_size - 1);
+    return virtual_alloc_on_node(size, MEM_RESERVE | MEM_COMMIT, node);
+}
+
+void platform_free_arena(void* ptr, size_t) {
+    if (ptr) {
+        VirtualFree(ptr, 0, MEM_RELEASE);
+    }
+}
+
+int platform_lock_memory(void* ptr, const size_t size) {
+    return VirtualLock(ptr, size) ? 0 : -1;
+}
+
+std::vector<unsigned int> platform_numa_nodes() {
+    ULONG highest_node = 0;
+    std::vector<unsigned int> nodes;
+    if (GetNumaHighestNodeNumber(&highest_node)) {
+        for (ULONG node = 0; node <= highest_node; ++node) {
+            ULONGLONG available = 0;
+            if (GetNumaAvailableMemoryNodeEx(static_cast<USHORT>(node), &available) && available != 0) {
+                nodes.push_back(node);
+            }
+        }
+    }
+    if (nodes.empty()) {
+        nodes.push_back(0);
+    }
+    return nodes;
+}
+
+size_t platform_cpu_count() {
+    // Номер процессора — группа * 64 + номер в группе
+    return static_cast<size_t>(GetActiveProcessorGroupCount()) * 64;
+}
+
+int platform_numa_node_of_cpu(const unsigned int cpu) {
+    PROCESSOR_NUMBER processor = {};
+    processor.Group = static_cast<WORD>(cpu / 64);
+    processor.Number = static_cast<BYTE>(cpu % 64);
+    USHORT node = 0;
+    return GetNumaProcessorNodeEx(&processor, &node) ? node : -1;
+}
+
+int platform_current_cpu() {
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+    return processor.Group * 64 + processor.Number;
+}
+
+int platform_pin_thread_to_node(const unsigned int node) {
+    GROUP_AFFINITY affinity = {};
+    if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity) || affinity.Mask == 0) {
+        return -1;
+    }
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) ? 0 : -1;
+}
+
+// Объект в пространстве имен сеанса: без привилегии SeCreateGlobalPrivilege
+void* platform_shm_open(const char* name, const size_t size, bool& created) {
+    const std::string object_name = std::string("Local\\") + name;
+    const uint64_t mapping_size = size;
+    const HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                              static_cast<DWORD>(mapping_size >> 32), static_cast<DWORD>(mapping_size),
+                                              object_name.c_str());
+    if (!mapping) {
+        std::cerr << "CreateFileMapping failed: " << GetLastError() << std::endl;
+        return nullptr;
+    }
+    created = GetLastError() != ERROR_ALREADY_EXISTS;
+    void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    CloseHandle(mapping);
+    if (!data) {
+        std::cerr << "MapViewOfFile failed: " << GetLastError() << std::endl;
+    }
+    return data;
+}
+
+void platform_shm_close(void* data, size_t) {
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+}
+
+int platform_shm_unlink(const char*) {
+    return 0;
+}
+
+uint32_t platform_process_id() {
+    return static_cast<uint32_t>(GetCurrentProcessId());
+}
+
+bool platform_process_alive(const uint32_t process_id) {
+    const HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, process_id);
+    if (!process) {
+        return GetLastError() != ERROR_INVALID_PARAMETER; // Нет доступа — процесс есть
+    }
+    const bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+}
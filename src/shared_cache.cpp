@@ -0,0 +1,310 @@
+#include "shared_cache.hpp"
+#include "platform.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+namespace {
+
+constexpr char SEGMENT_MAGIC[8] = {'L', 'A', 'B', '2', 'S', 'H', 'M', '1'};
+constexpr uint32_t SEGMENT_VERSION = 1;
+constexpr size_t WAYS = 8;
+constexpr size_t DATA_ALIGNMENT = 4096;
+constexpr int64_t EMPTY_SLOT = -1;
+
+// Сегмент отображается в разные процессы по разным адресам: годятся только атомики без блокировок
+// и без указателей
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared segment needs lock-free 64-bit atomics");
+static_assert(std::atomic<int64_t>::is_always_lock_free, "shared segment needs lock-free 64-bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared segment needs lock-free 32-bit atomics");
+
+uint32_t state_version(const uint64_t state) {
+    return static_cast<uint32_t>(state);
+}
+
+uint32_t state_owner(const uint64_t state) {
+    return static_cast<uint32_t>(state >> 32);
+}
+
+uint64_t make_state(const uint32_t owner, const uint32_t version) {
+    return static_cast<uint64_t>(owner) << 32 | version;
+}
+
+size_t align_up(const size_t value, const size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+struct SharedCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t ways;
+    uint64_t block_size;
+    uint64_t set_count;
+    std::atomic<uint64_t> write_generation;
+    std::atomic<uint32_t> ready; // Создатель разметил сегмент
+};
+
+// Младшие 32 бита state — версия слота, нечетная, пока слот занят записью; старшие — номер процесса,
+// который его занял (чтобы забрать слот у упавшего процесса). Ключ и данные читаются без блокировки
+// и проверяются повторным чтением версии
+struct SharedCacheSlot {
+    std::atomic<uint64_t> state;
+    std::atomic<int64_t> file_id; // EMPTY_SLOT — слот свободен
+    std::atomic<int64_t> block_id;
+    std::atomic<uint32_t> referenced;
+};
+
+struct SharedCacheSet {
+    std::atomic<uint32_t> hand; // Стрелка clock набора
+    SharedCacheSlot slots[WAYS];
+};
+
+namespace {
+
+bool slot_matches(const SharedCacheSlot& slot, const LONGLONG file_id, const bool any_block,
+                  const LONGLONG block_id) {
+    return slot.file_id.load(std::memory_order_relaxed) == file_id &&
+           (any_block || slot.block_id.load(std::memory_order_relaxed) == block_id);
+}
+
+// Процесс, занявший слот, умер посреди записи: слот очищается и снова становится доступным.
+// false — слот успели забрать или освободить раньше
+bool reclaim_abandoned_slot(SharedCacheSlot& slot, const uint64_t state, const uint32_t process_id) {
+    if (platform_process_alive(state_owner(state))) {
+        return false;
+    }
+    uint64_t expected = state;
+    const uint32_t version = state_version(state);
+    if (!slot.state.compare_exchange_strong(expected, make_state(process_id, version + 2))) {
+        return false;
+    }
+    slot.file_id.store(EMPTY_SLOT, std::memory_order_relaxed);
+    slot.state.store(make_state(process_id, version + 3), std::memory_order_release);
+    return true;
+}
+
+// Данные блока хранятся 8-байтовыми атомиками: читатель может копировать блок одновременно с записью,
+// результат такого чтения отбрасывается по версии слота
+void load_words(const char* source, char* destination, const size_t size) {
+    const auto* words = reinterpret_cast<const std::atomic<uint64_t>*>(source);
+    for (size_t i = 0; i < size / sizeof(uint64_t); ++i) {
+        const uint64_t word = words[i].load(std::memory_order_relaxed);
+        std::memcpy(destination + i * sizeof(uint64_t), &word, sizeof(word));
+    }
+}
+
+void store_words(const char* source, char* destination, const size_t size) {
+    auto* words = reinterpret_cast<std::atomic<uint64_t>*>(destination);
+    for (size_t i = 0; i < size / sizeof(uint64_t); ++i) {
+        uint64_t word;
+        std::memcpy(&word, source + i * sizeof(uint64_t), sizeof(word));
+        words[i].store(word, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+std::unique_ptr<SharedBlockCache> SharedBlockCache::attach(const std::string& name, const size_t capacity,
+                                                           const size_t block_size) {
+    if (name.empty() || block_size % sizeof(uint64_t) != 0) {
+        std::cerr << "Invalid shared cache name or block size" << std::endl;
+        return nullptr;
+    }
+    const size_t set_count = std::max<size_t>(1, capacity / (block_size * WAYS));
+    const size_t data_offset = align_up(sizeof(SharedCacheHeader) + set_count * sizeof(SharedCacheSet),
+                                        DATA_ALIGNMENT);
+    const size_t segment_size = data_offset + set_count * WAYS * block_size;
+
+    bool created = false;
+    void* segment = platform_shm_open(name.c_str(), segment_size, created);
+    if (!segment) {
+        std::cerr << "Failed to open shared cache segment " << name << std::endl;
+        return nullptr;
+    }
+    auto* header = static_cast<SharedCacheHeader*>(segment);
+
+    if (created) {
+        header = new (segment) SharedCacheHeader();
+        std::memcpy(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+        header->version = SEGMENT_VERSION;
+        header->ways = WAYS;
+        header->block_size = block_size;
+        header->set_count = set_count;
+        header->write_generation.store(0, std::memory_order_relaxed);
+        auto* sets = new (header + 1) SharedCacheSet[set_count];
+        for (size_t i = 0; i < set_count; ++i) {
+            sets[i].hand.store(0, std::memory_order_relaxed);
+            for (SharedCacheSlot& slot : sets[i].slots) {
+                slot.state.store(0, std::memory_order_relaxed);
+                slot.file_id.store(EMPTY_SLOT, std::memory_order_relaxed);
+                slot.block_id.store(0, std::memory_order_relaxed);
+                slot.referenced.store(0, std::memory_order_relaxed);
+            }
+        }
+        header->ready.store(1, std::memory_order_release);
+    } else {
+        // Сегмент создан другим процессом: ждем, пока тот его разметит
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (header->ready.load(std::memory_order_acquire) == 0) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                std::cerr << "Shared cache segment " << name << " was never initialized" << std::endl;
+                platform_shm_close(segment, segment_size);
+                return nullptr;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (std::memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 ||
+            header->version != SEGMENT_VERSION || header->ways != WAYS || header->block_size != block_size ||
+            header->set_count != set_count) {
+            std::cerr << "Shared cache segment " << name << " has a different layout (block size "
+                      << header->block_size << ", " << header->set_count << " sets)" << std::endl;
+            platform_shm_close(segment, segment_size);
+            return nullptr;
+        }
+    }
+
+    std::unique_ptr<SharedBlockCache> cache(new SharedBlockCache(segment, segment_size, block_size));
+    cache->header = header;
+    cache->sets = reinterpret_cast<SharedCacheSet*>(header + 1);
+    cache->data = static_cast<char*>(segment) + data_offset;
+    cache->set_count = set_count;
+    return cache;
+}
+
+SharedBlockCache::SharedBlockCache(void* segment, const size_t segment_size, const size_t block_size)
+    : segment(segment), segment_size(segment_size), block_size(block_size), header(nullptr), sets(nullptr),
+      data(nullptr), set_count(0), process_id(platform_process_id()) {}
+
+SharedBlockCache::~SharedBlockCache() {
+    platform_shm_close(segment, segment_size);
+}
+
+SharedCacheSet& SharedBlockCache::set_of(const size_t hash) const {
+    // Старшие биты хэша выбирают сегмент кэша, младшие — набор
+    const uint64_t low = static_cast<uint32_t>(hash);
+    return sets[low * set_count >> 32];
+}
+
+char* SharedBlockCache::block_data(const SharedCacheSet& set, const size_t way) const {
+    return data + (static_cast<size_t>(&set - sets) * WAYS + way) * block_size;
+}
+
+bool SharedBlockCache::read(const LONGLONG file_id, const LONGLONG block_id, const size_t hash,
+                            char* destination) const {
+    SharedCacheSet& set = set_of(hash);
+    for (size_t way = 0; way < WAYS; ++way) {
+        SharedCacheSlot& slot = set.slots[way];
+        const uint64_t state = slot.state.load(std::memory_order_acquire);
+        if (state_version(state) & 1 || !slot_matches(slot, file_id, false, block_id)) {
+            continue;
+        }
+        load_words(block_data(set, way), destination, block_size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.state.load(std::memory_order_relaxed) != state) {
+            return false; // Блок вытеснили или переписали во время копирования
+        }
+        slot.referenced.store(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+uint64_t SharedBlockCache::write_generation() const {
+    return header->write_generation.load();
+}
+
+bool SharedBlockCache::insert(const LONGLONG file_id, const LONGLONG block_id, const size_t hash,
+                              const char* source, const uint64_t generation) {
+    if (header->write_generation.load() != generation) {
+        return false;
+    }
+    SharedCacheSet& set = set_of(hash);
+    for (SharedCacheSlot& slot : set.slots) {
+        if (slot_matches(slot, file_id, false, block_id)) {
+            return false; // Уже положил другой процесс
+        }
+    }
+
+    // Clock по слотам набора; слоты, занятые записью, пропускаются
+    for (size_t step = 0; step < 2 * WAYS; ++step) {
+        const size_t way = set.hand.fetch_add(1, std::memory_order_relaxed) % WAYS;
+        SharedCacheSlot& slot = set.slots[way];
+        uint64_t state = slot.state.load(std::memory_order_acquire);
+        if (state_version(state) & 1) {
+            reclaim_abandoned_slot(slot, state, process_id);
+            continue;
+        }
+        if (slot.file_id.load(std::memory_order_relaxed) != EMPTY_SLOT &&
+            slot.referenced.exchange(0, std::memory_order_relaxed) != 0) {
+            continue;
+        }
+        const uint32_t version = state_version(state);
+        if (!slot.state.compare_exchange_strong(state, make_state(process_id, version + 1))) {
+            continue;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        // Запись на диск, начавшаяся после чтения блока, могла не увидеть этот слот занятым:
+        // тогда данные уже устарели и блок не публикуется
+        if (header->write_generation.load() != generation) {
+            slot.file_id.store(EMPTY_SLOT, std::memory_order_relaxed);
+            slot.state.store(make_state(process_id, version + 2), std::memory_order_release);
+            return false;
+        }
+        slot.file_id.store(file_id, std::memory_order_relaxed);
+        slot.block_id.store(block_id, std::memory_order_relaxed);
+        slot.referenced.store(0, std::memory_order_relaxed);
+        store_words(source, block_data(set, way), block_size);
+        slot.state.store(make_state(process_id, version + 2), std::memory_order_release);
+        return true;
+    }
+    return false;
+}
+
+void SharedBlockCache::invalidate_slot(SharedCacheSet& set, const size_t way, const LONGLONG file_id,
+                                       const bool any_block, const LONGLONG block_id) {
+    SharedCacheSlot& slot = set.slots[way];
+    for (;;) {
+        uint64_t state = slot.state.load();
+        if (state_version(state) & 1) {
+            // Слот пишется: после записи в нем может оказаться этот блок со старыми данными
+            if (!reclaim_abandoned_slot(slot, state, process_id)) {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+        if (!slot_matches(slot, file_id, any_block, block_id)) {
+            return;
+        }
+        const uint32_t version = state_version(state);
+        if (slot.state.compare_exchange_strong(state, make_state(process_id, version + 1))) {
+            slot.file_id.store(EMPTY_SLOT, std::memory_order_relaxed);
+            slot.state.store(make_state(process_id, version + 2), std::memory_order_release);
+            return;
+        }
+    }
+}
+
+void SharedBlockCache::invalidate(const LONGLONG file_id, const LONGLONG block_id, const size_t hash) {
+    // Сначала поколение: вставки, прочитавшие диск до записи, после этого не опубликуются
+    header->write_generation.fetch_add(1);
+    SharedCacheSet& set = set_of(hash);
+    for (size_t way = 0; way < WAYS; ++way) {
+        invalidate_slot(set, way, file_id, false, block_id);
+    }
+}
+
+void SharedBlockCache::invalidate_file(const LONGLONG file_id) {
+    header->write_generation.fetch_add(1);
+    for (size_t i = 0; i < set_count; ++i) {
+        for (size_t way = 0; way < WAYS; ++way) {
+            invalidate_slot(sets[i], way, file_id, true, 0);
+        }
+    }
+}
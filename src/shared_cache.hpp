@@ -0,0 +1,54 @@
+#ifndef LAB2_SHARED_CACHE_H
+#define LAB2_SHARED_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "cache.hpp"
+
+struct SharedCacheHeader;
+struct SharedCacheSet;
+
+// Общий для процессов уровень чистых блоков в именованном сегменте разделяемой памяти: буферы блоков,
+// их ключи и биты обращения clock. Сегмент множественно-ассоциативный: блок живет только в своем наборе
+// из нескольких слотов, поэтому отдельного индекса нет, а вытеснение — clock внутри набора.
+// Блокировок нет: слот защищен версией (seqlock), занимается CAS, и упавший процесс не оставляет
+// сегмент запертым — недописанный им слот забирается обратно по номеру процесса.
+// hash — hash_cache_key блока: по нему выбирается набор, во всех процессах он одинаков
+class SharedBlockCache {
+public:
+    // nullptr при ошибке, в том числе если сегмент с этим именем размечен под другой размер блока или ёмкость
+    static std::unique_ptr<SharedBlockCache> attach(const std::string& name, size_t capacity, size_t block_size);
+    ~SharedBlockCache();
+
+    // Копирует блок в data; false — блока нет или его как раз переписывают
+    bool read(LONGLONG file_id, LONGLONG block_id, size_t hash, char* data) const;
+    // Поколение записей на диск всех процессов; берется до чтения блока с диска и передается в insert
+    uint64_t write_generation() const;
+    // Блок не ставится, если после generation какой-то процесс что-то записал на диск: данные могли устареть
+    bool insert(LONGLONG file_id, LONGLONG block_id, size_t hash, const char* data, uint64_t generation);
+    // После записи блока на диск (или усечения файла) копии в сегменте устарели
+    void invalidate(LONGLONG file_id, LONGLONG block_id, size_t hash);
+    void invalidate_file(LONGLONG file_id);
+
+    size_t size() const { return segment_size; }
+
+private:
+    SharedBlockCache(void* segment, size_t segment_size, size_t block_size);
+
+    SharedCacheSet& set_of(size_t hash) const;
+    char* block_data(const SharedCacheSet& set, size_t way) const;
+    void invalidate_slot(SharedCacheSet& set, size_t way, LONGLONG file_id, bool any_block, LONGLONG block_id);
+
+    void* segment;
+    const size_t segment_size;
+    const size_t block_size;
+    SharedCacheHeader* header;
+    SharedCacheSet* sets;
+    char* data;
+    size_t set_count;
+    uint32_t process_id;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "stats.hpp"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+constexpr unsigned int HISTOGRAM_SUB_BITS = 3; // 8 корзин на степень двойки
+constexpr unsigned long long HISTOGRAM_MAX_NS = (1ull << 40) - 1;
+
+const char* const COUNTER_NAMES[LAB2_STAT_COUNT] = {
+    "hits", "misses", "coalesced_misses", "evictions", "dirty_evictions", "eviction_scan_steps",
+    "writeback_blocks", "disk_reads", "disk_read_bytes", "disk_writes", "disk_write_bytes",
+    "readahead_blocks", "readahead_hits", "readahead_wasted", "fsync_writes", "fsync_write_bytes",
+    "warmup_blocks", "compressed_hits", "compressed_stores", "compressed_rejects", "compressed_input_bytes",
+    "compressed_output_bytes", "shared_hits", "shared_inserts", "sync_calls", "sync_flushes",
+    "numa_local_hits", "numa_remote_hits",
+};
+
+const char* const LATENCY_NAMES[LAB2_LATENCY_COUNT] = { "hit", "miss", "flush", "decompress" };
+
+// Слоты живых потоков и итог завершившихся; baseline — снимок на момент сброса.
+// Сброс не трогает слоты: их пишут только владельцы
+struct StatsRegistry {
+    std::mutex lock;
+    std::vector<StatsSlot*> live_slots;
+    StatsSlot retired;
+    Lab2Stats baseline;
+};
+
+// Не разрушается при выходе: фоновые потоки кэша завершаются из деструкторов статических объектов
+StatsRegistry& registry() {
+    static StatsRegistry* const instance = new StatsRegistry();
+    return *instance;
+}
+
+struct StatsSlotOwner {
+    std::unique_ptr<StatsSlot> slot = std::make_unique<StatsSlot>();
+
+    StatsSlotOwner() {
+        std::lock_guard<std::mutex> lock(registry().lock);
+        registry().live_slots.push_back(slot.get());
+    }
+
+    ~StatsSlotOwner();
+};
+
+void add_slot(const StatsSlot& slot, Lab2Stats& stats) {
+    for (size_t i = 0; i < LAB2_STAT_COUNT; ++i) {
+        stats.counters[i] += slot.counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t kind = 0; kind < LAB2_LATENCY_COUNT; ++kind) {
+        Lab2Histogram& histogram = stats.latency[kind];
+        histogram.total_ns += slot.latency_total_ns[kind].load(std::memory_order_relaxed);
+        for (size_t bucket = 0; bucket < LAB2_HISTOGRAM_BUCKETS; ++bucket) {
+            const unsigned long long count = slot.latency_buckets[kind][bucket].load(std::memory_order_relaxed);
+            histogram.buckets[bucket] += count;
+            histogram.count += count;
+        }
+    }
+}
+
+void add_to_slot(std::atomic<unsigned long long>& target, const unsigned long long amount) {
+    target.store(target.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+StatsSlotOwner::~StatsSlotOwner() {
+    StatsRegistry& stats = registry();
+    std::lock_guard<std::mutex> lock(stats.lock);
+    for (size_t i = 0; i < LAB2_STAT_COUNT; ++i) {
+        add_to_slot(stats.retired.counters[i], slot->counters[i].load(std::memory_order_relaxed));
+    }
+    for (size_t kind = 0; kind < LAB2_LATENCY_COUNT; ++kind) {
+        add_to_slot(stats.retired.latency_total_ns[kind], slot->latency_total_ns[kind].load(std::memory_order_relaxed));
+        for (size_t bucket = 0; bucket < LAB2_HISTOGRAM_BUCKETS; ++bucket) {
+            add_to_slot(stats.retired.latency_buckets[kind][bucket],
+                        slot->latency_buckets[kind][bucket].load(std::memory_order_relaxed));
+        }
+    }
+    stats.live_slots.erase(std::find(stats.live_slots.begin(), stats.live_slots.end(), slot.get()));
+}
+
+// Итог без вычета снимка; вызывается под registry().lock
+void collect_raw(Lab2Stats& stats) {
+    stats = {};
+    add_slot(registry().retired, stats);
+    for (const StatsSlot* slot : registry().live_slots) {
+        add_slot(*slot, stats);
+    }
+}
+
+size_t latency_bucket(unsigned long long ns) {
+    ns = std::min(ns, HISTOGRAM_MAX_NS);
+    if (ns < (1ull << HISTOGRAM_SUB_BITS)) {
+        return static_cast<size_t>(ns);
+    }
+    unsigned int top_bit = HISTOGRAM_SUB_BITS;
+    while ((ns >> (top_bit + 1)) != 0) {
+        top_bit++;
+    }
+    const size_t sub_bucket = (ns >> (top_bit - HISTOGRAM_SUB_BITS)) & ((1u << HISTOGRAM_SUB_BITS) - 1);
+    return ((top_bit - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) + sub_bucket;
+}
+
+unsigned long long bucket_lower_bound(const size_t bucket) {
+    if (bucket < (1u << HISTOGRAM_SUB_BITS)) {
+        return bucket;
+    }
+    const unsigned int top_bit = static_cast<unsigned int>(bucket >> HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS - 1;
+    const unsigned long long mantissa = (1ull << HISTOGRAM_SUB_BITS) + (bucket & ((1u << HISTOGRAM_SUB_BITS) - 1));
+    return mantissa << (top_bit - HISTOGRAM_SUB_BITS);
+}
+
+} // namespace
+
+StatsSlot& local_stats() {
+    thread_local StatsSlotOwner owner;
+    return *owner.slot;
+}
+
+void record_latency(const Lab2LatencyKind kind, const std::chrono::steady_clock::time_point start) {
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const unsigned long long ns = static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    StatsSlot& slot = local_stats();
+    add_to_slot(slot.latency_buckets[kind][latency_bucket(ns)], 1);
+    add_to_slot(slot.latency_total_ns[kind], ns);
+}
+
+void collect_stats(Lab2Stats* stats, const bool since_reset) {
+    std::lock_guard<std::mutex> lock(registry().lock);
+    collect_raw(*stats);
+    if (!since_reset) {
+        return;
+    }
+    const Lab2Stats& baseline = registry().baseline;
+    for (size_t i = 0; i < LAB2_STAT_COUNT; ++i) {
+        stats->counters[i] -= baseline.counters[i];
+    }
+    for (size_t kind = 0; kind < LAB2_LATENCY_COUNT; ++kind) {
+        Lab2Histogram& histogram = stats->latency[kind];
+        histogram.count -= baseline.latency[kind].count;
+        histogram.total_ns -= baseline.latency[kind].total_ns;
+        for (size_t bucket = 0; bucket < LAB2_HISTOGRAM_BUCKETS; ++bucket) {
+            histogram.buckets[bucket] -= baseline.latency[kind].buckets[bucket];
+        }
+    }
+}
+
+unsigned long long collect_counter(const Lab2Counter counter) {
+    std::lock_guard<std::mutex> lock(registry().lock);
+    unsigned long long total = registry().retired.counters[counter].load(std::memory_order_relaxed);
+    for (const StatsSlot* slot : registry().live_slots) {
+        total += slot->counters[counter].load(std::memory_order_relaxed);
+    }
+    return total - registry().baseline.counters[counter];
+}
+
+void reset_stats() {
+    std::lock_guard<std::mutex> lock(registry().lock);
+    collect_raw(registry().baseline);
+}
+
+const char* lab2_counter_name(const Lab2Counter counter) {
+    return counter >= 0 && counter < LAB2_STAT_COUNT ? COUNTER_NAMES[counter] : nullptr;
+}
+
+const char* lab2_latency_name(const Lab2LatencyKind kind) {
+    return kind >= 0 && kind < LAB2_LATENCY_COUNT ? LATENCY_NAMES[kind] : nullptr;
+}
+
+unsigned long long lab2_histogram_percentile(const Lab2Histogram* histogram, const double fraction) {
+    if (!histogram || histogram->count == 0) {
+        return 0;
+    }
+    const double clamped = std::min(std::max(fraction, 0.0), 1.0);
+    const unsigned long long rank = std::max<unsigned long long>(
+        static_cast<unsigned long long>(clamped * static_cast<double>(histogram->count) + 0.5), 1);
+    unsigned long long seen = 0;
+    for (size_t bucket = 0; bucket < LAB2_HISTOGRAM_BUCKETS; ++bucket) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank) {
+            return bucket + 1 < LAB2_HISTOGRAM_BUCKETS ? bucket_lower_bound(bucket + 1) - 1 : HISTOGRAM_MAX_NS;
+        }
+    }
+    return HISTOGRAM_MAX_NS;
+}
@@ -0,0 +1,32 @@
+#ifndef LAB2_STATS_H
+#define LAB2_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include "cache.hpp"
+
+// Счетчики и гистограммы одного потока. Пишет только владелец, поэтому прибавление — обычные
+// load и store без атомарного RMW; атомарность нужна лишь для чтения слота из другого потока
+struct StatsSlot {
+    std::atomic<unsigned long long> counters[LAB2_STAT_COUNT];
+    std::atomic<unsigned long long> latency_buckets[LAB2_LATENCY_COUNT][LAB2_HISTOGRAM_BUCKETS];
+    std::atomic<unsigned long long> latency_total_ns[LAB2_LATENCY_COUNT];
+};
+
+// Слот текущего потока; при выходе потока его значения переносятся в общий итог
+StatsSlot& local_stats();
+
+inline void count_stat(const Lab2Counter counter, const unsigned long long amount = 1) {
+    std::atomic<unsigned long long>& value = local_stats().counters[counter];
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void record_latency(Lab2LatencyKind kind, std::chrono::steady_clock::time_point start);
+
+// Сумма слотов всех потоков; since_reset — за вычетом снимка последнего reset_stats
+void collect_stats(Lab2Stats* stats, bool since_reset);
+// Один счетчик с последнего reset_stats, без обхода гистограмм
+unsigned long long collect_counter(Lab2Counter counter);
+void reset_stats();
+
+#endif
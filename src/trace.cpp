@@ -0,0 +1,120 @@
+#include "trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+
+std::atomic<bool> trace_enabled{false};
+
+namespace {
+
+const char* const OP_NAMES[] = { "close", "read", "pread", "write", "pwrite", "lseek", "fsync", "fdatasync" };
+
+// Не разрушается при выходе: трасса закрывается через atexit, а вызовы API могут идти до конца программы
+struct TraceRecorder {
+    std::mutex lock;
+    FILE* output = nullptr;
+    std::chrono::steady_clock::time_point start;
+    std::unordered_map<HANDLE, unsigned long> files; // Хэндл -> номер открытия в трассе
+    unsigned long next_file = 0;
+    bool exit_hook_installed = false;
+};
+
+TraceRecorder& recorder() {
+    static TraceRecorder* const instance = new TraceRecorder();
+    return *instance;
+}
+
+// Вызов через хэндл, открытый до начала записи, в трассу не попадает: его открытия в ней нет
+bool find_file(const HANDLE file_handle, unsigned long& file) {
+    const auto iterator = recorder().files.find(file_handle);
+    if (iterator == recorder().files.end()) {
+        return false;
+    }
+    file = iterator->second;
+    return true;
+}
+
+} // namespace
+
+LONGLONG trace_now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - recorder().start).count();
+}
+
+void trace_open(const HANDLE file_handle, const char* path, const DWORD access_mode, const DWORD creation_disposition,
+                const LONGLONG start_us) {
+    TraceRecorder& trace = recorder();
+    std::lock_guard<std::mutex> lock(trace.lock);
+    if (!trace.output) {
+        return;
+    }
+    const unsigned long file = trace.next_file++;
+    trace.files[file_handle] = file;
+    std::fprintf(trace.output, "%lld open %lu %lu %lu %s\n", static_cast<long long>(start_us), file,
+                 static_cast<unsigned long>(access_mode), static_cast<unsigned long>(creation_disposition), path);
+}
+
+void trace_call(const TraceOp op, const HANDLE file_handle, const LONGLONG start_us, const LONGLONG first, const LONGLONG second) {
+    TraceRecorder& trace = recorder();
+    std::lock_guard<std::mutex> lock(trace.lock);
+    unsigned long file;
+    if (!trace.output || !find_file(file_handle, file)) {
+        return;
+    }
+    switch (op) {
+        case TRACE_CLOSE:
+        case TRACE_FSYNC:
+        case TRACE_FDATASYNC:
+            std::fprintf(trace.output, "%lld %s %lu\n", static_cast<long long>(start_us), OP_NAMES[op], file);
+            if (op == TRACE_CLOSE) {
+                trace.files.erase(file_handle);
+            }
+            break;
+        case TRACE_READ:
+        case TRACE_WRITE:
+            std::fprintf(trace.output, "%lld %s %lu %lld\n", static_cast<long long>(start_us), OP_NAMES[op], file,
+                         static_cast<long long>(first));
+            break;
+        default:
+            std::fprintf(trace.output, "%lld %s %lu %lld %lld\n", static_cast<long long>(start_us), OP_NAMES[op], file,
+                         static_cast<long long>(first), static_cast<long long>(second));
+            break;
+    }
+}
+
+int lab2_trace_start(const char* path) {
+    TraceRecorder& trace = recorder();
+    std::lock_guard<std::mutex> lock(trace.lock);
+    if (!path || trace.output) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    trace.output = std::fopen(path, "w");
+    if (!trace.output) {
+        std::cerr << "Cannot open trace file " << path << std::endl;
+        return -1;
+    }
+    std::fputs("# lab2 trace v1\n", trace.output);
+    trace.start = std::chrono::steady_clock::now();
+    trace.files.clear();
+    trace.next_file = 0;
+    if (!trace.exit_hook_installed) {
+        trace.exit_hook_installed = true;
+        std::atexit([] { lab2_trace_stop(); });
+    }
+    trace_enabled.store(true, std::memory_order_release); // После start: его читает trace_now_us без блокировки
+    return 0;
+}
+
+int lab2_trace_stop() {
+    TraceRecorder& trace = recorder();
+    std::lock_guard<std::mutex> lock(trace.lock);
+    if (!trace.output) {
+        return 0;
+    }
+    trace_enabled.store(false, std::memory_order_relaxed);
+    const bool closed = std::fclose(trace.output) == 0;
+    trace.output = nullptr;
+    return closed ? 0 : -1;
+}
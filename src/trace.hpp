@@ -0,0 +1,52 @@
+#ifndef LAB2_TRACE_H
+#define LAB2_TRACE_H
+
+#include <atomic>
+#include "cache.hpp"
+
+// Трасса вызовов API — текстовый файл, одна операция на строку:
+//   <мкс от начала записи> open <файл> <access_mode> <creation_disposition> <путь до конца строки>
+//   <мкс> read|write <файл> <count>            — с текущей позиции
+//   <мкс> pread|pwrite <файл> <offset> <count>
+//   <мкс> lseek <файл> <offset> <whence>
+//   <мкс> fsync|fdatasync|close <файл>
+// Файл — номер открытия в трассе (хэндлы ОС переиспользуются); строки с # — комментарии.
+// Время — начало вызова, а строка пишется по его завершении
+enum TraceOp {
+    TRACE_CLOSE,
+    TRACE_READ,
+    TRACE_PREAD,
+    TRACE_WRITE,
+    TRACE_PWRITE,
+    TRACE_LSEEK,
+    TRACE_FSYNC,
+    TRACE_FDATASYNC,
+};
+
+extern std::atomic<bool> trace_enabled;
+
+LONGLONG trace_now_us();
+void trace_open(HANDLE file_handle, const char* path, DWORD access_mode, DWORD creation_disposition, LONGLONG start_us);
+void trace_call(TraceOp op, HANDLE file_handle, LONGLONG start_us, LONGLONG first = 0, LONGLONG second = 0);
+
+// Вызов API, который пишется в трассу при выходе из области видимости
+struct TraceCall {
+    TraceCall(const TraceOp op, const HANDLE file_handle, const LONGLONG first = 0, const LONGLONG second = 0)
+        : enabled(trace_enabled.load(std::memory_order_acquire)), op(op), file_handle(file_handle),
+          start_us(enabled ? trace_now_us() : 0), first(first), second(second) {}
+
+    ~TraceCall() {
+        if (enabled) {
+            trace_call(op, file_handle, start_us, first, second);
+        }
+    }
+
+    const bool enabled;
+    const TraceOp op;
+    const HANDLE file_handle;
+    const LONGLONG start_us;
+    const LONGLONG first;
+    const LONGLONG second;
+};
+
+#endif